@@ -0,0 +1,104 @@
+#include "allocCounter.h"
+
+
+/*
+ * Zähler für Heap-Allokationen
+ *
+ * Ersetzt malloc, calloc, realloc, die memalign-Varianten und free des
+ * Prozesses durch Funktionen, die jeden Aufruf zählen und an die
+ * Implementierung der glibc weiterreichen. Damit lässt sich prüfen, dass die
+ * Ausführung der Befehle im eingeschwungenen Zustand ohne Allokationen
+ * auskommt (Befehl STAT, "benchmark alloc"). Hängt von internen Symbolen der
+ * glibc ab und wird deshalb nur mit "cmake -DALLOC_COUNTER=ON" gebaut.
+ *
+ */
+
+
+extern void* __libc_malloc (size_t size);
+extern void* __libc_calloc (size_t count, size_t size);
+extern void* __libc_realloc (void *ptr, size_t size);
+extern void* __libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+static unsigned long allocationCount = 0;
+static unsigned long releaseCount = 0;
+
+
+void* malloc (size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+
+void* calloc (size_t count, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+
+void* realloc (void *ptr, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+
+void* memalign (size_t alignment, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_memalign(alignment, size);
+}
+
+
+void* aligned_alloc (size_t alignment, size_t size)
+{
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_memalign(alignment, size);
+}
+
+
+int posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    void *block = __libc_memalign(alignment, size);
+    if (block == NULL) {
+        return ENOMEM;
+    }
+    *ptr = block;
+    return 0;
+}
+
+
+void free (void *ptr)
+{
+    if (ptr != NULL) {
+        __atomic_fetch_add(&releaseCount, 1, __ATOMIC_RELAXED);
+    }
+    __libc_free(ptr);
+}
+
+
+/**
+ * Liefert die Anzahl der Allokationen dieses Prozesses (inkl. der vom
+ * Eltern-Prozess geerbten).
+ *
+ */
+unsigned long getAllocationCount ()
+{
+    return __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Liefert die Anzahl der Freigaben dieses Prozesses (free ohne NULL).
+ *
+ */
+unsigned long getReleaseCount ()
+{
+    return __atomic_load_n(&releaseCount, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,1789 @@
+#include "utils.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+/*
+ * Lastgenerator / Benchmark
+ *
+ * Eigenständiger Client, der den Key-Value Server über das Text-Protokoll
+ * (und zum Vergleich über das binäre Protokoll) mit Anfragen aus mehreren
+ * Client-Prozessen belastet und die Durchsätze ausgibt. Der Server muss
+ * bereits laufen.
+ *
+ */
+
+
+#define BENCH_DEFAULT_HOST "127.0.0.1"
+#define BENCH_DEFAULT_PORT 5678
+#define BENCH_DEFAULT_BINARY_PORT 5679
+#define BENCH_RECV_BUFFER_SIZE PAGE_SIZE
+#define BENCH_MAX_PIPELINE_DEPTH 128
+#define BENCH_ALLOC_COMMANDS 10000
+#define BENCH_MAX_ALLOCS_PER_COMMAND 0.001 // Einmaliges Wachsen von Puffern ist erlaubt
+#define BENCH_STAT_TIMEOUT_MS 500 // Wartezeit auf die Zähler-Zeile nach der Lock-Statistik
+#define BENCH_SCAN_COUNT 1000 // Einträge pro SCAN
+#define BENCH_STREAM_ROUNDS 3 // Einzelne Wildcard-GETs für die Messung ohne Last
+#define BENCH_KEY_FILE "../data.csv" // Schlüssel für "match" (die Datei des Servers)
+#define BENCH_MATCH_ROUNDS 2000 // Durchläufe über alle Schlüssel pro Muster
+#define BENCH_LOOKUP_BATCH 256 // Schlüssel pro MGET für "lookup"
+#define BENCH_STARTUP_BATCH 100 // Einträge pro MPUT beim Befüllen für "startup"
+#define BENCH_STALL_SECONDS 0.001 // Ab hier zählt ein PUT in "snapshot" als blockiert
+#define BENCH_SERVER_DIRECTORY "/tmp/kvbenchXXXXXX" // Für selbst gestartete Server
+
+
+static const char *benchHost = BENCH_DEFAULT_HOST;
+static int benchPort = BENCH_DEFAULT_PORT;
+static int benchBinaryPort = BENCH_DEFAULT_BINARY_PORT;
+static int benchClients = 1;
+static long benchRecords = 1000000;
+static int benchValueSize = 16;
+static int benchDuration = 5;
+static int benchPipelineDepth = 1; // Nur für runPipelineClient
+static const char *benchPatternCommand = NULL; // Nur für runPatternClient
+static long benchPatternLines = 1;
+static long benchLookupRecords = 1; // Nur für runLookupClient
+static const char *benchLookupPrefix = "bench";
+static const char *benchServerPath = "./server"; // Nur für selbst gestartete Server
+static const char *benchServerLog = "/dev/null"; // Ausgabe selbst gestarteter Server
+
+
+void freeResourcesAndExit ()
+{
+    exit(EXIT_SUCCESS);
+}
+
+
+void fatalError (const char *message)
+{
+    perror(message);
+    exit(EXIT_FAILURE);
+}
+
+
+static double getTimeSeconds ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+
+/**
+ * Baut eine Verbindung zum Server auf, bei Fehlschlag -1.
+ *
+ */
+static int tryConnectToServer ()
+{
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(benchPort);
+    inet_pton(AF_INET, benchHost, &serverAddr.sin_addr);
+
+    int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
+    return sock;
+}
+
+
+static int connectToServer ()
+{
+    int sock = tryConnectToServer();
+    if (sock < 0) {
+        fatalError("connectToServer connect");
+    }
+    return sock;
+}
+
+
+/**
+ * Schickt einen einzelnen Befehl und wartet auf die vollständige Antwortzeile.
+ *
+ * @param sock - Verbindungs-Deskriptor
+ * @param request - Befehl inkl. Zeilenumbruch
+ * @param length - Länge des Befehls
+ */
+static void sendCommand (int sock, const char *request, size_t length)
+{
+    char buffer[BENCH_RECV_BUFFER_SIZE];
+
+    if (send(sock, request, length, 0) != (ssize_t)length) {
+        fatalError("sendCommand send");
+    }
+
+    ssize_t size;
+    do {
+        size = recv(sock, buffer, sizeof(buffer), 0);
+        if (size <= 0) {
+            fatalError("sendCommand recv");
+        }
+    } while (buffer[size - 1] != '\n');
+}
+
+
+/**
+ * Wartet auf eine bestimmte Anzahl an Antwortzeilen (Pipelining, Befehle
+ * mit mehreren Schlüsseln).
+ *
+ * @param sock - Verbindungs-Deskriptor
+ * @param lines - Anzahl der Zeilen
+ */
+static void receiveResponseLines (int sock, long lines)
+{
+    char buffer[BENCH_RECV_BUFFER_SIZE];
+
+    while (lines > 0) {
+        ssize_t size = recv(sock, buffer, sizeof(buffer), 0);
+        if (size <= 0) {
+            fatalError("receiveResponseLines recv");
+        }
+        for (ssize_t i = 0; i < size; i++) {
+            if (buffer[i] == '\n') lines--;
+        }
+    }
+}
+
+
+/**
+ * Fügt die Einträge [from, to) mit "benchClients" parallelen Prozessen ein.
+ * Jeder Prozess übernimmt einen zusammenhängenden Bereich der Schlüssel.
+ *
+ * @param from - erster Schlüssel
+ * @param to - letzter Schlüssel (exklusiv)
+ */
+static void runPutRange (long from, long to)
+{
+    long perClient = (to - from + benchClients - 1) / benchClients;
+
+    for (int c = 0; c < benchClients; c++) {
+        if (fork() != 0) continue;
+
+        char value[BENCH_RECV_BUFFER_SIZE];
+        memset(value, 'x', benchValueSize);
+        value[benchValueSize] = '\0';
+
+        char request[BENCH_RECV_BUFFER_SIZE * 2];
+        int sock = connectToServer();
+
+        long end = from + (c + 1) * perClient;
+        for (long i = from + c * perClient; i < end && i < to; i++) {
+            int length = snprintf(request, sizeof(request), "PUT bench%ld %s\r\n", i, value);
+            sendCommand(sock, request, length);
+        }
+
+        close(sock);
+        exit(EXIT_SUCCESS);
+    }
+
+    while (wait(NULL) > 0);
+}
+
+
+/**
+ * Fügt die Einträge [from, to) wie "runPutRange" ein, aber mit MPUT und
+ * "batch" Einträgen pro Befehl.
+ *
+ * @param from - erster Schlüssel
+ * @param to - letzter Schlüssel (exklusiv)
+ * @param batch - Einträge pro MPUT
+ */
+static void runMultiPutRange (long from, long to, int batch)
+{
+    long perClient = (to - from + benchClients - 1) / benchClients;
+
+    for (int c = 0; c < benchClients; c++) {
+        if (fork() != 0) continue;
+
+        char value[BENCH_RECV_BUFFER_SIZE];
+        memset(value, 'x', benchValueSize);
+        value[benchValueSize] = '\0';
+
+        char request[BENCH_RECV_BUFFER_SIZE];
+        int sock = connectToServer();
+
+        long end = from + (c + 1) * perClient;
+        if (end > to) end = to;
+        for (long i = from + c * perClient; i < end; ) {
+            int length = snprintf(request, sizeof(request), "MPUT");
+            int count = 0;
+            for (; count < batch && i < end; count++, i++) {
+                length += snprintf(&request[length], sizeof(request) - length, " bench%ld %s", i, value);
+            }
+            length += snprintf(&request[length], sizeof(request) - length, "\r\n");
+
+            if (send(sock, request, length, 0) != length) {
+                fatalError("runMultiPutRange send");
+            }
+            receiveResponseLines(sock, count);
+        }
+
+        close(sock);
+        exit(EXIT_SUCCESS);
+    }
+
+    while (wait(NULL) > 0);
+}
+
+
+/**
+ * PUT-Durchsatz bei wachsender Tabelle. Die Einträge werden in Dekaden
+ * (1K, 10K, 100K, ...) eingefügt und der Durchsatz jeder Stufe ausgegeben.
+ *
+ */
+static void benchmarkPut ()
+{
+    printf("%12s %12s %14s\n", "records", "inserted", "put/sec");
+    fflush(stdout);
+
+    long from = 0;
+    for (long to = 1000; from < benchRecords; to *= 10) {
+        if (to > benchRecords) to = benchRecords;
+
+        double start = getTimeSeconds();
+        runPutRange(from, to);
+        double elapsed = getTimeSeconds() - start;
+
+        printf("%12ld %12ld %14.0f\n", to, to - from, (double)(to - from) / elapsed);
+        fflush(stdout);
+        from = to;
+    }
+}
+
+
+static int compareDoubles (const void *a, const void *b)
+{
+    double diff = *(const double*)a - *(const double*)b;
+    return (diff > 0) - (diff < 0);
+}
+
+
+/**
+ * Schickt "STAT" und gibt die Antwortzeilen (Lock-Strategie und Wartezeiten
+ * pro Zugriffs-Art) aus.
+ *
+ */
+static void printServerLockStats ()
+{
+    char buffer[BENCH_RECV_BUFFER_SIZE];
+    int sock = connectToServer();
+
+    if (send(sock, "STAT\r\n", 6, 0) != 6) {
+        fatalError("printServerLockStats send");
+    }
+
+    size_t length = 0;
+    int lines = 0;
+    while (lines < 3 && length < sizeof(buffer) - 1) {
+        ssize_t size = recv(sock, &buffer[length], sizeof(buffer) - 1 - length, 0);
+        if (size <= 0) {
+            fatalError("printServerLockStats recv");
+        }
+        for (ssize_t i = 0; i < size; i++) {
+            if (buffer[length + i] == '\n') lines++;
+        }
+        length += size;
+    }
+    buffer[length] = '\0';
+
+    printf("%s", buffer);
+    close(sock);
+}
+
+
+/**
+ * Startet "clients" Prozesse, die bis "deadline" jeweils über eine eigene
+ * Verbindung "runClient" aufrufen. Die Anzahl ihrer Anfragen schicken sie
+ * über eine Pipe zurück, "collectTimedClients" wartet auf sie und summiert.
+ *
+ * @param clients - Anzahl der Client-Prozesse
+ * @param deadline - Endzeitpunkt (getTimeSeconds)
+ * @param runClient - Funktion eines Clients, liefert die Anzahl der Anfragen
+ * @param counterPipe - Pipe für die Zähler
+ */
+static void startTimedClients (int clients, double deadline,
+                               long (*runClient)(int sock, double deadline), int counterPipe[2])
+{
+    pipe(counterPipe);
+
+    for (int c = 0; c < clients; c++) {
+        if (fork() != 0) continue;
+
+        srand(getpid());
+        int sock = connectToServer();
+        long count = runClient(sock, deadline);
+
+        write(counterPipe[1], &count, sizeof(count));
+        close(sock);
+        exit(EXIT_SUCCESS);
+    }
+}
+
+
+static long collectTimedClients (int clients, int counterPipe[2])
+{
+    long total = 0;
+    for (int c = 0; c < clients; c++) {
+        long count;
+        if (read(counterPipe[0], &count, sizeof(count)) == sizeof(count)) {
+            total += count;
+        }
+    }
+    while (wait(NULL) > 0);
+
+    close(counterPipe[0]);
+    close(counterPipe[1]);
+    return total;
+}
+
+
+static long runScanClient (int sock, double deadline)
+{
+    long scans = 0;
+    while (getTimeSeconds() < deadline) {
+        sendCommand(sock, "CNT bench*\r\n", 12);
+        scans++;
+    }
+    return scans;
+}
+
+
+static long runGetClient (int sock, double deadline)
+{
+    char request[BENCH_RECV_BUFFER_SIZE];
+    long gets = 0;
+
+    while (getTimeSeconds() < deadline) {
+        int length = snprintf(request, sizeof(request), "GET bench%ld\r\n",
+                              (long)rand() % benchRecords);
+        sendCommand(sock, request, length);
+        gets++;
+    }
+    return gets;
+}
+
+
+/**
+ * Schickt jeweils "benchPipelineDepth" GETs mit einem send() und wartet dann
+ * auf alle Antwortzeilen.
+ *
+ */
+static long runPipelineClient (int sock, double deadline)
+{
+    char request[BENCH_MAX_PIPELINE_DEPTH * 32];
+    long gets = 0;
+
+    while (getTimeSeconds() < deadline) {
+        int length = 0;
+        for (int i = 0; i < benchPipelineDepth; i++) {
+            length += snprintf(&request[length], sizeof(request) - length, "GET bench%ld\r\n",
+                               (long)rand() % benchRecords);
+        }
+        if (send(sock, request, length, 0) != length) {
+            fatalError("runPipelineClient send");
+        }
+
+        receiveResponseLines(sock, benchPipelineDepth);
+        gets += benchPipelineDepth;
+    }
+    return gets;
+}
+
+
+/**
+ * Baut für jede Anfrage eine neue Verbindung auf. QUIT lässt den Server die
+ * Verbindung zuerst schließen, damit die Ports des Clients nicht im
+ * TIME-WAIT Status hängen bleiben.
+ *
+ */
+static long runConnectClient (int sock, double deadline)
+{
+    long connections = 0;
+
+    for (;;) {
+        sendCommand(sock, "QUIT\r\n", 6);
+        connections++;
+        if (getTimeSeconds() >= deadline) break;
+
+        close(sock);
+        sock = connectToServer();
+    }
+    return connections;
+}
+
+
+/**
+ * Liest die vollständige Antwort eines Wildcard-GETs über alle
+ * "benchRecords" Einträge.
+ *
+ */
+static long runStreamClient (int sock, double deadline)
+{
+    long scans = 0;
+    while (getTimeSeconds() < deadline) {
+        if (send(sock, "GET bench*\r\n", 12, 0) != 12) {
+            fatalError("runStreamClient send");
+        }
+        receiveResponseLines(sock, benchRecords);
+        scans++;
+    }
+    return scans;
+}
+
+
+/**
+ * Durchläuft alle Einträge mit "SCAN cursor bench* BENCH_SCAN_COUNT", bis der
+ * Server den Cursor 0 liefert. Die letzte Zeile jeder Antwort ist der Cursor.
+ *
+ */
+static long runCursorScanClient (int sock, double deadline)
+{
+    char request[64];
+    char buffer[BENCH_RECV_BUFFER_SIZE + 1];
+    long scans = 0;
+
+    while (getTimeSeconds() < deadline) {
+        long cursor = 0;
+        do {
+            int length = snprintf(request, sizeof(request), "SCAN %ld bench* %d\r\n",
+                                  cursor, BENCH_SCAN_COUNT);
+            if (send(sock, request, length, 0) != length) {
+                fatalError("runCursorScanClient send");
+            }
+
+            // Nur das Ende der Antwort wird aufgehoben, die Cursor-Zeile ist kurz
+            size_t used = 0;
+            for (;;) {
+                ssize_t size = recv(sock, &buffer[used], BENCH_RECV_BUFFER_SIZE - used, 0);
+                if (size <= 0) {
+                    fatalError("runCursorScanClient recv");
+                }
+                used += size;
+                buffer[used] = '\0';
+
+                char *last = (used >= 2 && buffer[used - 1] == '\n') ? &buffer[used - 2] : NULL;
+                if (last != NULL) {
+                    while (last > buffer && last[-1] != '\n') last--;
+                    if (strncmp(last, "SCAN:", 5) == 0 && strchr(&last[5], ':') == NULL) {
+                        cursor = atol(&last[5]);
+                        break;
+                    }
+                }
+                if (used > BENCH_RECV_BUFFER_SIZE / 2) {
+                    char *keep = strrchr(buffer, '\n');
+                    keep = (keep != NULL) ? keep + 1 : &buffer[used];
+                    used = &buffer[used] - keep;
+                    memmove(buffer, keep, used);
+                }
+            }
+        } while (cursor != 0);
+        scans++;
+    }
+    return scans;
+}
+
+
+/**
+ * Schickt "benchPatternCommand" und wartet auf "benchPatternLines" Antwortzeilen.
+ *
+ */
+static long runPatternClient (int sock, double deadline)
+{
+    ssize_t length = (ssize_t)strlen(benchPatternCommand);
+    long requests = 0;
+
+    while (getTimeSeconds() < deadline) {
+        if (send(sock, benchPatternCommand, length, 0) != length) {
+            fatalError("runPatternClient send");
+        }
+        receiveResponseLines(sock, benchPatternLines);
+        requests++;
+    }
+    return requests;
+}
+
+
+/**
+ * Fragt jeweils BENCH_LOOKUP_BATCH zufällige Schlüssel aus "benchLookupRecords"
+ * mit einem MGET ab, damit die Suche im Index und nicht der Systemaufruf
+ * überwiegt. Mit einem anderen "benchLookupPrefix" existieren die Schlüssel nicht.
+ *
+ */
+static long runLookupClient (int sock, double deadline)
+{
+    char request[BENCH_RECV_BUFFER_SIZE];
+    long keys = 0;
+
+    while (getTimeSeconds() < deadline) {
+        int length = snprintf(request, sizeof(request), "MGET");
+        for (int i = 0; i < BENCH_LOOKUP_BATCH; i++) {
+            length += snprintf(&request[length], sizeof(request) - length, " %s%ld",
+                               benchLookupPrefix, (long)rand() % benchLookupRecords);
+        }
+        length += snprintf(&request[length], sizeof(request) - length, "\r\n");
+
+        if (send(sock, request, length, 0) != length) {
+            fatalError("runLookupClient send");
+        }
+        receiveResponseLines(sock, BENCH_LOOKUP_BATCH);
+        keys += BENCH_LOOKUP_BATCH;
+    }
+    return keys;
+}
+
+
+/**
+ * Schickt bis zur Deadline einzelne PUTs und misst ihre Latenz. Gibt die
+ * sortierten Latenzen zurück (mit free() freigeben).
+ *
+ * @param deadline - Ende der Messung
+ * @param keyPrefix - Präfix der geschriebenen Schlüssel
+ * @param puts - Anzahl der PUTs
+ */
+static double* measurePutLatency (double deadline, const char *keyPrefix, size_t *puts)
+{
+    char value[BENCH_RECV_BUFFER_SIZE];
+    memset(value, 'x', benchValueSize);
+    value[benchValueSize] = '\0';
+
+    char request[BENCH_RECV_BUFFER_SIZE * 2];
+    int sock = connectToServer();
+
+    size_t capacity = 1024;
+    double *latencies = malloc(capacity * sizeof(double));
+    *puts = 0;
+
+    while (getTimeSeconds() < deadline) {
+        int length = snprintf(request, sizeof(request), "PUT %s%zu %s\r\n", keyPrefix, *puts, value);
+
+        double start = getTimeSeconds();
+        sendCommand(sock, request, length);
+        if (*puts == capacity) {
+            capacity *= 2;
+            latencies = realloc(latencies, capacity * sizeof(double));
+        }
+        latencies[(*puts)++] = getTimeSeconds() - start;
+    }
+    close(sock);
+
+    qsort(latencies, *puts, sizeof(double), compareDoubles);
+    return latencies;
+}
+
+
+/**
+ * Gemischte Last: "benchClients" Prozesse zählen per Wildcard-Scan
+ * ("CNT bench*", hält das Lese-Lock über die ganze Tabelle), während ein
+ * Schreiber-Prozess einzelne PUTs schickt und deren Latenz misst. Zeigt wie
+ * stark die Lock-Strategie des Servers Schreiber unter Leselast ausbremst.
+ *
+ */
+static void benchmarkMixed ()
+{
+    runPutRange(0, benchRecords);
+
+    int counterPipe[2];
+    double deadline = getTimeSeconds() + benchDuration;
+    startTimedClients(benchClients, deadline, runScanClient, counterPipe);
+
+    size_t puts;
+    double *latencies = measurePutLatency(deadline, "benchw", &puts);
+
+    long scans = collectTimedClients(benchClients, counterPipe);
+
+    printf("%12s %12s %14s %14s\n", "scan/sec", "put/sec", "put p50 (us)", "put p99 (us)");
+    printf("%12.0f %12.0f %14.1f %14.1f\n",
+           (double)scans / benchDuration, (double)puts / benchDuration,
+           (puts > 0) ? latencies[puts / 2] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts * 99 / 100] * 1e6 : 0.0);
+    fflush(stdout);
+    free(latencies);
+
+    printServerLockStats();
+}
+
+
+/**
+ * Große Wildcard-Antworten: Zuerst liest ein einzelner Client "GET bench*"
+ * über n Einträge und misst die Zeit bis zum ersten Byte, die Gesamtzeit und
+ * den Durchsatz. Danach lesen "benchClients" Prozesse die Antwort
+ * fortlaufend, während ein Schreiber die PUT-Latenz misst.
+ *
+ */
+static void benchmarkStream ()
+{
+    runPutRange(0, benchRecords);
+
+    int sock = connectToServer();
+    char buffer[BENCH_RECV_BUFFER_SIZE];
+    double firstByte = 0, total = 0;
+    size_t bytes = 0;
+
+    for (int i = 0; i < BENCH_STREAM_ROUNDS; i++) {
+        double start = getTimeSeconds();
+        if (send(sock, "GET bench*\r\n", 12, 0) != 12) {
+            fatalError("benchmarkStream send");
+        }
+
+        long lines = benchRecords;
+        bool first = true;
+        while (lines > 0) {
+            ssize_t size = recv(sock, buffer, sizeof(buffer), 0);
+            if (size <= 0) {
+                fatalError("benchmarkStream recv");
+            }
+            if (first) {
+                firstByte += getTimeSeconds() - start;
+                first = false;
+            }
+            for (ssize_t j = 0; j < size; j++) {
+                if (buffer[j] == '\n') lines--;
+            }
+            bytes += size;
+        }
+        total += getTimeSeconds() - start;
+    }
+    close(sock);
+
+    printf("%12s %16s %12s %12s\n", "records", "first byte (ms)", "total (ms)", "MB/sec");
+    printf("%12ld %16.2f %12.1f %12.1f\n", benchRecords,
+           firstByte / BENCH_STREAM_ROUNDS * 1e3, total / BENCH_STREAM_ROUNDS * 1e3,
+           (double)bytes / total / 1e6);
+    fflush(stdout);
+
+    int counterPipe[2];
+    double deadline = getTimeSeconds() + benchDuration;
+    startTimedClients(benchClients, deadline, runStreamClient, counterPipe);
+
+    size_t puts;
+    double *latencies = measurePutLatency(deadline, "w", &puts);
+
+    long scans = collectTimedClients(benchClients, counterPipe);
+
+    printf("%12s %12s %14s %14s\n", "scan/sec", "put/sec", "put p50 (us)", "put p99 (us)");
+    printf("%12.1f %12.0f %14.1f %14.1f\n",
+           (double)scans / benchDuration, (double)puts / benchDuration,
+           (puts > 0) ? latencies[puts / 2] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts * 99 / 100] * 1e6 : 0.0);
+    fflush(stdout);
+    free(latencies);
+
+    printServerLockStats();
+}
+
+
+/**
+ * Wie "stream", aber die Clients durchlaufen die Einträge seitenweise mit
+ * SCAN. Zeigt die PUT-Latenz, wenn das Lock nur pro Abschnitt gehalten wird.
+ *
+ */
+static void benchmarkScan ()
+{
+    runPutRange(0, benchRecords);
+
+    int counterPipe[2];
+    double deadline = getTimeSeconds() + benchDuration;
+    startTimedClients(benchClients, deadline, runCursorScanClient, counterPipe);
+
+    size_t puts;
+    double *latencies = measurePutLatency(deadline, "w", &puts);
+
+    long scans = collectTimedClients(benchClients, counterPipe);
+
+    printf("%12s %12s %14s %14s\n", "scan/sec", "put/sec", "put p50 (us)", "put p99 (us)");
+    printf("%12.1f %12.0f %14.1f %14.1f\n",
+           (double)scans / benchDuration, (double)puts / benchDuration,
+           (puts > 0) ? latencies[puts / 2] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts * 99 / 100] * 1e6 : 0.0);
+    fflush(stdout);
+    free(latencies);
+
+    printServerLockStats();
+}
+
+
+/**
+ * Durchsatz von CNT und GET mit Wildcards über "benchRecords" Einträge: ein
+ * enger und ein weiter Präfix, ein Präfix mit "?" und ein Muster ohne festen
+ * Anfang (Vergleich mit dem Durchsuchen aller Einträge).
+ *
+ */
+static void benchmarkPrefix ()
+{
+    const char *patterns[] = {"bench1999*", "bench19*", "bench1999?", "*1999"};
+
+    runPutRange(0, benchRecords);
+
+    printf("%12s %10s %12s %12s\n", "pattern", "matches", "CNT/sec", "GET/sec");
+    fflush(stdout); // Vor fork()
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        char key[32];
+        long matches = 0;
+        for (long i = 0; i < benchRecords; i++) {
+            snprintf(key, sizeof(key), "bench%ld", i);
+            if (fnmatch(patterns[p], key, 0) == 0) matches++;
+        }
+
+        double rates[2];
+        for (int get = 0; get < 2; get++) {
+            char command[64];
+            snprintf(command, sizeof(command), "%s %s\r\n", get ? "GET" : "CNT", patterns[p]);
+            benchPatternCommand = command;
+            benchPatternLines = (get && matches > 0) ? matches : 1;
+
+            int counterPipe[2];
+            startTimedClients(benchClients, getTimeSeconds() + benchDuration, runPatternClient, counterPipe);
+            rates[get] = (double)collectTimedClients(benchClients, counterPipe) / benchDuration;
+        }
+
+        printf("%12s %10ld %12.1f %12.1f\n", patterns[p], matches, rates[0], rates[1]);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * Schlüssel-Suchen pro Sekunde bei wachsender Tabelle (1K, 10K, ... n), für
+ * vorhandene und für fehlende Schlüssel. Fehlende Schlüssel sondieren bis zu
+ * einer freien Position im Index und vergleichen dabei mit allen belegten.
+ *
+ */
+static void benchmarkLookup ()
+{
+    printf("%12s %14s %14s\n", "records", "hit keys/sec", "miss keys/sec");
+    fflush(stdout);
+
+    long from = 0;
+    for (long to = 1000; from < benchRecords; to *= 10) {
+        if (to > benchRecords) to = benchRecords;
+        runPutRange(from, to);
+        from = to;
+
+        double rates[2];
+        for (int miss = 0; miss < 2; miss++) {
+            benchLookupRecords = to;
+            benchLookupPrefix = miss ? "miss" : "bench";
+
+            int counterPipe[2];
+            startTimedClients(benchClients, getTimeSeconds() + benchDuration, runLookupClient, counterPipe);
+            rates[miss] = (double)collectTimedClients(benchClients, counterPipe) / benchDuration;
+        }
+
+        printf("%12ld %14.0f %14.0f\n", to, rates[0], rates[1]);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * Startet den Server "benchServerPath" im aktuellen Verzeichnis und wartet,
+ * bis er Verbindungen annimmt. Der Server läuft in einer eigenen Sitzung (er
+ * beendet beim Herunterfahren seine ganze Prozessgruppe) und ist kein
+ * Kind-Prozess, damit wait() in runMultiPutRange nicht auf ihn wartet.
+ *
+ * @param option - Kommandozeilen-Option des Servers (z.B. "-s")
+ * @param value - Wert der Option
+ * @param seconds - Zeit bis zur ersten Verbindung
+ * @return - Prozess-Id des Servers
+ */
+static pid_t startServer (const char *option, const char *value, double *seconds)
+{
+    int pidPipe[2];
+    pipe(pidPipe);
+
+    double start = getTimeSeconds();
+    pid_t child = fork();
+    if (child == 0) {
+        setsid();
+        pid_t server = fork();
+        if (server == 0) {
+            int log = open(benchServerLog, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+            execl(benchServerPath, benchServerPath, option, value, (char*)NULL);
+            _exit(EXIT_FAILURE);
+        }
+        write(pidPipe[1], &server, sizeof(server));
+        _exit(EXIT_SUCCESS);
+    }
+
+    pid_t server = -1;
+    read(pidPipe[0], &server, sizeof(server));
+    waitpid(child, NULL, 0);
+    close(pidPipe[0]);
+    close(pidPipe[1]);
+
+    int sock;
+    while ((sock = tryConnectToServer()) == -1) {
+        if (server == -1 || kill(server, 0) == -1) {
+            fatalError("startServer exec");
+        }
+        usleep(1000);
+    }
+    *seconds = getTimeSeconds() - start;
+    close(sock);
+    return server;
+}
+
+
+/**
+ * Beendet den Server wie mit ctrl+c (er speichert dabei das Storage) und
+ * gibt die Zeit bis zum Ende des Prozesses zurück.
+ *
+ * @param server - Prozess-Id des Servers
+ */
+static double stopServer (pid_t server)
+{
+    double start = getTimeSeconds();
+    kill(server, SIGINT);
+    while (kill(server, 0) == 0) {
+        usleep(1000);
+    }
+    return getTimeSeconds() - start;
+}
+
+
+/**
+ * Liest aus der Ausgabe "benchServerLog" eines beendeten Servers, wie lange
+ * das Speichern beim Beenden gedauert hat, -1 wenn die Meldung fehlt.
+ *
+ */
+static double readServerSaveSeconds ()
+{
+    FILE *file = fopen(benchServerLog, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    char line[BENCH_RECV_BUFFER_SIZE];
+    double seconds = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        const char *taken = strstr(line, "saved to");
+        if (taken != NULL && (taken = strstr(taken, "time taken: ")) != NULL) {
+            seconds = atof(taken + strlen("time taken: "));
+        }
+    }
+    fclose(file);
+    return seconds;
+}
+
+
+static long countServerRecords ()
+{
+    char buffer[BENCH_RECV_BUFFER_SIZE];
+    int sock = connectToServer();
+
+    if (send(sock, "CNT bench*\r\n", 12, 0) != 12) {
+        fatalError("countServerRecords send");
+    }
+    size_t used = 0;
+    while (used == 0 || buffer[used - 1] != '\n') {
+        ssize_t size = recv(sock, &buffer[used], sizeof(buffer) - used - 1, 0);
+        if (size <= 0) {
+            fatalError("countServerRecords recv");
+        }
+        used += size;
+    }
+    buffer[used] = '\0';
+    close(sock);
+
+    const char *count = strrchr(buffer, ':');
+    return (count != NULL) ? atol(count + 1) : -1;
+}
+
+
+/**
+ * Legt ein temporäres Verzeichnis mit Unterordner "build" an und wechselt
+ * hinein, damit die Dateien des selbst gestarteten Servers ("../data.csv"
+ * usw.) dort landen. Auf dem Port darf noch kein Server laufen.
+ *
+ * @param directory - Vorlage für mkdtemp(), danach der Name des Verzeichnisses
+ * @param serverPath - Puffer für den absoluten Pfad von "benchServerPath"
+ */
+static void enterServerDirectory (char *directory, char *serverPath)
+{
+    if (realpath(benchServerPath, serverPath) == NULL) {
+        fatalError("enterServerDirectory realpath");
+    }
+    benchServerPath = serverPath;
+
+    int sock = tryConnectToServer();
+    if (sock != -1) {
+        close(sock);
+        fprintf(stderr, "enterServerDirectory: a server is already running on port %d\n", benchPort);
+        exit(EXIT_FAILURE);
+    }
+
+    if (mkdtemp(directory) == NULL || chdir(directory) == -1 ||
+            mkdir("build", 0755) == -1 || chdir("build") == -1) {
+        fatalError("enterServerDirectory mkdtemp");
+    }
+}
+
+
+static void leaveServerDirectory (const char *directory)
+{
+    chdir("..");
+    rmdir("build");
+    chdir("..");
+    rmdir(directory);
+}
+
+
+/**
+ * Startzeit des Servers mit n Einträgen in beiden Storage-Formaten. Startet
+ * "benchServerPath" (-s) selbst in einem temporären Verzeichnis, befüllt ihn
+ * mit MPUT, beendet ihn (er speichert, die Dauer des Speicherns stammt aus
+ * seiner Ausgabe) und misst den erneuten Start bis zur ersten Verbindung.
+ * Auf dem Port darf noch kein Server laufen.
+ *
+ */
+static void benchmarkStartup ()
+{
+    const char *formats[] = {"csv", "binary"};
+    const char *files[] = {"../data.csv", "../storage.bin"}; // STORAGE_FILE, STORAGE_SNAPSHOT_FILE
+
+    char directory[] = BENCH_SERVER_DIRECTORY;
+    char serverPath[PATH_MAX];
+    enterServerDirectory(directory, serverPath);
+    benchServerLog = "../server.log";
+
+    printf("%8s %10s %10s %10s %10s %10s %14s %14s\n", "format", "records", "file (MB)", "stop (s)",
+           "save (s)", "save MB/s", "start empty (s)", "start full (s)");
+    fflush(stdout);
+
+    for (int f = 0; f < 2; f++) {
+        double emptyStart, fullStart;
+
+        pid_t server = startServer("-s", formats[f], &emptyStart);
+        runMultiPutRange(0, benchRecords, BENCH_STARTUP_BATCH);
+        double stop = stopServer(server);
+        double save = readServerSaveSeconds();
+
+        struct stat info;
+        if (stat(files[f], &info) == -1) {
+            fatalError("benchmarkStartup stat");
+        }
+
+        server = startServer("-s", formats[f], &fullStart);
+        long records = countServerRecords();
+        stopServer(server);
+        if (records != benchRecords) {
+            fprintf(stderr, "benchmarkStartup: %ld of %ld records loaded\n", records, benchRecords);
+            exit(EXIT_FAILURE);
+        }
+
+        printf("%8s %10ld %10.1f %10.3f %10.3f %10.1f %14.3f %14.3f\n", formats[f], benchRecords,
+               (double)info.st_size / 1e6, stop, save, (save > 0) ? (double)info.st_size / 1e6 / save : 0.0,
+               emptyStart, fullStart);
+        fflush(stdout);
+        unlink(files[f]);
+        unlink("../journal.log");
+    }
+
+    unlink(benchServerLog);
+    benchServerLog = "/dev/null";
+    leaveServerDirectory(directory);
+}
+
+
+static long runPutClient (int sock, double deadline)
+{
+    char value[BENCH_RECV_BUFFER_SIZE];
+    memset(value, 'x', benchValueSize);
+    value[benchValueSize] = '\0';
+
+    char request[BENCH_RECV_BUFFER_SIZE * 2];
+    long puts = 0;
+    while (getTimeSeconds() < deadline) {
+        int length = snprintf(request, sizeof(request), "PUT bench%d-%ld %s\r\n", getpid(), puts, value);
+        sendCommand(sock, request, length);
+        puts++;
+    }
+    return puts;
+}
+
+
+/**
+ * PUT-Latenz mit jeder Sync-Strategie des Journals (-j). Startet
+ * "benchServerPath" (-s) pro Strategie selbst in einem temporären
+ * Verzeichnis; ein Client misst die Latenz einzelner PUTs, während
+ * "benchClients" - 1 weitere Clients ebenfalls PUTs schicken. Mit mehreren
+ * Clients teilen sich die Schreiber bei "always" ein fdatasync()
+ * (Group-Commit). Auf dem Port darf noch kein Server laufen.
+ *
+ */
+static void benchmarkJournal ()
+{
+    const char *policies[] = {"off", "none", "1000ms", "64kb", "always"};
+
+    char directory[] = BENCH_SERVER_DIRECTORY;
+    char serverPath[PATH_MAX];
+    enterServerDirectory(directory, serverPath);
+
+    printf("%8s %8s %12s %14s %14s\n", "sync", "clients", "put/sec", "put p50 (us)", "put p99 (us)");
+    fflush(stdout);
+
+    for (size_t p = 0; p < sizeof(policies) / sizeof(*policies); p++) {
+        double seconds;
+        pid_t server = startServer("-j", policies[p], &seconds);
+
+        int counterPipe[2];
+        double deadline = getTimeSeconds() + benchDuration;
+        startTimedClients(benchClients - 1, deadline, runPutClient, counterPipe);
+
+        size_t puts;
+        double *latencies = measurePutLatency(deadline, "benchj", &puts);
+        long others = collectTimedClients(benchClients - 1, counterPipe);
+
+        printf("%8s %8d %12.0f %14.1f %14.1f\n", policies[p], benchClients,
+               (double)(puts + others) / benchDuration,
+               (puts > 0) ? latencies[puts / 2] * 1e6 : 0.0,
+               (puts > 0) ? latencies[puts * 99 / 100] * 1e6 : 0.0);
+        fflush(stdout);
+        free(latencies);
+
+        stopServer(server);
+        unlink("../storage.bin");
+        unlink("../journal.log");
+    }
+
+    leaveServerDirectory(directory);
+}
+
+
+/**
+ * Blockieren der Schreiber durch den Snapshot-Timer: Startet
+ * "benchServerPath" (-s) mit einem Snapshot pro Sekunde (-i 1) selbst in
+ * einem temporären Verzeichnis, befüllt ihn mit n Einträgen und misst dann
+ * "benchDuration" Sekunden lang die Latenz einzelner PUTs. Die langsamsten
+ * PUTs zeigen, wie lange ein Snapshot die Schreiber aufhält. Auf dem Port
+ * darf noch kein Server laufen.
+ *
+ */
+static void benchmarkSnapshot ()
+{
+    char directory[] = BENCH_SERVER_DIRECTORY;
+    char serverPath[PATH_MAX];
+    enterServerDirectory(directory, serverPath);
+
+    double seconds;
+    pid_t server = startServer("-i", "1", &seconds);
+    runMultiPutRange(0, benchRecords, BENCH_STARTUP_BATCH);
+
+    size_t puts;
+    double *latencies = measurePutLatency(getTimeSeconds() + benchDuration, "benchs", &puts);
+
+    size_t stalled = 0;
+    for (size_t i = 0; i < puts; i++) {
+        if (latencies[i] > BENCH_STALL_SECONDS) stalled++;
+    }
+
+    printf("%10s %10s %12s %12s %14s %12s %14s\n", "records", "put/sec", "p50 (us)", "p99 (us)",
+           "p99.9 (us)", "max (ms)", "puts > 1 ms");
+    printf("%10ld %10.0f %12.1f %12.1f %14.1f %12.2f %14zu\n", benchRecords, (double)puts / benchDuration,
+           (puts > 0) ? latencies[puts / 2] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts * 99 / 100] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts * 999 / 1000] * 1e6 : 0.0,
+           (puts > 0) ? latencies[puts - 1] * 1e3 : 0.0, stalled);
+    fflush(stdout);
+    free(latencies);
+
+    stopServer(server);
+    unlink("../storage.bin");
+    unlink("../storage.delta");
+    unlink("../journal.log");
+    leaveServerDirectory(directory);
+}
+
+
+/**
+ * Vergleicht die Schlüssel aus BENCH_KEY_FILE (und einen langen Schlüssel aus
+ * nur einem Zeichen) lokal mit normalen und mit bösartigen Mustern, bei denen
+ * ein rekursiver Vergleich exponentiell viele Wege zurückverfolgt. Misst
+ * strMatchWildcard() und den einmal vorbereiteten Ausdruck, wie ihn das
+ * Storage für alle Einträge eines Durchlaufs benutzt. Braucht keinen Server.
+ *
+ */
+static void benchmarkMatch ()
+{
+    const char *patterns[] = {"Bo*", "*ia", "*an*", "?a*i?", "*a*a*a*a*b",
+                              "*a*a*a*a*a*a*a*a*z", "*?*?*?*?*?*?*?*?x"};
+
+    FILE *file = fopen(BENCH_KEY_FILE, "r");
+    if (file == NULL) {
+        fatalError("benchmarkMatch fopen");
+    }
+    Array *keys = arrayCreate();
+    char line[BENCH_RECV_BUFFER_SIZE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, ",\r\n")] = '\0';
+        if (line[0] != '\0') {
+            arrayPushItem(keys, stringCreate(line));
+        }
+    }
+    fclose(file);
+
+    String *longKey = stringCreate("");
+    for (int i = 0; i < 64; i++) {
+        stringAppend(longKey, "a");
+    }
+    arrayPushItem(keys, longKey);
+
+    printf("%20s %8s %16s %18s\n", "pattern", "matches", "match (ns/key)", "compiled (ns/key)");
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        long matches = 0;
+        double start = getTimeSeconds();
+        for (int round = 0; round < BENCH_MATCH_ROUNDS; round++) {
+            for (size_t k = 0; k < keys->size; k++) {
+                matches += strMatchWildcard(((String*)keys->cArr[k])->cStr, patterns[p]);
+            }
+        }
+        double plain = getTimeSeconds() - start;
+
+        long compiledMatches = 0;
+        start = getTimeSeconds();
+        for (int round = 0; round < BENCH_MATCH_ROUNDS; round++) {
+            WildcardPattern pattern;
+            strCompileWildcard(&pattern, patterns[p]);
+            for (size_t k = 0; k < keys->size; k++) {
+                String *key = keys->cArr[k];
+                compiledMatches += strMatchCompiledWildcard(&pattern, key->cStr, key->length);
+            }
+        }
+        double compiled = getTimeSeconds() - start;
+
+        if (compiledMatches != matches) {
+            fatalError("benchmarkMatch results differ");
+        }
+        double comparisons = (double)BENCH_MATCH_ROUNDS * keys->size;
+        printf("%20s %8ld %16.1f %18.1f\n", patterns[p], matches / BENCH_MATCH_ROUNDS,
+               plain / comparisons * 1e9, compiled / comparisons * 1e9);
+    }
+
+    for (size_t k = 0; k < keys->size; k++) {
+        stringFree(keys->cArr[k]);
+    }
+    arrayFree(keys);
+}
+
+
+/**
+ * GET-Durchsatz bei steigender Anzahl an Client-Prozessen (1, 2, 4, ... c),
+ * jeweils "benchDuration" Sekunden mit zufälligen Schlüsseln aus n Einträgen.
+ *
+ */
+static void benchmarkGet ()
+{
+    runPutRange(0, benchRecords);
+
+    printf("%12s %14s %14s\n", "clients", "get/sec", "get/sec/client");
+    fflush(stdout);
+
+    for (int clients = 1; clients <= benchClients; clients *= 2) {
+        int counterPipe[2];
+        startTimedClients(clients, getTimeSeconds() + benchDuration, runGetClient, counterPipe);
+        long gets = collectTimedClients(clients, counterPipe);
+
+        printf("%12d %14.0f %14.0f\n", clients, (double)gets / benchDuration,
+               (double)gets / benchDuration / clients);
+        fflush(stdout);
+    }
+
+    printServerLockStats();
+}
+
+
+/**
+ * Liefert die Größe der ersten Antwort des binären Protokolls im Puffer,
+ * 0 wenn sie noch nicht vollständig empfangen wurde.
+ *
+ * @param data - Empfangene Daten
+ * @param length - Anzahl der empfangenen Bytes
+ */
+static size_t getBinaryResponseSize (const char *data, size_t length)
+{
+    if (length < 8) return 0;
+
+    uint16_t messageLength;
+    uint32_t records;
+    memcpy(&messageLength, &data[2], sizeof(messageLength));
+    memcpy(&records, &data[4], sizeof(records));
+
+    size_t size = 8 + ntohs(messageLength);
+    for (uint32_t i = 0; i < ntohl(records); i++) {
+        if (size + 6 > length) return 0;
+
+        uint16_t keyLength;
+        uint32_t valueLength;
+        memcpy(&keyLength, &data[size], sizeof(keyLength));
+        memcpy(&valueLength, &data[size + 2], sizeof(valueLength));
+        size += 6 + ntohs(keyLength) + ntohl(valueLength);
+    }
+    return (size <= length) ? size : 0;
+}
+
+
+static void receiveBinaryResponses (int sock, int count)
+{
+    static char buffer[BENCH_RECV_BUFFER_SIZE * 16];
+    size_t length = 0;
+
+    while (count > 0) {
+        ssize_t size = recv(sock, &buffer[length], sizeof(buffer) - length, 0);
+        if (size <= 0) {
+            fatalError("receiveBinaryResponses recv");
+        }
+        length += size;
+
+        size_t offset = 0;
+        size_t responseSize;
+        while (count > 0 && (responseSize = getBinaryResponseSize(&buffer[offset], length - offset)) > 0) {
+            offset += responseSize;
+            count--;
+        }
+        memmove(buffer, &buffer[offset], length - offset);
+        length -= offset;
+    }
+}
+
+
+/**
+ * Wie "runPipelineClient", aber über das binäre Protokoll.
+ *
+ */
+static long runBinaryGetClient (int sock, double deadline)
+{
+    char request[BENCH_MAX_PIPELINE_DEPTH * 32];
+    long gets = 0;
+
+    while (getTimeSeconds() < deadline) {
+        int length = 0;
+        for (int i = 0; i < benchPipelineDepth; i++) {
+            char *header = &request[length];
+            int keyLength = snprintf(&header[8], sizeof(request) - length - 8, "bench%ld",
+                                     (long)rand() % benchRecords);
+            uint16_t netKeyLength = htons(keyLength);
+            uint32_t netValueLength = 0;
+            header[0] = 1; // GET
+            header[1] = 0;
+            memcpy(&header[2], &netKeyLength, sizeof(netKeyLength));
+            memcpy(&header[4], &netValueLength, sizeof(netValueLength));
+            length += 8 + keyLength;
+        }
+        if (send(sock, request, length, 0) != length) {
+            fatalError("runBinaryGetClient send");
+        }
+
+        receiveBinaryResponses(sock, benchPipelineDepth);
+        gets += benchPipelineDepth;
+    }
+    return gets;
+}
+
+
+/**
+ * Schreibdurchsatz von n Einträgen mit c Clients, einzeln mit PUT und mit
+ * MPUT bei steigender Anzahl an Einträgen pro Befehl (so viele wie in eine
+ * Zeile passen).
+ *
+ */
+static void benchmarkBulk ()
+{
+    int maxBatch = (BENCH_RECV_BUFFER_SIZE - 16) / (benchValueSize + 24);
+
+    printf("%12s %14s\n", "batch", "put/sec");
+    fflush(stdout);
+
+    double start = getTimeSeconds();
+    runPutRange(0, benchRecords);
+    printf("%12s %14.0f\n", "PUT", (double)benchRecords / (getTimeSeconds() - start));
+    fflush(stdout);
+
+    for (int batch = 1; batch <= maxBatch; batch *= 4) {
+        start = getTimeSeconds();
+        runMultiPutRange(0, benchRecords, batch);
+        printf("%12d %14.0f\n", batch, (double)benchRecords / (getTimeSeconds() - start));
+        fflush(stdout);
+    }
+
+    printServerLockStats();
+}
+
+
+/**
+ * GET-Durchsatz von c Clients bei steigender Pipeline-Tiefe (1, 2, 4, ... 128
+ * Befehle pro send()), jeweils "benchDuration" Sekunden mit zufälligen
+ * Schlüsseln aus n Einträgen.
+ *
+ */
+static void benchmarkPipeline ()
+{
+    runPutRange(0, benchRecords);
+
+    printf("%12s %14s %14s\n", "depth", "get/sec", "batches/sec");
+    fflush(stdout);
+
+    for (int depth = 1; depth <= BENCH_MAX_PIPELINE_DEPTH; depth *= 2) {
+        benchPipelineDepth = depth;
+
+        int counterPipe[2];
+        startTimedClients(benchClients, getTimeSeconds() + benchDuration, runPipelineClient, counterPipe);
+        long gets = collectTimedClients(benchClients, counterPipe);
+
+        printf("%12d %14.0f %14.0f\n", depth, (double)gets / benchDuration,
+               (double)gets / benchDuration / depth);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * GET-Durchsatz von c Clients über das Text-Protokoll und das binäre
+ * Protokoll, einzeln und mit 32 Befehlen pro send().
+ *
+ */
+static void benchmarkProtocol ()
+{
+    runPutRange(0, benchRecords);
+
+    printf("%12s %14s %14s\n", "depth", "text get/sec", "binary get/sec");
+    fflush(stdout);
+
+    for (int depth = 1; depth <= 32; depth *= 32) {
+        benchPipelineDepth = depth;
+
+        int counterPipe[2];
+        startTimedClients(benchClients, getTimeSeconds() + benchDuration, runPipelineClient, counterPipe);
+        long textGets = collectTimedClients(benchClients, counterPipe);
+
+        int textPort = benchPort;
+        benchPort = benchBinaryPort;
+        startTimedClients(benchClients, getTimeSeconds() + benchDuration, runBinaryGetClient, counterPipe);
+        long binaryGets = collectTimedClients(benchClients, counterPipe);
+        benchPort = textPort;
+
+        printf("%12d %14.0f %14.0f\n", depth, (double)textGets / benchDuration,
+               (double)binaryGets / benchDuration);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * Fragt den Allokations-Zähler des Server-Prozesses der Verbindung ab (STAT)
+ * und liefert die Anzahl der Allokationen seit dem letzten STAT. Ein ohne
+ * ALLOC_COUNTER gebauter Server liefert keinen Zähler, dann -1.
+ *
+ * @param sock - Verbindungs-Deskriptor
+ */
+static long getServerAllocations (int sock)
+{
+    char buffer[BENCH_RECV_BUFFER_SIZE] = "";
+    size_t length = 0;
+
+    if (send(sock, "STAT\r\n", 6, 0) != 6) {
+        fatalError("getServerAllocations send");
+    }
+
+    // Der Zähler folgt als letzte Zeile auf die Lock-Statistik
+    const char *stat;
+    while ((stat = strstr(buffer, "mallocs=")) == NULL || strchr(stat, '\n') == NULL) {
+        const char *locks = strstr(buffer, "lock_wait_write");
+        if (stat == NULL && locks != NULL && strchr(locks, '\n') != NULL) {
+            struct pollfd pending = {sock, POLLIN, 0};
+            if (poll(&pending, 1, BENCH_STAT_TIMEOUT_MS) == 0) {
+                return -1;
+            }
+        }
+        ssize_t size = recv(sock, &buffer[length], sizeof(buffer) - length - 1, 0);
+        if (size <= 0) {
+            fatalError("getServerAllocations recv");
+        }
+        length += size;
+        buffer[length] = '\0';
+    }
+    return atol(stat + strlen("mallocs="));
+}
+
+
+/**
+ * Heap-Allokationen des Servers pro Befehl im eingeschwungenen Zustand.
+ * Jede Phase läuft einmal zum Aufwärmen und einmal gemessen. Beendet sich
+ * mit Fehler, wenn eine Phase mehr als BENCH_MAX_ALLOCS_PER_COMMAND braucht.
+ *
+ */
+static int benchmarkAlloc ()
+{
+    const char *phases[] = {"PUT", "GET", "GET miss", "PUT overwrite"};
+    const char *formats[] = {"PUT alloc%ld value%ld\r\n", "GET alloc%ld\r\n",
+                             "GET nokey%ld\r\n", "PUT alloc%ld other%ld\r\n"};
+    int sock = connectToServer();
+    char request[BENCH_RECV_BUFFER_SIZE];
+    int result = EXIT_SUCCESS;
+
+    printf("%14s %12s %12s %14s\n", "phase", "commands", "mallocs", "mallocs/cmd");
+    fflush(stdout);
+
+    for (size_t phase = 0; phase < sizeof(phases) / sizeof(char*); phase++) {
+        long allocations = 0;
+        for (int round = 0; round < 2; round++) {
+            if (getServerAllocations(sock) == -1) {
+                fprintf(stderr, "benchmarkAlloc: server built without ALLOC_COUNTER (cmake -DALLOC_COUNTER=ON)\n");
+                close(sock);
+                return EXIT_FAILURE;
+            }
+            for (long i = 0; i < BENCH_ALLOC_COMMANDS; i++) {
+                long key = i % 1000;
+                int length = snprintf(request, sizeof(request), formats[phase], key, key);
+                sendCommand(sock, request, length);
+            }
+            allocations = getServerAllocations(sock);
+        }
+
+        double perCommand = (double)allocations / BENCH_ALLOC_COMMANDS;
+        printf("%14s %12d %12ld %14.4f\n", phases[phase], BENCH_ALLOC_COMMANDS, allocations, perCommand);
+        fflush(stdout);
+        if (perCommand > BENCH_MAX_ALLOCS_PER_COMMAND) {
+            result = EXIT_FAILURE;
+        }
+    }
+
+    close(sock);
+    return result;
+}
+
+
+/**
+ * Verbindungsrate bei steigender Anzahl an Client-Prozessen (1, 2, 4, ... c).
+ * Jede Verbindung schickt nur ein QUIT, gemessen werden also die Kosten für
+ * Aufbau, Annahme und Abbau einer Verbindung (z.B. fork pro Verbindung
+ * gegenüber Worker-Prozessen, "server -w").
+ *
+ */
+static void benchmarkConnect ()
+{
+    printf("%12s %14s %14s\n", "clients", "conn/sec", "conn/sec/client");
+    fflush(stdout);
+
+    for (int clients = 1; clients <= benchClients; clients *= 2) {
+        int counterPipe[2];
+        startTimedClients(clients, getTimeSeconds() + benchDuration, runConnectClient, counterPipe);
+        long connections = collectTimedClients(clients, counterPipe);
+
+        printf("%12d %14.0f %14.0f\n", clients, (double)connections / benchDuration,
+               (double)connections / benchDuration / clients);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * Liest einen Wert in kB aus einer /proc Datei ("Name:   1234 kB"), -1 wenn
+ * er nicht gefunden wurde.
+ *
+ * @param path - Pfad der Datei
+ * @param field - Name des Werts inkl. Doppelpunkt
+ */
+static long readProcKilobytes (const char *path, const char *field)
+{
+    char line[256];
+    long value = -1;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, field, strlen(field)) == 0) {
+            value = atol(line + strlen(field));
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+
+/**
+ * Summiert den Kernel-Speicher für Sockets, Prozesse und Seitentabellen.
+ *
+ */
+static long getKernelMemoryKilobytes ()
+{
+    return readProcKilobytes("/proc/meminfo", "Slab:") +
+           readProcKilobytes("/proc/meminfo", "KernelStack:") +
+           readProcKilobytes("/proc/meminfo", "PageTables:");
+}
+
+
+/**
+ * Summiert den privaten Speicher (RssAnon) aller Server-Prozesse ("kvsvr"),
+ * funktioniert nur wenn der Server auf demselben Rechner läuft.
+ *
+ * @param processes - Anzahl der gefundenen Server-Prozesse
+ */
+static long getServerMemoryKilobytes (int *processes)
+{
+    char path[280];
+    long total = 0;
+    *processes = 0;
+
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) {
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+
+        char name[64] = "";
+        snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) continue;
+        if (fgets(name, sizeof(name), file) == NULL) name[0] = '\0';
+        fclose(file);
+        if (strncmp(name, "kvsvr", 5) != 0) continue;
+
+        snprintf(path, sizeof(path), "/proc/%s/status", entry->d_name);
+        long rss = readProcKilobytes(path, "RssAnon:");
+        if (rss >= 0) {
+            total += rss;
+            (*processes)++;
+        }
+    }
+    closedir(proc);
+    return total;
+}
+
+
+/**
+ * Hält n ruhende Verbindungen offen und misst den Speicher pro Verbindung.
+ * Die Verbindungen werden in Stufen (128, 256, ... n) aufgebaut, jede
+ * schickt ein GET, damit der Server sie sicher angenommen hat. Gemessen
+ * werden der private Speicher der Server-Prozesse und der Kernel-Speicher
+ * (Sockets, Prozesse). Bricht der Aufbau ab, ist das die maximale Anzahl
+ * gleichzeitiger Verbindungen.
+ *
+ */
+static void benchmarkIdle ()
+{
+    // Jede Verbindung belegt einen Deskriptor im Benchmark-Prozess
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+
+        // Reserve für die /proc Dateien der Messung
+        if (benchRecords > (long)limit.rlim_cur - 32) {
+            benchRecords = (long)limit.rlim_cur - 32;
+            printf("Limited to %ld connections by the descriptor limit of the benchmark\n",
+                   benchRecords);
+        }
+    }
+
+    int *sockets = malloc(benchRecords * sizeof(int));
+    long connections = 0;
+    int processes;
+
+    long baseServer = getServerMemoryKilobytes(&processes);
+    long baseKernel = getKernelMemoryKilobytes();
+
+    printf("%12s %10s %12s %17s %17s\n", "connections", "processes", "server (MB)",
+           "server/conn (KB)", "kernel/conn (KB)");
+    fflush(stdout);
+
+    bool failed = false;
+    for (long target = 128; !failed && connections < benchRecords; target *= 2) {
+        if (target > benchRecords) target = benchRecords;
+
+        while (connections < target) {
+            int sock = tryConnectToServer();
+            if (sock < 0) {
+                failed = true;
+                break;
+            }
+
+            // Nimmt der Server keine weitere Verbindung an, bleibt die Antwort aus
+            struct timeval timeout = {.tv_sec = 2, .tv_usec = 0};
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            if (send(sock, "GET idle\r\n", 10, 0) != 10) {
+                close(sock);
+                failed = true;
+                break;
+            }
+            char buffer[BENCH_RECV_BUFFER_SIZE];
+            if (recv(sock, buffer, sizeof(buffer), 0) <= 0) {
+                close(sock);
+                failed = true;
+                break;
+            }
+            sockets[connections++] = sock;
+        }
+        usleep(500000); // Server-Prozesse sollen ihren Speicher anpassen
+
+        long server = getServerMemoryKilobytes(&processes);
+        long kernel = getKernelMemoryKilobytes();
+        printf("%12ld %10d %12.1f %17.2f %17.2f\n", connections, processes, server / 1024.0,
+               (double)(server - baseServer) / connections,
+               (double)(kernel - baseKernel) / connections);
+        fflush(stdout);
+    }
+    if (failed) {
+        perror("benchmarkIdle");
+        printf("Max. concurrent connections: %ld\n", connections);
+    }
+
+    for (long i = 0; i < connections; i++) {
+        close(sockets[i]);
+    }
+    free(sockets);
+}
+
+
+static void printUsage (const char *name)
+{
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-b binary-port] [-c clients] [-n records] "
+                    "[-v value-size] [-t seconds] [-s server] <mode>\n"
+                    "Modes:\n"
+                    "  put      PUT throughput while the table grows (1K, 10K, ... n)\n"
+                    "  get      GET throughput with 1, 2, 4, ... c clients over n records\n"
+                    "  pipeline GET throughput of c clients sending 1, 2, 4, ... 128\n"
+                    "           pipelined commands per send\n"
+                    "  bulk     PUT throughput of n records with c clients, single PUTs\n"
+                    "           and MPUT with 1, 4, 16, ... records per command\n"
+                    "  protocol GET throughput of c clients, text vs. binary protocol\n"
+                    "  alloc    Server mallocs per command in steady state (fails if\n"
+                    "           not zero, server built with -DALLOC_COUNTER=ON)\n"
+                    "  mixed    PUT latency of one writer while c clients run wildcard\n"
+                    "           scans over n records for t seconds, plus server lock stats\n"
+                    "  stream   Time to first byte and MB/sec of GET bench* over n records,\n"
+                    "           then PUT latency while c clients read it continuously\n"
+                    "  scan     PUT latency while c clients iterate n records with SCAN\n"
+                    "  prefix   CNT/GET throughput of c clients for wildcard patterns with\n"
+                    "           narrow, wide and no literal prefix over n records\n"
+                    "  lookup   Keys/sec of c clients looking up existing and missing keys\n"
+                    "           with MGET while the table grows (1K, 10K, ... n)\n"
+                    "  startup  Starts the server binary (-s) itself with an empty and with\n"
+                    "           n records, once with CSV and once with the binary snapshot,\n"
+                    "           and measures saving n records in MB/sec on shutdown\n"
+                    "  journal  PUT latency for each journal sync policy (-j) of the server\n"
+                    "           binary (-s) started itself, c clients write concurrently\n"
+                    "  snapshot PUT latency over n records while the server binary (-s),\n"
+                    "           started itself, writes a snapshot every second\n"
+                    "  match    Local wildcard matching speed over the keys of " BENCH_KEY_FILE "\n"
+                    "           with normal and adversarial patterns (no server needed)\n"
+                    "  connect  Connections/sec with 1, 2, 4, ... c clients, one QUIT\n"
+                    "           per connection\n"
+                    "  idle     Opens up to n idle connections, server memory per\n"
+                    "           connection and max. concurrent connections\n",
+            name);
+}
+
+
+int main (int argc, char *argv[])
+{
+    int option;
+    while ((option = getopt(argc, argv, "h:p:b:c:n:v:t:s:")) != -1) {
+        switch (option) {
+            case 'h': benchHost = optarg; break;
+            case 'p': benchPort = atoi(optarg); break;
+            case 'b': benchBinaryPort = atoi(optarg); break;
+            case 'c': benchClients = atoi(optarg); break;
+            case 'n': benchRecords = atol(optarg); break;
+            case 'v': benchValueSize = atoi(optarg); break;
+            case 't': benchDuration = atoi(optarg); break;
+            case 's': benchServerPath = optarg; break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || benchClients < 1 || benchValueSize < 1 || benchDuration < 1 ||
+            benchValueSize >= BENCH_RECV_BUFFER_SIZE) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *mode = argv[optind];
+    if (strcmp(mode, "put") == 0) {
+        benchmarkPut();
+    }
+    else if (strcmp(mode, "get") == 0) {
+        benchmarkGet();
+    }
+    else if (strcmp(mode, "pipeline") == 0) {
+        benchmarkPipeline();
+    }
+    else if (strcmp(mode, "bulk") == 0) {
+        benchmarkBulk();
+    }
+    else if (strcmp(mode, "protocol") == 0) {
+        benchmarkProtocol();
+    }
+    else if (strcmp(mode, "alloc") == 0) {
+        return benchmarkAlloc();
+    }
+    else if (strcmp(mode, "mixed") == 0) {
+        benchmarkMixed();
+    }
+    else if (strcmp(mode, "stream") == 0) {
+        benchmarkStream();
+    }
+    else if (strcmp(mode, "scan") == 0) {
+        benchmarkScan();
+    }
+    else if (strcmp(mode, "prefix") == 0) {
+        benchmarkPrefix();
+    }
+    else if (strcmp(mode, "lookup") == 0) {
+        benchmarkLookup();
+    }
+    else if (strcmp(mode, "startup") == 0) {
+        benchmarkStartup();
+    }
+    else if (strcmp(mode, "journal") == 0) {
+        benchmarkJournal();
+    }
+    else if (strcmp(mode, "snapshot") == 0) {
+        benchmarkSnapshot();
+    }
+    else if (strcmp(mode, "match") == 0) {
+        benchmarkMatch();
+    }
+    else if (strcmp(mode, "connect") == 0) {
+        benchmarkConnect();
+    }
+    else if (strcmp(mode, "idle") == 0) {
+        benchmarkIdle();
+    }
+    else {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
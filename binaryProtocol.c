@@ -0,0 +1,233 @@
+#include "binaryProtocol.h"
+
+
+/*
+ * Binäres Protokoll
+ *
+ * Kompakte Alternative zum Text-Protokoll für eigene Clients. Jede Anfrage
+ * besteht aus einem Kopf fester Größe (opcode, Schlüssel-Länge, Wert-Länge)
+ * und den Nutzdaten. Schlüssel und Wert werden direkt in das Befehlsobjekt
+ * kopiert, ohne Zerlegen, Trimmen oder Umwandeln des Befehlsnamens. Alle
+ * Zahlen sind in Network Byte Order.
+ *
+ * Anfrage:  u8 opcode | u8 0 | u16 keyLength | u32 valueLength | key | value
+ * Antwort:  u8 status | u8 opcode | u16 messageLength | u32 recordCount | message
+ *           und pro Datensatz: u16 keyLength | u32 valueLength | key | value
+ *
+ */
+
+
+// Über den opcode indiziert, SUB fehlt da der Observer Text-Nachrichten schickt
+static const char *binaryOpcodeNames[] = {
+    [BINARY_OP_GET] = "GET",
+    [BINARY_OP_PUT] = "PUT",
+    [BINARY_OP_DEL] = "DEL",
+    [BINARY_OP_CNT] = "CNT",
+    [BINARY_OP_MGET] = "MGET",
+    [BINARY_OP_MPUT] = "MPUT",
+    [BINARY_OP_MDEL] = "MDEL",
+    [BINARY_OP_BEG] = "BEG",
+    [BINARY_OP_END] = "END",
+    [BINARY_OP_STAT] = "STAT",
+    [BINARY_OP_OP] = "OP",
+    [BINARY_OP_QUIT] = "QUIT",
+    [BINARY_OP_SCAN] = "SCAN",
+};
+
+
+/**
+ * Erzeugt einen neuen Binär-Puffer auf dem Heap-Speicher.
+ *
+ * @param capacity - Anfängliche Kapazität in Bytes
+ */
+BinaryBuffer* binaryBufferCreate (size_t capacity)
+{
+    BinaryBuffer *buffer = malloc(sizeof(BinaryBuffer));
+
+    buffer->data = malloc(capacity);
+    buffer->length = 0;
+    buffer->capacity = capacity;
+
+    return buffer;
+}
+
+
+/**
+ * Gibt den Heap-Speicher des Binär-Puffers wieder frei.
+ *
+ * @param buffer - Zielobjekt
+ */
+void binaryBufferFree (BinaryBuffer *buffer)
+{
+    free(buffer->data);
+    free(buffer);
+}
+
+
+/**
+ * Vergrößert die Kapazität auf mindestens "capacity" Bytes (mindestens auf
+ * das Doppelte, damit wiederholtes Anhängen nicht jedes Mal kopiert).
+ *
+ * @param buffer - Zielobjekt
+ * @param capacity - Kapazität in Bytes
+ */
+void binaryBufferReserve (BinaryBuffer *buffer, size_t capacity)
+{
+    if (capacity <= buffer->capacity) return;
+
+    if (capacity < buffer->capacity * 2) {
+        capacity = buffer->capacity * 2;
+    }
+    buffer->data = realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+}
+
+
+void binaryBufferAppend (BinaryBuffer *buffer, const void *data, size_t length)
+{
+    binaryBufferReserve(buffer, buffer->length + length);
+    memcpy(&buffer->data[buffer->length], data, length);
+    buffer->length += length;
+}
+
+
+/**
+ * Entfernt die ersten "length" Bytes, der Rest rückt an den Anfang.
+ *
+ * @param buffer - Zielobjekt
+ * @param length - Anzahl der verarbeiteten Bytes
+ */
+void binaryBufferConsume (BinaryBuffer *buffer, size_t length)
+{
+    memmove(buffer->data, &buffer->data[length], buffer->length - length);
+    buffer->length -= length;
+}
+
+
+/**
+ * Liefert den Befehlsnamen zu einem opcode, NULL wenn er unbekannt ist.
+ *
+ * @param opcode - opcode
+ */
+const char* getBinaryOpcodeName (uint8_t opcode)
+{
+    if (opcode >= sizeof(binaryOpcodeNames) / sizeof(char*)) {
+        return NULL;
+    }
+    return binaryOpcodeNames[opcode];
+}
+
+
+/**
+ * Liest den Kopf einer Anfrage (BINARY_REQUEST_HEADER_SIZE Bytes).
+ *
+ * @param data - Empfangene Daten
+ * @param header - Ausgabe des Kopfes
+ */
+void binaryParseRequestHeader (const char *data, BinaryRequestHeader *header)
+{
+    uint16_t keyLength;
+    uint32_t valueLength;
+    memcpy(&keyLength, &data[2], sizeof(keyLength));
+    memcpy(&valueLength, &data[4], sizeof(valueLength));
+
+    header->opcode = (uint8_t)data[0];
+    header->keyLength = ntohs(keyLength);
+    header->valueLength = ntohl(valueLength);
+}
+
+
+/**
+ * Setzt eine Anfrage in das Befehlsobjekt ein. Schlüssel und Wert werden
+ * direkt aus den Nutzdaten kopiert. Gibt BINARY_STATUS_OK zurück, oder den
+ * Grund warum der Befehl nicht ausgeführt werden kann.
+ *
+ * @param cmd - Zielobjekt
+ * @param header - Kopf der Anfrage
+ * @param payload - Schlüssel und Wert
+ */
+int binaryParseRequest (Command *cmd, const BinaryRequestHeader *header, const char *payload)
+{
+    const char *name = getBinaryOpcodeName(header->opcode);
+    if (name == NULL) {
+        return BINARY_STATUS_UNKNOWN_OPCODE;
+    }
+    commandSetName(cmd, name);
+    if (cmd->entry == NULL) {
+        return BINARY_STATUS_UNKNOWN_OPCODE;
+    }
+
+    // Schlüssel und Wert werden als C-Strings weiterverarbeitet und dürfen wie
+    // beim Text-Protokoll keine Zeilenumbrüche enthalten (CSV, Text-Antworten)
+    size_t payloadLength = header->keyLength + header->valueLength;
+    for (size_t i = 0; i < payloadLength; i++) {
+        if (payload[i] == '\0' || payload[i] == '\n' || payload[i] == '\r') {
+            stringCopy(cmd->responseMessage, "argument_bad_symbol");
+            return BINARY_STATUS_REJECTED;
+        }
+    }
+
+    if (cmd->key->capacity < header->keyLength) {
+        stringReserve(cmd->key, header->keyLength);
+    }
+    memcpy(cmd->key->cStr, payload, header->keyLength);
+    cmd->key->cStr[header->keyLength] = '\0';
+    cmd->key->length = header->keyLength;
+
+    if (cmd->value->capacity < header->valueLength) {
+        stringReserve(cmd->value, header->valueLength);
+    }
+    memcpy(cmd->value->cStr, &payload[header->keyLength], header->valueLength);
+    cmd->value->cStr[header->valueLength] = '\0';
+    cmd->value->length = header->valueLength;
+
+    return BINARY_STATUS_OK;
+}
+
+
+static void appendBinaryRecord (BinaryBuffer *output, const String *key, const String *value)
+{
+    char header[BINARY_RECORD_HEADER_SIZE];
+    uint16_t keyLength = htons(key->length);
+    uint32_t valueLength = htonl(value->length);
+    memcpy(&header[0], &keyLength, sizeof(keyLength));
+    memcpy(&header[2], &valueLength, sizeof(valueLength));
+
+    binaryBufferAppend(output, header, sizeof(header));
+    binaryBufferAppend(output, key->cStr, key->length);
+    binaryBufferAppend(output, value->cStr, value->length);
+}
+
+
+/**
+ * Hängt die Antwort auf einen Befehl an den Ausgabepuffer an: Status, die
+ * Meldung und alle Antwort-Datensätze des Befehlsobjekts.
+ *
+ * @param cmd - Ausgeführter Befehl
+ * @param opcode - opcode der Anfrage
+ * @param status - Status (BINARY_STATUS_...)
+ * @param output - Ausgabepuffer
+ */
+void binaryFormatResponse (const Command *cmd, uint8_t opcode, int status, BinaryBuffer *output)
+{
+    const String *message = cmd->responseMessage;
+    size_t messageLength = (status == BINARY_STATUS_OK || status == BINARY_STATUS_REJECTED) ?
+                           strlen(message->cStr) : 0;
+    size_t records = (status == BINARY_STATUS_OK) ? cmd->responseRecords->size : 0;
+
+    char header[BINARY_RESPONSE_HEADER_SIZE];
+    uint16_t length = htons(messageLength);
+    uint32_t count = htonl(records);
+    header[0] = (char)status;
+    header[1] = (char)opcode;
+    memcpy(&header[2], &length, sizeof(length));
+    memcpy(&header[4], &count, sizeof(count));
+
+    binaryBufferAppend(output, header, sizeof(header));
+    binaryBufferAppend(output, message->cStr, messageLength);
+
+    for (size_t i = 0; i < records; i++) {
+        ResponseRecord *record = cmd->responseRecords->cArr[i];
+        appendBinaryRecord(output, record->key, record->value);
+    }
+}
@@ -10,12 +10,19 @@
  */
 
 
-static Array /* CommandEntry */ *commandTable = NULL;
+static Array /* CommandEntry */ *commandTable = NULL; // In Reihenfolge der Registrierung
+static CommandEntry *commandHashTable[COMMAND_TABLE_SIZE]; // Offene Adressierung
+
+// Freigegebene Antwort-Datensätze werden samt ihrer Strings wiederverwendet,
+// damit einzelne Befehle im eingeschwungenen Zustand nichts allozieren
+static Array /* ResponseRecord */ *responseRecordPool = NULL;
+static unsigned long executedCommandCount = 0;
 
 
 void initModuleCommand ()
 {
     commandTable = arrayCreate();
+    responseRecordPool = arrayCreateWithCapacity(RESPONSE_RECORD_POOL_SIZE);
 }
 
 
@@ -23,6 +30,36 @@ void freeModuleCommand ()
 {
     freeCommandTable();
     arrayFree(commandTable);
+
+    for (int i = 0; i < responseRecordPool->size; i++) {
+        ResponseRecord *record = responseRecordPool->cArr[i];
+        stringFree(record->key);
+        stringFree(record->value);
+        free(record);
+    }
+    arrayFree(responseRecordPool);
+}
+
+
+/**
+ * Packt die ersten 4 Zeichen eines Befehlsnamens in eine Zahl. Die meisten
+ * Befehle sind damit schon mit einem Zahlenvergleich gefunden.
+ *
+ * @param name - Befehl
+ */
+static inline uint32_t packCommandName (const char* name)
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 4 && name[i] != '\0'; i++) {
+        packed |= (uint32_t)(unsigned char)name[i] << (8 * i);
+    }
+    return packed;
+}
+
+
+static inline unsigned int getCommandHashSlot (uint32_t packedName)
+{
+    return (packedName * 2654435761u) >> (32 - COMMAND_TABLE_BITS); // Fibonacci-Hashing
 }
 
 
@@ -34,9 +71,14 @@ void freeModuleCommand ()
  */
 CommandEntry* lookupCommandEntry (const char* name)
 {
-    for (int i = 0; i < commandTable->size; i++) {
-        CommandEntry *entry = commandTable->cArr[i];
-        if (stringEquals(entry->name, name)) {
+    uint32_t packed = packCommandName(name);
+    unsigned int slot = getCommandHashSlot(packed);
+
+    for (CommandEntry *entry; (entry = commandHashTable[slot]) != NULL;
+         slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1)) {
+        // Gleiche gepackte Namen stimmen bis zum 4. Zeichen (inkl. Ende) überein
+        if (entry->packedName == packed &&
+                (entry->name->length < 4 || strcmp(&entry->name->cStr[4], &name[4]) == 0)) {
             return entry;
         }
     }
@@ -69,18 +111,30 @@ bool registerCommandEntry (const char* name, int argc, bool wildcardKey, void (*
         return false;
     }
 
-    CommandEntry *entry = lookupCommandEntry(name);
-    if (entry != NULL) {
+    String *upperName = stringToUpper(stringCreate(name));
+    if (lookupCommandEntry(upperName->cStr) != NULL) {
         assert(false && "Overlapping command entry registration!\n");
+        stringFree(upperName);
+        return false;
+    }
+    if (commandTable->size >= COMMAND_TABLE_SIZE / 2) {
+        assert(false && "Command table is full!\n");
+        stringFree(upperName);
         return false;
     }
 
-    entry = malloc(sizeof(CommandEntry));
-    entry->name = stringToUpper(stringCreate(name));
+    CommandEntry *entry = malloc(sizeof(CommandEntry));
+    entry->name = upperName;
+    entry->packedName = packCommandName(upperName->cStr);
     entry->argc = argc;
     entry->wildcardKey = wildcardKey;
     entry->callback = callback;
 
+    unsigned int slot = getCommandHashSlot(entry->packedName);
+    while (commandHashTable[slot] != NULL) {
+        slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1);
+    }
+    commandHashTable[slot] = entry;
     arrayPushItem(commandTable, entry);
 
     return true;
@@ -99,6 +153,7 @@ void freeCommandTable ()
         free(entry);
     }
     arrayClear(commandTable);
+    memset(commandHashTable, 0, sizeof(commandHashTable));
 }
 
 
@@ -131,12 +186,15 @@ Command* commandCreate ()
     Command *cmd = malloc(sizeof(Command));
 
     cmd->name = stringCreate("");
+    cmd->entry = NULL;
     cmd->key = stringCreate("");
     cmd->value = stringCreate("");
 
     cmd->responseMessage = stringCreate("");
 
     cmd->responseRecords = arrayCreate();
+    cmd->responseTrailer = false;
+    cmd->stream = NULL;
 
     return cmd;
 }
@@ -162,6 +220,21 @@ void commandFree (Command* cmd)
 }
 
 
+/**
+ * Setzt den Befehlsnamen (in Großbuchstaben) und sucht einmalig den
+ * zugehörigen Eintrag der Befehlstabelle, den Ausführen und Formatieren
+ * dann wiederverwenden.
+ *
+ * @param cmd - Zielobjekt
+ * @param name - Befehl
+ */
+void commandSetName (Command *cmd, const char *name)
+{
+    stringToUpper(stringCopy(cmd->name, name));
+    cmd->entry = lookupCommandEntry(cmd->name->cStr);
+}
+
+
 /**
  * Validiert die Argumente und ruft die in der Befehlstabelle mit dem
  * Befehl assoziierten Funktion auf.
@@ -172,8 +245,10 @@ bool commandExecute (Command *cmd)
 {
     stringCopy(cmd->responseMessage, "");
     responseRecordsFree(cmd->responseRecords);
+    cmd->responseTrailer = false;
+    if (cmd->stream != NULL) responseStreamClose(cmd->stream);
 
-    CommandEntry *entry = lookupCommandEntry(cmd->name->cStr);
+    CommandEntry *entry = cmd->entry;
     if (entry == NULL) {
         return false;
     }
@@ -195,6 +270,7 @@ bool commandExecute (Command *cmd)
     if (entry->callback == NULL) {
         return false;
     }
+    executedCommandCount++;
     entry->callback(cmd);
 
     return true;
@@ -216,7 +292,7 @@ void commandParseInputMessage (Command *cmd, String *inputMessage)
     const char *key = strtok(NULL, " \t");
     const char *value = strtok(NULL, "");
 
-    stringToUpper(stringCopy(cmd->name, (name != NULL) ? name : ""));
+    commandSetName(cmd, (name != NULL) ? name : "");
     stringCopy(cmd->key, (key != NULL) ? key : "");
     stringCopy(cmd->value, (value != NULL) ? value : "");
 }
@@ -230,21 +306,30 @@ void commandParseInputMessage (Command *cmd, String *inputMessage)
  */
 void commandFormatResponseMessage (const Command *cmd, String *responseMessage)
 {
-    CommandEntry *entry = lookupCommandEntry(cmd->name->cStr);
-    if (entry == NULL) {
+    if (cmd->entry == NULL) {
         formatCommandOverviewMessage(responseMessage);
         stringAppend(responseMessage, "\r\n");
         return;
     }
 
+    // Die Datensätze folgen über responseStreamWrite()
+    if (cmd->stream != NULL && responseStreamIsOpen(cmd->stream)) {
+        stringCopy(responseMessage, "");
+        return;
+    }
+
     size_t records = cmd->responseRecords->size;
-    if (records > 0) {
+    if (records > 0 || cmd->responseTrailer) {
         stringCopy(responseMessage, "");
         for (int i = 0; i < records; i++) {
             ResponseRecord *record = cmd->responseRecords->cArr[i];
             stringAppendFormat(responseMessage, "%s:%s:%s\r\n",
                                cmd->name->cStr, record->key->cStr, record->value->cStr);
         }
+        if (cmd->responseTrailer) {
+            stringAppendFormat(responseMessage, "%s:%s\r\n",
+                               cmd->name->cStr, cmd->responseMessage->cStr);
+        }
         return;
     }
 
@@ -267,7 +352,158 @@ void commandFormatResponseMessage (const Command *cmd, String *responseMessage)
 
 
 /**
- * Fügt einem Befehlsobjekt einen Antwort-Datensatz hinzu.
+ * Anzahl der in diesem Prozess ausgeführten Befehle.
+ *
+ */
+unsigned long getExecutedCommandCount ()
+{
+    return executedCommandCount;
+}
+
+
+/**
+ * Erzeugt einen (geschlossenen) Antwort-Stream. Ein Verbindungs-Handler
+ * gibt ihn einem Befehlsobjekt, wenn er große Antworten abschnittsweise
+ * senden kann.
+ *
+ */
+ResponseStream* responseStreamCreate ()
+{
+    ResponseStream *stream = malloc(sizeof(ResponseStream));
+
+    stream->write = NULL;
+    stream->name = stringCreate("");
+    stream->key = stringCreate("");
+    stream->value = stringCreate("");
+    stream->resumeKey = stringCreate("");
+    stream->cursor = 0;
+    stream->count = 0;
+
+    return stream;
+}
+
+
+/**
+ * Gibt den Heap-Speicher des Antwort-Streams wieder frei.
+ *
+ * @param stream - Zielobjekt
+ */
+void responseStreamFree (ResponseStream *stream)
+{
+    stringFree(stream->name);
+    stringFree(stream->key);
+    stringFree(stream->value);
+    stringFree(stream->resumeKey);
+    free(stream);
+}
+
+
+/**
+ * Öffnet den Antwort-Stream für einen Befehl. Statt die Datensätze zu sammeln,
+ * schreibt "write" sie später abschnittsweise in den Ausgabepuffer der
+ * Verbindung. Name, Schlüssel und Wert werden kopiert, da das Befehlsobjekt
+ * bis dahin wiederverwendet werden kann.
+ *
+ * @param stream - Zielobjekt
+ * @param cmd - Befehl, dessen Antwort gestreamt wird
+ * @param write - Schreibt den nächsten Abschnitt der Antwort
+ */
+void responseStreamOpen (ResponseStream *stream, const Command *cmd, ResponseStreamFunction write)
+{
+    stream->write = write;
+    stringCopy(stream->name, cmd->name->cStr);
+    stringCopy(stream->key, cmd->key->cStr);
+    stringCopy(stream->value, cmd->value->cStr);
+    stringCopy(stream->resumeKey, "");
+    stream->cursor = 0;
+    stream->count = 0;
+}
+
+
+void responseStreamClose (ResponseStream *stream)
+{
+    stream->write = NULL;
+}
+
+
+bool responseStreamIsOpen (const ResponseStream *stream)
+{
+    return stream->write != NULL;
+}
+
+
+/**
+ * Hängt den nächsten Abschnitt der Antwort an, bis "output" mindestens
+ * "limit" Zeichen enthält. Wurde kein Datensatz gefunden, wird wie bei
+ * gesammelten Datensätzen "key_nonexistent" gemeldet. Gibt false zurück,
+ * sobald die Antwort vollständig ist (der Stream ist dann geschlossen).
+ *
+ * @param stream - Zielobjekt
+ * @param output - Ausgabepuffer
+ * @param limit - Gewünschte Länge des Ausgabepuffers
+ */
+bool responseStreamWrite (ResponseStream *stream, String *output, size_t limit)
+{
+    if (!responseStreamIsOpen(stream)) return false;
+    if (!stream->write(stream, output, limit)) return true;
+
+    if (stream->count == 0) {
+        stringAppend(output, stream->name->cStr);
+        stringAppend(output, ":");
+        stringAppend(output, stream->key->cStr);
+        if (!stringIsEmpty(stream->value)) {
+            stringAppend(output, ":");
+            stringAppend(output, stream->value->cStr);
+        }
+        stringAppend(output, ":key_nonexistent\r\n");
+    }
+    responseStreamClose(stream);
+    return false;
+}
+
+
+/**
+ * Hängt einen Datensatz im Format der gesammelten Datensätze an, ohne
+ * Format-String und ohne Zwischenkopie.
+ *
+ * @param stream - Zielobjekt
+ * @param output - Ausgabepuffer
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ * @param value - Wert
+ * @param valueLength - Länge des Werts
+ */
+void responseStreamAppendRecord (ResponseStream *stream, String *output,
+                                 const char *key, size_t keyLength, const char *value, size_t valueLength)
+{
+    size_t nameLength = stringLength(stream->name);
+    size_t length = stringLength(output);
+    size_t required = length + nameLength + keyLength + valueLength + 4;
+    if (required > output->capacity) {
+        stringReserve(output, (required > 2 * output->capacity) ? required : 2 * output->capacity);
+    }
+
+    char *pos = &output->cStr[length];
+    memcpy(pos, stream->name->cStr, nameLength);
+    pos += nameLength;
+    *pos++ = ':';
+    memcpy(pos, key, keyLength);
+    pos += keyLength;
+    *pos++ = ':';
+    memcpy(pos, value, valueLength);
+    pos += valueLength;
+    *pos++ = '\r';
+    *pos++ = '\n';
+    *pos = '\0';
+    output->length = required;
+
+    stream->count++;
+}
+
+
+/**
+ * Fügt einem Befehlsobjekt einen Antwort-Datensatz hinzu. Nimmt dafür
+ * möglichst einen freigegebenen Datensatz aus dem Pool.
  *
  * @param records - Antwort-Datensätze
  * @param key - Schlüssel
@@ -275,9 +511,17 @@ void commandFormatResponseMessage (const Command *cmd, String *responseMessage)
  */
 ResponseRecord* responseRecordsAdd (Array* records, const char* key, const char* value)
 {
-    ResponseRecord *record = malloc(sizeof(ResponseRecord));
-    record->key = stringCreate(key);
-    record->value = stringCreate(value);
+    ResponseRecord *record;
+    if (responseRecordPool != NULL && responseRecordPool->size > 0) {
+        record = arrayPopItem(responseRecordPool);
+        stringCopy(record->key, key);
+        stringCopy(record->value, value);
+    }
+    else {
+        record = malloc(sizeof(ResponseRecord));
+        record->key = stringCreate(key);
+        record->value = stringCreate(value);
+    }
 
     arrayPushItem(records, record);
 
@@ -286,19 +530,46 @@ ResponseRecord* responseRecordsAdd (Array* records, const char* key, const char*
 
 
 /**
- * Gibt den Heap-Speicher aller Datensätze (ResponseRecord Objekte) in dem
- * Befehlsobjekt frei.
+ * Gibt einen Datensatz an den Pool zurück, oder seinen Heap-Speicher frei
+ * wenn der Pool voll ist oder der Datensatz zu viel Speicher belegt.
+ *
+ * @param record - Datensatz
+ */
+static void releaseResponseRecord (ResponseRecord *record)
+{
+    if (responseRecordPool != NULL && responseRecordPool->size < RESPONSE_RECORD_POOL_SIZE &&
+            record->key->capacity + record->value->capacity <= RESPONSE_RECORD_POOL_CAPACITY) {
+        arrayPushItem(responseRecordPool, record);
+        return;
+    }
+
+    stringFree(record->key);
+    stringFree(record->value);
+    free(record);
+}
+
+
+/**
+ * Entfernt den zuletzt hinzugefügten Datensatz wieder.
+ *
+ * @param records - Antwort-Datensätze
+ */
+void responseRecordsRemoveLast (Array* records)
+{
+    releaseResponseRecord(arrayPopItem(records));
+}
+
+
+/**
+ * Gibt alle Datensätze (ResponseRecord Objekte) in dem Befehlsobjekt frei
+ * bzw. an den Pool zurück.
  *
  * @param records - Antwort-Datensätze
  */
 void responseRecordsFree (Array* records)
 {
     for (int i = 0; i < records->size; i++) {
-        ResponseRecord *record = records->cArr[i];
-        stringFree(record->key);
-        stringFree(record->value);
-        free(record);
+        releaseResponseRecord(records->cArr[i]);
     }
     arrayClear(records);
 }
-
@@ -472,34 +472,143 @@ int strMatchAnyChar (const char* str, const char *match, int charGroup)
 }
 
 
-// "One-Liner Challenge" Original-Version: https://www.ioccc.org/2001/schweikh.c
 bool strMatchWildcard (const char *str, const char *wildcard)
 {
-    if (*wildcard == '*') {
-        // Wenn der Wildcard-Ausdruck mit einem '*' endet, ist
-        // jedes weitere Zeichen im String immer ein Match
-        if (wildcard[1] == '\0' ||
-                // '*' ist nichts im String (oder wurde bereits übersprungen)
-                strMatchWildcard(str, wildcard+1) ||
-                // '*' ist ein (oder mehrere) Zeichen im String
-                (*str != '\0' && strMatchWildcard(str+1, wildcard))) {
-            return true;
+    // Position nach dem letzten '*' und das Zeichen im String, ab dem er
+    // zuletzt angelegt wurde. Frühere '*' müssen nie erneut versucht werden,
+    // die Laufzeit ist deshalb höchstens Länge(str) * Länge(wildcard).
+    const char *starWildcard = NULL;
+    const char *starStr = NULL;
+
+    while (*str != '\0') {
+        if (*wildcard == '*') {
+            starWildcard = ++wildcard;
+            starStr = str;
+        }
+        else if (*wildcard == *str || (*wildcard == '?')) {
+            wildcard++;
+            str++;
+        }
+        else if (starWildcard != NULL) {
+            // Der letzte '*' umfasst ein Zeichen mehr
+            wildcard = starWildcard;
+            str = ++starStr;
+        }
+        else {
+            return false;
         }
-        return false;
     }
 
-    // Wenn der String am Ende ist, muss der Wildcard-Ausdruck es auch sein
-    // (und aktuell kein '*', wurde bereits ausgeschlossen), sonst haben wir
-    // ein Mismatch
-    if (*str == '\0') {
-        return *wildcard == '\0';
+    while (*wildcard == '*') wildcard++;
+    return *wildcard == '\0';
+}
+
+
+static inline bool matchWildcardSegment (const char *str, const char *segment, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (str[i] != segment[i] && segment[i] != '?') {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Normaler 1:1 bzw. 1:'?' Vergleich schlägt fehl
-    if (*str != *wildcard && *wildcard != '?') {
-        return false;
+
+// Erste Position von "segment" (ohne '*') in [str, end), bei Fehlschlag NULL
+static const char* findWildcardSegment (const char *str, const char *end,
+                                        const char *segment, size_t length)
+{
+    for (; str + length <= end; str++) {
+        if (segment[0] != '?') {
+            str = memchr(str, segment[0], (size_t)(end - str) - length + 1);
+            if (str == NULL) {
+                return NULL;
+            }
+        }
+        if (matchWildcardSegment(str, segment, length)) {
+            return str;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Bereitet den Wildcard-Ausdruck für viele Vergleiche vor (z.B. mit allen
+ * Einträgen des Storage). "wildcard" wird nicht kopiert und muss gültig
+ * bleiben, solange "pattern" benutzt wird.
+ *
+ * @param pattern - Zielobjekt
+ * @param wildcard - Wildcard
+ */
+void strCompileWildcard (WildcardPattern *pattern, const char *wildcard)
+{
+    size_t length = strlen(wildcard);
+    size_t suffixStart = length;
+    size_t stars = 0;
+
+    while (suffixStart > 0 && wildcard[suffixStart - 1] != '*') suffixStart--;
+    for (size_t i = 0; i < length; i++) {
+        if (wildcard[i] == '*') stars++;
     }
 
-    return strMatchWildcard(str+1, wildcard+1);
+    pattern->wildcard = wildcard;
+    pattern->length = length;
+    pattern->hasStar = stars > 0;
+    pattern->prefixLength = strcspn(wildcard, "*");
+    pattern->suffixLength = (stars > 0) ? length - suffixStart : 0;
+    pattern->minLength = length - stars;
 }
 
+
+/**
+ * Wie strMatchWildcard, aber mit vorbereitetem Wildcard-Ausdruck und bekannter
+ * Länge von "str". Fester Anfang und festes Ende werden direkt an ihrer
+ * Position verglichen, nur die Abschnitte dazwischen werden gesucht.
+ *
+ * @param pattern - Vorbereiteter Wildcard-Ausdruck
+ * @param str - Zeichenkette
+ * @param length - Länge von "str"
+ */
+bool strMatchCompiledWildcard (const WildcardPattern *pattern, const char *str, size_t length)
+{
+    const char *wildcard = pattern->wildcard;
+
+    if (!pattern->hasStar) {
+        return length == pattern->length && matchWildcardSegment(str, wildcard, length);
+    }
+    if (length < pattern->minLength ||
+            !matchWildcardSegment(str, wildcard, pattern->prefixLength) ||
+            !matchWildcardSegment(&str[length - pattern->suffixLength],
+                                  &wildcard[pattern->length - pattern->suffixLength],
+                                  pattern->suffixLength)) {
+        return false;
+    }
+
+    // Die Abschnitte zwischen den '*' werden der Reihe nach jeweils möglichst
+    // weit links gesucht, ein späterer Treffer kann nie mehr Platz lassen
+    size_t pos = pattern->prefixLength;
+    size_t end = length - pattern->suffixLength;
+    size_t w = pattern->prefixLength;
+    size_t wildcardEnd = pattern->length - pattern->suffixLength;
+
+    while (w < wildcardEnd) {
+        if (wildcard[w] == '*') {
+            w++;
+            continue;
+        }
+
+        const char *segment = &wildcard[w];
+        size_t segmentLength = 0;
+        while (segment[segmentLength] != '*') segmentLength++;
+
+        const char *found = findWildcardSegment(&str[pos], &str[end], segment, segmentLength);
+        if (found == NULL) {
+            return false;
+        }
+        pos = (size_t)(found - str) + segmentLength;
+        w += segmentLength;
+    }
+    return true;
+}
@@ -115,6 +115,26 @@ void httpRequestParseMessage (HttpRequest *request, String *requestMessage)
 }
 
 
+/**
+ * Führt einen Befehl aus, schreibt das Ergebnis als JSON in die Antwort und
+ * gibt das Befehlsobjekt frei.
+ *
+ * @param cmd - Befehlsobjekt
+ * @param response - Zielobjekt
+ */
+static void processJsonCommand (Command *cmd, HttpResponse *response)
+{
+    commandExecute(cmd);
+    commandToJson(cmd, response->payload);
+
+    commandFree(cmd);
+
+    response->statusCode = HTTP_STATUS_OK;
+    response->payloadSize = stringLength(response->payload);
+    httpResponseAttributeAdd(response, "Content-Type: application/json");
+}
+
+
 /**
  * Verarbeitet eine Http-Anfrage und speichert die Ergebnisse in dem
  * Http-Response-Objekt. Leitet die Anfrage bei Aufruf der REST-API-URL an den
@@ -138,26 +158,39 @@ void httpRequestProcess (HttpRequest *request, HttpResponse *response)
 
         Command *cmd = commandCreate();
 
-        stringCopy(cmd->name, request->method->cStr);
+        // "DELETE" -> "DEL"
+        commandSetName(cmd, stringEquals(request->method, "DELETE") ? "DEL" : request->method->cStr);
         stringCopy(cmd->key, request->url->cStr);
         stringCopy(cmd->value, request->payload->cStr);
 
-        // "DELETE" -> "DEL"
-        if (stringEquals(cmd->name, "DELETE")) {
-            stringCut(cmd->name, 0, 3);
-        }
         // "/storage/key" -> "key"
         stringCut(cmd->key,strlen(STORAGE_URL),
                   stringLength(cmd->key));
 
-        commandExecute(cmd);
-        commandToJson(cmd, response->payload);
+        processJsonCommand(cmd, response);
+        return;
+    }
+    // Seitenweises Durchlaufen der Datenbank
+    // --------------------------------------
+    if (strncmp(request->url->cStr, SCAN_URL, strlen(SCAN_URL)) == 0) {
+        if (!stringEquals(request->method, "GET")) {
+            response->statusCode = HTTP_STATUS_METHOD_NOT_ALLOWED;
+            httpResponseAttributeAdd(response, "Allow: GET");
+            return;
+        }
 
-        commandFree(cmd);
+        // "/scan/cursor/pattern/count" -> "SCAN cursor pattern count"
+        String *line = stringCreate("SCAN ");
+        stringAppend(line, &request->url->cStr[strlen(SCAN_URL)]);
+        for (char *c = line->cStr; *c != '\0'; c++) {
+            if (*c == '/') *c = ' ';
+        }
 
-        response->statusCode = HTTP_STATUS_OK;
-        response->payloadSize = stringLength(response->payload);
-        httpResponseAttributeAdd(response, "Content-Type: application/json");
+        Command *cmd = commandCreate();
+        commandParseInputMessage(cmd, line);
+        stringFree(line);
+
+        processJsonCommand(cmd, response);
         return;
     }
     // Zugriff auf das Webroot-Verzeichnis
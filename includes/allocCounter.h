@@ -0,0 +1,12 @@
+#ifndef SERVER_ALLOCCOUNTER_H
+#define SERVER_ALLOCCOUNTER_H
+
+#include <stddef.h>
+#include <errno.h>
+
+
+unsigned long getAllocationCount ();
+unsigned long getReleaseCount ();
+
+
+#endif //SERVER_ALLOCCOUNTER_H
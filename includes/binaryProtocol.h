@@ -0,0 +1,64 @@
+#ifndef SERVER_BINARYPROTOCOL_H
+#define SERVER_BINARYPROTOCOL_H
+
+#include "utils.h"
+#include "command.h"
+
+#include <stdint.h>
+#include <arpa/inet.h>
+
+
+#define BINARY_REQUEST_HEADER_SIZE 8 // opcode, reserviert, Schlüssel-Länge (16 Bit), Wert-Länge (32 Bit)
+#define BINARY_RESPONSE_HEADER_SIZE 8 // Status, opcode, Meldungs-Länge (16 Bit), Anzahl Datensätze (32 Bit)
+#define BINARY_RECORD_HEADER_SIZE 6 // Schlüssel-Länge (16 Bit), Wert-Länge (32 Bit)
+#define BINARY_MAX_PAYLOAD_SIZE (1024 * 1024) // Schlüssel + Wert einer Anfrage
+
+#define BINARY_OP_GET 1
+#define BINARY_OP_PUT 2
+#define BINARY_OP_DEL 3
+#define BINARY_OP_CNT 4
+#define BINARY_OP_MGET 5
+#define BINARY_OP_MPUT 6
+#define BINARY_OP_MDEL 7
+#define BINARY_OP_BEG 8
+#define BINARY_OP_END 9
+#define BINARY_OP_STAT 10
+#define BINARY_OP_OP 11
+#define BINARY_OP_QUIT 12
+#define BINARY_OP_SCAN 13 // Die Meldung der Antwort ist der nächste Cursor
+
+#define BINARY_STATUS_OK 0
+#define BINARY_STATUS_REJECTED 1 // Argumente ungültig, die Meldung enthält den Grund
+#define BINARY_STATUS_UNKNOWN_OPCODE 2
+#define BINARY_STATUS_TOO_LARGE 3 // Die Verbindung wird danach geschlossen
+
+
+typedef struct {
+    uint8_t opcode;
+    uint16_t keyLength;
+    uint32_t valueLength;
+} BinaryRequestHeader;
+
+
+// Puffer für Binärdaten (können Nullbytes enthalten, daher kein String)
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} BinaryBuffer;
+
+
+BinaryBuffer* binaryBufferCreate (size_t capacity);
+void binaryBufferFree (BinaryBuffer *buffer);
+void binaryBufferReserve (BinaryBuffer *buffer, size_t capacity);
+void binaryBufferAppend (BinaryBuffer *buffer, const void *data, size_t length);
+void binaryBufferConsume (BinaryBuffer *buffer, size_t length);
+
+const char* getBinaryOpcodeName (uint8_t opcode);
+
+void binaryParseRequestHeader (const char *data, BinaryRequestHeader *header);
+int binaryParseRequest (Command *cmd, const BinaryRequestHeader *header, const char *payload);
+void binaryFormatResponse (const Command *cmd, uint8_t opcode, int status, BinaryBuffer *output);
+
+
+#endif //SERVER_BINARYPROTOCOL_H
@@ -4,23 +4,54 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <stdint.h>
+
+
+#define COMMAND_TABLE_BITS 6
+#define COMMAND_TABLE_SIZE (1 << COMMAND_TABLE_BITS) // Positionen der Hash-Tabelle der Befehle
+
+#define RESPONSE_RECORD_POOL_SIZE 1024 // Freigegebene Datensätze zur Wiederverwendung
+#define RESPONSE_RECORD_POOL_CAPACITY PAGE_SIZE // Größere Datensätze werden nicht aufgehoben
+
+
+typedef struct Command Command;
+typedef struct ResponseStream ResponseStream;
 
 
 typedef struct {
     String *name;
+    uint32_t packedName; // Die ersten 4 Zeichen des Namens als Zahl (Hash-Tabelle)
+    int argc;
+    bool wildcardKey;
+    void (*callback)(Command*);
+} CommandEntry;
+
+
+struct Command {
+    String *name;
+    CommandEntry *entry; // Beim Setzen des Namens aufgelöst, NULL = unbekannter Befehl
     String *key;
     String *value;
     String *responseMessage;
     Array /* ResponseRecord */ *responseRecords;
-} Command;
+    bool responseTrailer; // Die Meldung folgt als letzte Zeile auf die Datensätze (Cursor von SCAN)
+    ResponseStream *stream; // Antworten dürfen gestreamt werden, NULL = nur Datensätze
+};
 
 
-typedef struct {
+// Schreibt den nächsten Abschnitt der Antwort, gibt true zurück wenn sie vollständig ist
+typedef bool (*ResponseStreamFunction)(ResponseStream *stream, String *output, size_t limit);
+
+
+struct ResponseStream {
+    ResponseStreamFunction write; // NULL = geschlossen
     String *name;
-    int argc;
-    bool wildcardKey;
-    void (*callback)(Command*);
-} CommandEntry;
+    String *key;
+    String *value;
+    int cursor; // Fortschritt der schreibenden Funktion
+    String *resumeKey; // Zuletzt besuchter Schlüssel, falls die Funktion danach fortsetzt
+    unsigned long count; // Geschriebene Datensätze
+};
 
 
 typedef struct {
@@ -39,12 +70,25 @@ void formatCommandOverviewMessage (String *cmdMessage);
 
 Command* commandCreate ();
 void commandFree (Command* cmd);
+void commandSetName (Command *cmd, const char *name);
 
 bool commandExecute (Command *cmd);
 void commandParseInputMessage (Command *cmd, String *inputMessage);
 void commandFormatResponseMessage (const Command *cmd, String *responseMessage);
 
+unsigned long getExecutedCommandCount ();
+
+ResponseStream* responseStreamCreate ();
+void responseStreamFree (ResponseStream *stream);
+void responseStreamOpen (ResponseStream *stream, const Command *cmd, ResponseStreamFunction write);
+void responseStreamClose (ResponseStream *stream);
+bool responseStreamIsOpen (const ResponseStream *stream);
+bool responseStreamWrite (ResponseStream *stream, String *output, size_t limit);
+void responseStreamAppendRecord (ResponseStream *stream, String *output,
+                                 const char *key, size_t keyLength, const char *value, size_t valueLength);
+
 ResponseRecord* responseRecordsAdd (Array* records, const char* key, const char* value);
+void responseRecordsRemoveLast (Array* records);
 void responseRecordsFree (Array* records);
 
 
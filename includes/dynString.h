@@ -26,6 +26,17 @@ typedef struct {
 } String;
 
 
+// Für viele Vergleiche mit demselben Wildcard-Ausdruck vorbereitet (strCompileWildcard)
+typedef struct {
+    const char *wildcard; // Wird nicht kopiert
+    size_t length;
+    size_t prefixLength; // Zeichen vor dem ersten '*'
+    size_t suffixLength; // Zeichen nach dem letzten '*'
+    size_t minLength; // Zeichen außer '*'
+    bool hasStar;
+} WildcardPattern;
+
+
 String* stringCreate (const char* value);
 String* stringCreateWithFormat (const char* format, ...);
 String* stringCreateWithCapacity (const char* value, size_t capacity);
@@ -59,6 +70,8 @@ char* strTrimSpaces (char *str);
 bool strMatchAllChar (const char *str, const char *match, int charGroup);
 int strMatchAnyChar (const char *str, const char *match, int charGroup);
 bool strMatchWildcard (const char *str, const char *wildcard);
+void strCompileWildcard (WildcardPattern *pattern, const char *wildcard);
+bool strMatchCompiledWildcard (const WildcardPattern *pattern, const char *str, size_t length);
 
 
 #endif // DYNSTRING_H
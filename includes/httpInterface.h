@@ -18,6 +18,7 @@
 #define WEB_ROOT_DIR "../http/"
 #define WEB_INDEX_FILE "index.html"
 #define STORAGE_URL "/storage/"
+#define SCAN_URL "/scan/" // /scan/cursor/pattern/count
 
 
 typedef struct {
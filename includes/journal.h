@@ -0,0 +1,74 @@
+#ifndef SERVER_JOURNAL_H
+#define SERVER_JOURNAL_H
+
+#include "utils.h"
+#include "lock.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define JOURNAL_FILE "../journal.log"
+#define JOURNAL_ROTATED_FILE "../journal.old" // Bis der Snapshot des Timers auf der Platte ist
+#define JOURNAL_BUFFER_SIZE (64 * 1024) // Schreibpuffer pro Prozess, wird spätestens dann geschrieben
+
+#define JOURNAL_SYNC_OFF 0 // Kein Journal
+#define JOURNAL_SYNC_NONE 1 // Journal ohne fdatasync(), der Kernel schreibt es irgendwann
+#define JOURNAL_SYNC_ALWAYS 2 // Jede Antwort erst nach fdatasync() (Group-Commit)
+#define JOURNAL_SYNC_INTERVAL 3 // fdatasync() alle "interval" Millisekunden
+#define JOURNAL_SYNC_BYTES 4 // fdatasync() sobald "bytes" Bytes nicht synchronisiert sind
+
+#define JOURNAL_PUT 1
+#define JOURNAL_DEL 2
+
+
+typedef struct {
+    int mode; // JOURNAL_SYNC_*
+    int interval; // Millisekunden, nur JOURNAL_SYNC_INTERVAL
+    unsigned long bytes; // Nur JOURNAL_SYNC_BYTES
+} JournalPolicy;
+
+
+typedef struct {
+    unsigned long long appendedBytes; // Geschrieben (write() zurückgekehrt)
+    unsigned long long syncedBytes; // Davon durch fdatasync() auf der Platte
+    unsigned long syncCount;
+    unsigned int generation; // Wird bei jeder Rotation erhöht
+} JournalHeader;
+
+
+// Datensatz im Journal, danach "key\0value\0" (bei JOURNAL_DEL "key\0\0")
+typedef struct {
+    unsigned int checksum; // Über alle folgenden Bytes des Datensatzes
+    unsigned int type; // JOURNAL_PUT oder JOURNAL_DEL
+    unsigned int keyLength;
+    unsigned int valueLength;
+} JournalRecord;
+
+
+void initModuleJournal (JournalPolicy policy);
+void freeModuleJournal ();
+
+bool parseJournalPolicy (const char *name, JournalPolicy *policy);
+
+long replayJournal (void (*apply)(int type, const char *key, size_t keyLength,
+                                  const char *value, size_t valueLength));
+void openJournal ();
+void rotateJournal ();
+void discardRotatedJournal ();
+void resetJournal ();
+
+void logJournalPut (const char *key, size_t keyLength, const char *value, size_t valueLength);
+void logJournalDelete (const char *key, size_t keyLength);
+void writeJournal ();
+void commitJournal ();
+
+void runJournalTimer (int interval);
+
+
+#endif //SERVER_JOURNAL_H
@@ -3,27 +3,101 @@
 
 #include "utils.h"
 #include "command.h"
+#ifdef ALLOC_COUNTER
+#include "allocCounter.h"
+#endif
 
 #include <time.h>
-#include <sys/sem.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 
 #define READ_ACCESS 0
 #define WRITE_ACCESS 1
 
+#define LOCK_POLICY_READER 0 // Leser bevorzugt (Schreiber können verhungern)
+#define LOCK_POLICY_WRITER 1 // Schreiber bevorzugt
+#define LOCK_POLICY_FAIR 2 // Reihenfolge der Anfragen (Warteschlange)
+
+#define LOCK_STRIPE_BITS 6
+#define LOCK_STRIPES (1 << LOCK_STRIPE_BITS) // Teil-Locks, über den Schlüssel-Hash gewählt
+
+// 4 Buckets pro Zweierpotenz in Nanosekunden (max. Fehler 25%), bis ca. 18 Minuten
+#define LOCK_WAIT_BUCKETS (4 * 40)
+
+
+typedef unsigned long long StripeSet; // Bit i = Stripe i (LOCK_STRIPES <= 64)
+
+
+typedef struct {
+    unsigned long count;
+    unsigned long totalNanos;
+    unsigned long buckets[LOCK_WAIT_BUCKETS];
+} LockWaitStats;
+
+
+typedef struct {
+    struct robust_list robustEntry; // Eintrag in der Robust-Futex-Liste des Schreibers
+    unsigned int writer; // Thread-Id des Schreibers | FUTEX_WAITERS | FUTEX_OWNER_DIED
+    unsigned int readers; // Leser im kritischen Abschnitt
+    unsigned int writersWaiting; // Nur LOCK_POLICY_WRITER
+    unsigned int drainWaiting; // Schreiber die auf das Ende der Leser warten
+    unsigned int ticketNext; // Drehkreuz, nur LOCK_POLICY_FAIR
+    unsigned int ticketServing;
+} RwLock;
+
+
+typedef struct {
+    RwLock stripes[LOCK_STRIPES];
+    RwLock allocationLock; // Nur das Schreiber-Wort wird als Mutex benutzt
+    RwLock exclusiveLock; // Nur das Schreiber-Wort, zeigt Lesern ohne Lock den exklusiven Modus an
+    RwLock journalLock; // Nur das Schreiber-Wort, ein fdatasync() des Journals zur Zeit
+    LockWaitStats waitStats[2]; // Pro Zugriffs-Art
+} LockHeader;
+
 
 void eventCommandBeginn (Command *cmd);
 void eventCommandEnd (Command *cmd);
+void eventCommandStat (Command *cmd);
 
-void initModuleLock ();
+void initModuleLock (int policy);
 void freeModuleLock ();
 
+int parseLockPolicy (const char *name);
+const char* getLockPolicyName (int policy);
+
 void enterCriticalSection (int accessType);
 void leaveCriticalSection (int accessType);
+void enterStripeSection (unsigned int hash, int accessType);
+void leaveStripeSection (unsigned int hash, int accessType);
+void enterStripeSetSection (StripeSet stripes, int accessType);
+void leaveStripeSetSection (StripeSet stripes, int accessType);
+void enterAllocationSection ();
+void leaveAllocationSection ();
+void enterJournalSection ();
+void leaveJournalSection ();
 
 bool enterExclusiveMode ();
 bool leaveExclusiveMode ();
+bool isExclusiveModeActive ();
+
+unsigned long getLockWaitPercentile (int accessType, double percentile);
+
+
+static inline unsigned int getLockStripe (unsigned int hash)
+{
+    return hash & (LOCK_STRIPES - 1);
+}
+
+
+static inline StripeSet getLockStripeBit (unsigned int hash)
+{
+    return 1ULL << getLockStripe(hash);
+}
 
 
 #endif //SERVER_LOCK_H
@@ -4,6 +4,10 @@
 #include "utils.h"
 #include "command.h"
 #include "httpInterface.h"
+#include "binaryProtocol.h"
+#include "lock.h"
+#include "newsletter.h"
+#include "ringBuffer.h"
 
 #include <stdio.h>
 #include <sys/socket.h>
@@ -11,28 +15,63 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 
 
 #define SOCKET int
 #define RECV_BUFFER_SIZE PAGE_SIZE
+#define RECV_RING_SIZE (2 * RECV_BUFFER_SIZE) // Platz für eine unvollständige Zeile und einen weiteren Empfang
+#define SEND_BATCH_SIZE (16 * PAGE_SIZE) // Ab dieser Größe werden gesammelte Antworten vorzeitig gesendet
 
 #define COMMAND_SERVER_PORT 5678
+#define BINARY_SERVER_PORT 5679
 #define HTTP_SERVER_PORT 5680
 
+#define SERVER_LISTEN_BACKLOG 128
+#define SERVER_MAX_WORKERS 256
+#define EVENT_LOOP_MAX_EVENTS 64
+
+#define BATCH_DONE 0 // Alle vollständigen Zeilen verarbeitet
+#define BATCH_FULL 1 // SEND_BATCH_SIZE erreicht, Antworten senden und fortfahren
+#define BATCH_QUIT 2 // QUIT verarbeitet, die restliche Eingabe wird verworfen
+#define BATCH_DEDICATED 3 // Befehl muss in einem eigenen Prozess ausgeführt werden
+#define BATCH_STREAM 4 // Antwort wird gestreamt, die restliche Eingabe wartet bis sie gesendet ist
+
 extern SOCKET processSocket;
 
 
-void initModuleNetwork (bool httpInterface);
+// Verbindung in der Event-Loop eines Workers, die Puffer existieren nur
+// solange sie Daten enthalten (ruhende Verbindungen belegen nur diese Struktur)
+typedef struct {
+    SOCKET socket;
+    RingBuffer *input; // Unvollständige Zeile
+    String *output; // Noch nicht gesendete Antworten
+    size_t outputOffset;
+    ResponseStream *stream; // Antwort, die noch abschnittsweise gesendet wird
+    unsigned int events; // Bei epoll angemeldete Ereignisse
+    bool closing; // Nach dem Senden der Antworten schließen (QUIT)
+} Connection;
+
+
+void initModuleNetwork (bool httpInterface, bool binaryInterface, bool eventLoop);
 void freeModuleNetwork ();
 
 void eventCommandQuit (Command *cmd);
 
-void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET socket));
+void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET socket), int workers);
+void runCommandEventLoop (const char* name, SOCKET serverSocket);
 void clientHandlerCommand (SOCKET socket);
 void clientHandlerHttp (SOCKET socket);
+void clientHandlerBinary (SOCKET socket);
 
 size_t receiveMessage (SOCKET socket, String* message);
+ssize_t receiveIntoRingBuffer (SOCKET socket, RingBuffer *input);
 
 
 #endif //SERVER_NETWORK_H
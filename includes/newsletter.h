@@ -12,6 +12,8 @@
 
 
 #define NEWSLETTER_MAX_SUBS sizeof(RecordSubscriberMask) * 8
+#define NEWSLETTER_KEY_SIZE 64 // Längere Schlüssel/Werte werden gekürzt
+#define NEWSLETTER_VALUE_SIZE 256
 
 #define NL_NOTIFICATION_SUB 0
 #define NL_NOTIFICATION_UNSUB 1
@@ -20,10 +22,15 @@
 
 typedef long RecordSubscriberMask;
 
+typedef struct {
+    RecordSubscriberMask subscriberRegistry;
+    int chunkSegmentIds[STORAGE_MAX_CHUNKS]; // Segment-Id + 1, 0 = kein Chunk
+} NewsletterHeader;
+
 typedef struct {
     int notification;
-    char key[STORAGE_KEY_SIZE];
-    char value[STORAGE_VALUE_SIZE];
+    char key[NEWSLETTER_KEY_SIZE];
+    char value[NEWSLETTER_VALUE_SIZE];
 } Newsletter;
 
 typedef struct {
@@ -41,6 +48,7 @@ void notifyAllObservers (int notificationId, int recordIndex, const char* key, c
 
 int subscribeStorageRecord (const char* key);
 bool startStorageObserver ();
+void stopStorageObserver ();
 void sigChldNoSubscriptions ();
 
 void runStorageObserver ();
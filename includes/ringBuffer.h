@@ -0,0 +1,40 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include "dynString.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/uio.h>
+
+
+#define RING_LINE_NONE 0
+#define RING_LINE_COMPLETE 1
+#define RING_LINE_EXCEEDED -1
+
+
+typedef struct {
+    char *data;
+    size_t capacity; // Zweierpotenz
+    size_t readPos; // Positionen laufen nur vorwärts, der Index ist pos & (capacity-1)
+    size_t writePos;
+    size_t scanPos; // Bis hierhin enthält der Puffer keinen Zeilenumbruch
+    size_t maxLineLength;
+    bool discarding; // Der Rest einer zu langen Zeile wird verworfen
+} RingBuffer;
+
+
+RingBuffer* ringBufferCreate (size_t capacity, size_t maxLineLength);
+void ringBufferFree (RingBuffer *ring);
+void ringBufferClear (RingBuffer *ring);
+
+size_t ringBufferLength (const RingBuffer *ring);
+bool ringBufferIsEmpty (const RingBuffer *ring);
+
+int ringBufferGetFreeSegments (RingBuffer *ring, struct iovec segments[2]);
+void ringBufferCommitWrite (RingBuffer *ring, size_t length);
+int ringBufferReadLine (RingBuffer *ring, String *line);
+
+
+#endif //RINGBUFFER_H
@@ -0,0 +1,59 @@
+#ifndef SERVER_SLAB_H
+#define SERVER_SLAB_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <sys/shm.h>
+
+
+#define SLAB_CHUNK_SIZE (4 * 1024 * 1024) // Bytes pro Chunk
+#define SLAB_MAX_CHUNKS 2048
+#define SLAB_ALIGNMENT 8
+#define SLAB_MAX_BLOCK_SIZE (1024 * 1024)
+// 16 Klassen im 8-Byte Raster bis 128 Bytes, danach 4 Klassen pro Verdopplung
+#define SLAB_CLASSES (16 + 4 * 13)
+
+#define SLAB_NULL 0
+
+
+// Offset-basierte Referenz auf einen Block (in SLAB_ALIGNMENT Einheiten + 1),
+// unabhängig davon wo ein Prozess die Chunks eingehängt hat
+typedef unsigned int SlabRef;
+
+
+typedef struct {
+    int chunkCount;
+    unsigned int chunkOffset; // Belegte Bytes im letzten Chunk
+    int chunkSegmentIds[SLAB_MAX_CHUNKS];
+    SlabRef freeLists[SLAB_CLASSES];
+    long allocatedBytes; // Summe der Blockgrößen aller vergebenen Blöcke
+} SlabHeader;
+
+
+// Private Kopie aller Chunks (siehe copySlabChunks() und copySlabBlock())
+typedef struct {
+    int chunkCount;
+    char *chunks[SLAB_MAX_CHUNKS];
+} SlabCopy;
+
+
+void initModuleSlab ();
+void freeModuleSlab ();
+
+SlabRef allocateSlabBlock (unsigned int size);
+void freeSlabBlock (SlabRef ref, unsigned int size);
+void* getSlabBlockAddress (SlabRef ref);
+void* getSlabBlockAddressChecked (SlabRef ref, unsigned int size);
+
+bool copySlabChunks (SlabCopy *copy);
+bool copySlabBlock (SlabCopy *copy, SlabRef ref, unsigned int size);
+void* getSlabCopyAddress (const SlabCopy *copy, SlabRef ref);
+void freeSlabCopy (SlabCopy *copy);
+
+unsigned int getSlabBlockSize (unsigned int size);
+long getSlabAllocatedBytes ();
+long getSlabReservedBytes ();
+
+
+#endif //SERVER_SLAB_H
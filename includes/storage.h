@@ -4,47 +4,212 @@
 
 #define FILE_BUFFER_SIZE PAGE_SIZE
 
-#define STORAGE_KEY_SIZE 64
-#define STORAGE_VALUE_SIZE 256
-#define STORAGE_ENTRY_SIZE 1024
+#define STORAGE_CHUNK_SIZE 16384 // Einträge pro Chunk (Zweierpotenz!)
+#define STORAGE_MAX_CHUNKS 1024
+#define STORAGE_ENTRY_SIZE (STORAGE_CHUNK_SIZE * STORAGE_MAX_CHUNKS)
+#define STORAGE_INITIAL_INDEX_SIZE 512 // Positionen pro Index-Partition (Zweierpotenz!)
+
+#define STORAGE_SCAN_CHUNK_SIZE 4096 // Einträge pro Lock beim abschnittsweisen Durchsuchen (Stream, SCAN)
+#define STORAGE_SCAN_MAX_ENTRIES (16 * STORAGE_SCAN_CHUNK_SIZE) // Durchsuchte Einträge pro SCAN
+#define STORAGE_SCAN_DEFAULT_COUNT 100
+#define STORAGE_SCAN_MAX_COUNT 1000
+
+#define STORAGE_OPTIMISTIC_RETRIES 4 // Leseversuche ohne Lock, bevor das Stripe-Lock benutzt wird
+
+#define STORAGE_INDEX_EMPTY -1
+#define STORAGE_INDEX_DELETED -2
+#define PREFIX_INDEX_EMPTY 0xFFFFFFFEu // Gerade, wird nie als Eintrag benutzt
 
 #define STORAGE_FILE "../data.csv"
+#define STORAGE_TEMP_FILE "../data.csv.tmp" // Wird erst vollständig geschrieben umbenannt
+#define STORAGE_SNAPSHOT_FILE "../storage.bin"
+#define STORAGE_SNAPSHOT_TEMP_FILE "../storage.bin.tmp"
+#define STORAGE_DIRECTORY ".." // Wird nach dem Umbenennen synchronisiert
+#define STORAGE_SNAPSHOT_MAGIC "KVSNAPSH" // 8 Zeichen ohne '\0'
+#define STORAGE_SNAPSHOT_VERSION 1 // Erhöhen, wenn sich das Format oder hashStorageKey() ändert
+#define STORAGE_SNAPSHOT_BUFFER_SIZE (1 << 20) // Schreibpuffer für Snapshots
+#define STORAGE_DELTA_FILE "../storage.delta"
+#define STORAGE_DELTA_MAGIC "KVSDELTA" // 8 Zeichen ohne '\0'
+#define STORAGE_DELTA_MAX_PERCENT 50 // Ab dieser Größe aller Deltas (in % des Snapshots) neuer Snapshot
+
+#define STORAGE_FORMAT_CSV 0 // Datei-Format der Snapshots
+#define STORAGE_FORMAT_BINARY 1
 
 
 #include "utils.h"
 #include "command.h"
 #include "lock.h"
 #include "newsletter.h"
+#include "slab.h"
+#include "journal.h"
 
 #include <stdio.h>
+#include <fcntl.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
+// Innerer Knoten des Präfix-Index (Crit-Bit-Baum pro Partition). Ein Baum mit
+// n Blättern hat n-1 innere Knoten, jeder Eintrag trägt Platz für einen davon
+// mit, der Index braucht deshalb keine eigenen Allokationen.
 typedef struct {
-    char key[STORAGE_KEY_SIZE];
-    char value[STORAGE_VALUE_SIZE];
+    unsigned int child[2]; // Eintrag << 1 (Blatt) bzw. Eintrag << 1 | 1 (Knoten in dessen Platz)
+    unsigned int count; // Blätter im Teilbaum
+    unsigned int byte; // Position des kritischen Bytes
+    unsigned char otherbits; // Alle Bits außer dem kritischen gesetzt
+    bool used; // Der Platz enthält einen Knoten
+} PrefixNode;
+
+
+typedef struct {
+    unsigned int sequence; // Seqlock, ungerade solange ein Schreiber den Eintrag ändert
+    unsigned int hash; // Hash des Schlüssels für Index und Vergleiche
+    SlabRef data; // "key\0value\0" im Slab, SLAB_NULL = freier Platz
+    unsigned int keyLength;
+    unsigned int valueLength;
+    PrefixNode prefixNode; // Nur unter dem Lock des Stripes
 } Record;
 
 
+typedef struct {
+    Record records[STORAGE_CHUNK_SIZE];
+    int freeSlots[STORAGE_CHUNK_SIZE]; // Free-Slot-Stack (über alle Chunks)
+    int freeSlotPos[STORAGE_CHUNK_SIZE]; // Position eines freien Platzes im Stack
+    unsigned long dirtyRecords[STORAGE_CHUNK_SIZE / 64]; // Ein Bit pro seit dem letzten Snapshot geänderten Eintrag
+} StorageChunk;
+
+
+// Position im Hash-Index. Der Hash dient als Fingerabdruck, Positionen mit
+// anderem Hash werden beim Sondieren verworfen, ohne den Eintrag zu lesen.
+// Beide Felder werden zusammen (8 Byte) atomar geschrieben.
+typedef struct {
+    int record; // Index des Eintrags, STORAGE_INDEX_EMPTY oder STORAGE_INDEX_DELETED
+    unsigned int hash;
+} StorageIndexEntry;
+
+
+// Der Hash-Index ist in eine Partition pro Lock-Stripe aufgeteilt
+typedef struct {
+    int segmentId;
+    int size;
+    int usage; // Belegte Positionen inkl. Grabsteine
+    int count; // Einträge
+    unsigned int prefixRoot; // Wurzel des Präfix-Index (PREFIX_INDEX_EMPTY = leer)
+} StorageIndexPartition;
+
+
+// Kopf einer binären Snapshot-Datei, danach "dataSize" Bytes gepackter Einträge
+typedef struct {
+    char magic[8]; // STORAGE_SNAPSHOT_MAGIC
+    unsigned int version;
+    unsigned int recordCount;
+    unsigned long long dataSize;
+    unsigned long long checksum; // Über die gepackten Einträge
+} StorageSnapshotHeader;
+
+
+// Gepackter Eintrag im Snapshot, danach "key\0value\0" (wie im Slab-Block)
+// und Füllbytes bis zur nächsten 4-Byte-Grenze
+typedef struct {
+    unsigned int hash;
+    unsigned int keyLength;
+    unsigned int valueLength;
+} StorageSnapshotRecord;
+
+
+// Abschnitt der Delta-Datei (ein inkrementeller Snapshot), danach
+// "deleteCount" gelöschte Schlüssel (Wert leer) und "recordCount" geänderte
+// Einträge, gepackt wie im Snapshot. Abschnitte gelten nur für den Snapshot
+// mit derselben Prüfsumme und Größe.
+typedef struct {
+    char magic[8]; // STORAGE_DELTA_MAGIC
+    unsigned int deleteCount;
+    unsigned int recordCount;
+    unsigned long long dataSize;
+    unsigned long long checksum; // Über die gepackten Einträge
+    unsigned long long baseDataSize;
+    unsigned long long baseChecksum;
+} StorageDeltaHeader;
+
+
+// Private Kopie der Einträge und des Slabs, wird ohne Lock gespeichert
+typedef struct {
+    Record *records;
+    int endIndex;
+    int capacity;
+    SlabCopy slab;
+    int *changed; // Bei der letzten inkrementellen Kopie geänderte Einträge
+    int changedCount;
+    int changedCapacity;
+    char *deleted; // Dabei gelöschte oder ersetzte Schlüssel, gepackt wie im Snapshot
+    size_t deletedSize;
+    size_t deletedCapacity;
+    unsigned int deleteCount;
+} StorageCopy;
+
+
+// Gepufferter Schreiber für Snapshot-, Delta- und CSV-Dateien, führt Größe
+// und Prüfsumme der geschriebenen Daten mit
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    unsigned long long dataSize;
+    unsigned long long checksum;
+    bool checksummed; // false für CSV
+    bool failed;
+} StorageSnapshotWriter;
+
+
+typedef struct {
+    int endIndex;
+    int freeCount;
+    int chunkCount;
+    int chunkSegmentIds[STORAGE_MAX_CHUNKS];
+    StorageIndexPartition indexPartitions[LOCK_STRIPES];
+} StorageHeader;
+
+
 void eventCommandGet (Command *cmd);
 void eventCommandPut (Command *cmd);
 void eventCommandDel (Command *cmd);
 void eventCommandCount (Command *cmd);
+void eventCommandMultiGet (Command *cmd);
+void eventCommandMultiPut (Command *cmd);
+void eventCommandMultiDel (Command *cmd);
+void eventCommandScan (Command *cmd);
 
-void initModuleStorage (int snapshotInterval);
+void initModuleStorage (int snapshotInterval, int format);
 void freeModuleStorage ();
 
 int findStorageRecord (const char* key);
+bool rebuildStorageIndex (int partition, int indexSize);
+bool growStorage ();
 
 bool getStorageRecord (const char* key, String* value);
 int putStorageRecord (const char* key, const char* value);
 bool deleteStorageRecord (const char* key);
 
+void getStorageRecordBatch (const Array* keys, Array* result);
+void putStorageRecordBatch (const Array* keys, const Array* values, Array* result);
+void deleteStorageRecordBatch (const Array* keys, Array* result);
+
 void getMultipleStorageRecords (const char* wildcardKey, Array* result);
+long countMultipleStorageRecords (const char* wildcardKey);
+bool streamMultipleStorageRecords (ResponseStream* stream, String* output, size_t limit);
+int scanStorageRecords (int cursor, const char* wildcardKey, int count, Array* result);
 void deleteMultipleStorageRecords (const char* wildcardKey, Array* result);
 
 bool loadStorageFromFile ();
-bool saveStorageToFile ();
+bool saveStorageToFile (const StorageCopy *copy);
+bool loadStorageFromSnapshot ();
+long loadStorageFromJournal ();
+bool saveStorageToSnapshot (const StorageCopy *copy);
+long loadStorageFromDelta ();
+bool saveStorageToDelta (const StorageCopy *copy);
+bool saveStorage ();
 
 void runSnapshotTimer (int interval);
 
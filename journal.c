@@ -0,0 +1,524 @@
+#include "journal.h"
+
+
+/*
+ * Journal (Write-Ahead-Log) zwischen zwei Snapshots
+ *
+ * Jede Änderung am Storage wird als Datensatz an die Datei "JOURNAL_FILE"
+ * angehängt, solange der Schreiber noch das Lock seines Stripes hält. Die
+ * Reihenfolge im Journal entspricht so für jeden Schlüssel der Reihenfolge
+ * der Änderungen. Die Datensätze eines Befehls werden pro Prozess gepuffert
+ * und mit einem write() (O_APPEND) angehängt. Wann fdatasync() aufgerufen
+ * wird bestimmt die Sync-Strategie; es synchronisiert immer ein Prozess für
+ * alle bis dahin geschriebenen Bytes (Group-Commit). Beim Start wird das
+ * Journal nach dem Snapshot wiederholt. Der Snapshot-Timer rotiert es beim
+ * Kopieren des Storage und löscht das rotierte Journal, sobald der Snapshot
+ * auf der Platte ist; jeder Prozess öffnet das neue Journal bei seinem
+ * nächsten write() (Generation im Shared Memory).
+ *
+ */
+
+
+static JournalPolicy journalPolicy; // Bis initModuleJournal JOURNAL_SYNC_OFF
+
+static int shmJournalSegmentId = 0;
+static JournalHeader *journalHeader = NULL;
+static int journalFd = -1;
+
+// Pro Prozess: Datensätze des laufenden Befehls und Ende des eigenen letzten write()
+static char *journalBuffer = NULL;
+static size_t journalBufferUsed = 0;
+static size_t journalBufferCapacity = 0;
+static unsigned long long journalWrittenEnd = 0;
+static bool journalCommitPending = false;
+static unsigned int journalGeneration = 0; // Generation des geöffneten Journals
+
+
+void initModuleJournal (JournalPolicy policy)
+{
+    journalPolicy = policy;
+
+    // Neue Segmente sind immer mit Nullen initialisiert
+    shmJournalSegmentId = shmget(IPC_PRIVATE, sizeof(JournalHeader), IPC_CREAT | SHM_R | SHM_W);
+    if (shmJournalSegmentId == -1) {
+        fatalError("initModuleJournal shmget");
+    }
+    journalHeader = shmat(shmJournalSegmentId, NULL, 0);
+
+    printf("Journal shared memory segment created (Id %d).\n", shmJournalSegmentId);
+}
+
+
+void freeModuleJournal ()
+{
+    if (journalHeader == NULL) return; // Modul nicht initialisiert
+
+    if (journalFd != -1) {
+        close(journalFd);
+        printf("Journal closed (%lu syncs).\n", journalHeader->syncCount);
+    }
+    free(journalBuffer);
+
+    shmdt(journalHeader);
+    shmctl(shmJournalSegmentId, IPC_RMID, NULL);
+
+    printf("Journal shared memory segment deleted (Id %d).\n", shmJournalSegmentId);
+}
+
+
+/**
+ * Liest eine Sync-Strategie: "off", "none", "always", eine Zeit in
+ * Millisekunden ("100ms") oder eine Menge nicht synchronisierter Daten in
+ * Kilobyte ("64kb"). Bei unbekannten Namen false.
+ *
+ * @param name - Name der Strategie
+ * @param policy - Zielobjekt
+ */
+bool parseJournalPolicy (const char *name, JournalPolicy *policy)
+{
+    memset(policy, 0, sizeof(JournalPolicy));
+
+    if (strcmp(name, "off") == 0) {
+        policy->mode = JOURNAL_SYNC_OFF;
+        return true;
+    }
+    if (strcmp(name, "none") == 0) {
+        policy->mode = JOURNAL_SYNC_NONE;
+        return true;
+    }
+    if (strcmp(name, "always") == 0) {
+        policy->mode = JOURNAL_SYNC_ALWAYS;
+        return true;
+    }
+
+    char *unit;
+    long amount = strtol(name, &unit, 10);
+    if (amount <= 0 || unit == name) {
+        return false;
+    }
+    if (strcmp(unit, "ms") == 0) {
+        policy->mode = JOURNAL_SYNC_INTERVAL;
+        policy->interval = (int)amount;
+        return true;
+    }
+    if (strcmp(unit, "kb") == 0) {
+        policy->mode = JOURNAL_SYNC_BYTES;
+        policy->bytes = (unsigned long)amount * 1024;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Prüfsumme eines Datensatzes (FNV-1a über Typ, Längen und Daten).
+ *
+ * @param record - Kopf des Datensatzes
+ * @param data - "key\0value\0"
+ */
+static unsigned int checksumJournalRecord (const JournalRecord *record, const char *data)
+{
+    unsigned int checksum = 2166136261u;
+    const unsigned char *bytes = (const unsigned char*)&record->type;
+    size_t headerLength = sizeof(JournalRecord) - offsetof(JournalRecord, type);
+
+    for (size_t i = 0; i < headerLength; i++) {
+        checksum = (checksum ^ bytes[i]) * 16777619u;
+    }
+    size_t dataLength = (size_t)record->keyLength + record->valueLength + 2;
+    for (size_t i = 0; i < dataLength; i++) {
+        checksum = (checksum ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return checksum;
+}
+
+
+static inline size_t getJournalRecordSize (size_t keyLength, size_t valueLength)
+{
+    return sizeof(JournalRecord) + ((keyLength + valueLength + 2 + 3) & ~(size_t)3);
+}
+
+
+/**
+ * Wendet alle Datensätze einer Journal-Datei der Reihe nach mit "apply" an.
+ * Endet sie mit einem unvollständigen oder beschädigten Datensatz (Absturz
+ * während des Schreibens), wird sie dort abgeschnitten, damit neue
+ * Datensätze wieder lesbar angehängt werden. Gibt die Anzahl der Datensätze
+ * zurück, -1 wenn die Datei nicht existiert.
+ *
+ * @param path - Journal-Datei
+ * @param apply - Wendet einen Datensatz auf das Storage an
+ */
+static long replayJournalFile (const char *path, void (*apply)(int type, const char *key, size_t keyLength,
+                                                                const char *value, size_t valueLength))
+{
+    int fd = open(path, O_RDWR);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *file = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (file == MAP_FAILED) {
+        perror("replayJournalFile mmap");
+        close(fd);
+        return -1;
+    }
+
+    size_t size = info.st_size;
+    size_t offset = 0;
+    long count = 0;
+
+    while (size - offset >= sizeof(JournalRecord)) {
+        const JournalRecord *record = (const JournalRecord*)&file[offset];
+        if (record->type != JOURNAL_PUT && record->type != JOURNAL_DEL) break;
+
+        size_t recordSize = getJournalRecordSize(record->keyLength, record->valueLength);
+        if (size - offset < recordSize) break;
+
+        const char *key = (const char*)&record[1];
+        const char *value = key + record->keyLength + 1;
+        if (key[record->keyLength] != '\0' || value[record->valueLength] != '\0' ||
+                checksumJournalRecord(record, key) != record->checksum) break;
+
+        apply(record->type, key, record->keyLength, value, record->valueLength);
+        offset += recordSize;
+        count++;
+    }
+
+    if (offset < size) {
+        fprintf(stderr, "replayJournalFile: %s truncated after %ld records (%zu of %zu bytes valid)\n",
+                path, count, offset, size);
+        if (ftruncate(fd, (off_t)offset) == -1) {
+            perror("replayJournalFile ftruncate");
+        }
+    }
+
+    munmap((void*)file, size);
+    close(fd);
+    return count;
+}
+
+
+/**
+ * Wiederholt ein rotiertes Journal (der Snapshot dazu wurde nicht fertig)
+ * und danach das aktuelle. Gibt die Anzahl der Datensätze zurück, -1 wenn
+ * kein Journal existiert.
+ * Nur beim Start vor "openJournal" aufrufen.
+ *
+ * @param apply - Wendet einen Datensatz auf das Storage an
+ */
+long replayJournal (void (*apply)(int type, const char *key, size_t keyLength,
+                                  const char *value, size_t valueLength))
+{
+    long rotated = replayJournalFile(JOURNAL_ROTATED_FILE, apply);
+    long current = replayJournalFile(JOURNAL_FILE, apply);
+
+    if (rotated == -1 && current == -1) {
+        return -1;
+    }
+    return ((rotated > 0) ? rotated : 0) + ((current > 0) ? current : 0);
+}
+
+
+/**
+ * Öffnet das Journal zum Anhängen und startet bei JOURNAL_SYNC_INTERVAL den
+ * Journal-Prozess. Davor (beim Laden und Wiederholen) wird nichts
+ * protokolliert. Der Inhalt eines vorhandenen Journals gilt als
+ * synchronisiert.
+ *
+ */
+void openJournal ()
+{
+    if (journalPolicy.mode == JOURNAL_SYNC_OFF) return;
+
+    journalFd = open(JOURNAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journalFd == -1) {
+        fatalError("openJournal open");
+    }
+    journalHeader->appendedBytes = 0;
+    journalHeader->syncedBytes = 0;
+    journalGeneration = journalHeader->generation;
+
+    if (journalPolicy.mode == JOURNAL_SYNC_INTERVAL && fork() == 0) {
+        prctl(PR_SET_NAME, (unsigned long)"kvsvr(journal)");
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        runJournalTimer(journalPolicy.interval);
+
+        exit(EXIT_SUCCESS);
+    }
+}
+
+
+/**
+ * Öffnet das Journal neu, wenn es seit dem letzten Öffnen in diesem Prozess
+ * rotiert wurde. Schlägt das Öffnen fehl, bleibt das alte offen.
+ *
+ */
+static void reopenJournal ()
+{
+    unsigned int generation = __atomic_load_n(&journalHeader->generation, __ATOMIC_SEQ_CST);
+    if (generation == journalGeneration) return;
+
+    int fd = open(JOURNAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        perror("reopenJournal open");
+        return;
+    }
+    close(journalFd);
+    journalFd = fd;
+    journalGeneration = generation;
+}
+
+
+/**
+ * Benennt das Journal in "JOURNAL_ROTATED_FILE" um, bevor der Snapshot-Timer
+ * das Storage kopiert; alle folgenden Änderungen landen in einem neuen
+ * Journal. Existiert noch ein rotiertes Journal (der letzte Snapshot ist
+ * fehlgeschlagen), wird nicht rotiert: das Journal enthält dann zwar auch
+ * ältere Änderungen, diese noch einmal zu wiederholen ändert aber nichts.
+ * NUR IN EINEM KRITISCHEN ABSCHNITT ÜBER ALLE STRIPES AUFRUFEN!!!
+ *
+ */
+void rotateJournal ()
+{
+    if (journalFd == -1 || access(JOURNAL_ROTATED_FILE, F_OK) == 0) {
+        return;
+    }
+    if (rename(JOURNAL_FILE, JOURNAL_ROTATED_FILE) == -1) {
+        if (errno != ENOENT) perror("rotateJournal rename"); // Noch nichts geschrieben
+        return;
+    }
+
+    enterJournalSection();
+    __atomic_store_n(&journalHeader->appendedBytes, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&journalHeader->syncedBytes, 0, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&journalHeader->generation, 1, __ATOMIC_SEQ_CST);
+    leaveJournalSection();
+}
+
+
+/**
+ * Löscht das rotierte Journal, nachdem der Snapshot mit allen seinen
+ * Änderungen auf der Platte ist. Ohne offenes Journal wird auch ein altes
+ * aktuelles Journal gelöscht (siehe resetJournal()).
+ *
+ */
+void discardRotatedJournal ()
+{
+    unlink(JOURNAL_ROTATED_FILE);
+    if (journalFd == -1) {
+        unlink(JOURNAL_FILE);
+    }
+}
+
+
+/**
+ * Leert das Journal, nachdem beim Beenden ein Snapshot vollständig
+ * gespeichert wurde, und löscht ein rotiertes. Ohne offenes Journal wird
+ * auch das aktuelle gelöscht, damit es beim nächsten Start nicht über den
+ * neueren Snapshot wiederholt wird. Arbeitet über den Pfad, weil das Journal
+ * dieses Prozesses schon rotiert sein kann.
+ * NUR IN EINEM KRITISCHEN ABSCHNITT ÜBER ALLE STRIPES AUFRUFEN!!!
+ *
+ */
+void resetJournal ()
+{
+    if (journalHeader == NULL) return; // Modul nicht initialisiert
+
+    enterJournalSection();
+
+    if (journalFd != -1) {
+        if (truncate(JOURNAL_FILE, 0) == -1 && errno != ENOENT) {
+            perror("resetJournal truncate");
+        }
+    }
+    else {
+        unlink(JOURNAL_FILE);
+    }
+    unlink(JOURNAL_ROTATED_FILE);
+    __atomic_store_n(&journalHeader->appendedBytes, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&journalHeader->syncedBytes, 0, __ATOMIC_SEQ_CST);
+
+    leaveJournalSection();
+}
+
+
+/**
+ * Hängt einen Datensatz an den Puffer des Prozesses an. Ist der Puffer voll,
+ * wird er vorher geschrieben.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param type - JOURNAL_PUT oder JOURNAL_DEL
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ * @param value - Wert ("" bei JOURNAL_DEL)
+ * @param valueLength - Länge des Werts
+ */
+static void appendJournalRecord (int type, const char *key, size_t keyLength,
+                                 const char *value, size_t valueLength)
+{
+    size_t size = getJournalRecordSize(keyLength, valueLength);
+    if (journalBufferUsed + size > journalBufferCapacity) {
+        writeJournal();
+
+        if (size > journalBufferCapacity) {
+            journalBufferCapacity = (size > JOURNAL_BUFFER_SIZE) ? size : JOURNAL_BUFFER_SIZE;
+            journalBuffer = realloc(journalBuffer, journalBufferCapacity);
+            if (journalBuffer == NULL) {
+                fatalError("appendJournalRecord realloc");
+            }
+        }
+    }
+
+    JournalRecord *record = (JournalRecord*)&journalBuffer[journalBufferUsed];
+    record->type = type;
+    record->keyLength = keyLength;
+    record->valueLength = valueLength;
+
+    char *data = (char*)&record[1];
+    memcpy(data, key, keyLength);
+    data[keyLength] = '\0';
+    memcpy(&data[keyLength + 1], value, valueLength);
+    memset(&data[keyLength + 1 + valueLength], 0, size - sizeof(JournalRecord) - keyLength - 1 - valueLength);
+    record->checksum = checksumJournalRecord(record, data);
+
+    journalBufferUsed += size;
+}
+
+
+/**
+ * Protokolliert das Anlegen oder Überschreiben eines Eintrags.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ * @param value - Neuer Wert
+ * @param valueLength - Länge des Werts
+ */
+void logJournalPut (const char *key, size_t keyLength, const char *value, size_t valueLength)
+{
+    if (journalFd == -1) return;
+    appendJournalRecord(JOURNAL_PUT, key, keyLength, value, valueLength);
+}
+
+
+/**
+ * Protokolliert das Löschen eines Eintrags.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ */
+void logJournalDelete (const char *key, size_t keyLength)
+{
+    if (journalFd == -1) return;
+    appendJournalRecord(JOURNAL_DEL, key, keyLength, "", 0);
+}
+
+
+/**
+ * Hängt die gepufferten Datensätze mit einem write() an das Journal an. Muss
+ * vor dem Verlassen des kritischen Abschnitts der Änderungen aufgerufen
+ * werden, sonst stimmt die Reihenfolge im Journal nicht mehr.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ */
+void writeJournal ()
+{
+    if (journalBufferUsed == 0) return;
+    reopenJournal();
+
+    ssize_t written = write(journalFd, journalBuffer, journalBufferUsed);
+    if (written == (ssize_t)journalBufferUsed) {
+        // Erst nach dem write() zählen: jeder Stand von "appendedBytes" deckt
+        // nur vollständig geschriebene Datensätze ab
+        journalWrittenEnd = __atomic_add_fetch(&journalHeader->appendedBytes, journalBufferUsed,
+                                               __ATOMIC_SEQ_CST);
+        journalCommitPending = true;
+    }
+    else {
+        perror("writeJournal write");
+    }
+    journalBufferUsed = 0;
+}
+
+
+/**
+ * Synchronisiert das Journal mindestens bis "end". Wer auf das Lock wartet,
+ * findet seine Daten danach meist schon durch den Vorgänger synchronisiert
+ * (Group-Commit); sonst synchronisiert er alle bis dahin geschriebenen Bytes.
+ *
+ * @param end - Benötigter Stand von "appendedBytes"
+ */
+static void syncJournal (unsigned long long end)
+{
+    enterJournalSection();
+
+    if (journalGeneration != __atomic_load_n(&journalHeader->generation, __ATOMIC_SEQ_CST)) {
+        // Inzwischen rotiert, die Daten stehen im rotierten Journal
+        if (fdatasync(journalFd) == -1) {
+            perror("syncJournal fdatasync");
+        }
+    }
+    else if (__atomic_load_n(&journalHeader->syncedBytes, __ATOMIC_SEQ_CST) < end) {
+        unsigned long long target = __atomic_load_n(&journalHeader->appendedBytes, __ATOMIC_SEQ_CST);
+        if (fdatasync(journalFd) == -1) {
+            perror("syncJournal fdatasync");
+        }
+        else {
+            __atomic_store_n(&journalHeader->syncedBytes, target, __ATOMIC_SEQ_CST);
+            journalHeader->syncCount++;
+        }
+    }
+
+    leaveJournalSection();
+}
+
+
+/**
+ * Macht die Änderungen des letzten Befehls nach der Sync-Strategie dauerhaft.
+ * Bei JOURNAL_SYNC_ALWAYS kehrt es erst zurück, wenn sie auf der Platte sind.
+ * Nach dem Verlassen des kritischen Abschnitts aufrufen, damit andere
+ * Schreiber nicht auf fdatasync() warten.
+ *
+ */
+void commitJournal ()
+{
+    if (!journalCommitPending) return;
+    journalCommitPending = false;
+
+    if (journalPolicy.mode == JOURNAL_SYNC_ALWAYS) {
+        syncJournal(journalWrittenEnd);
+    }
+    else if (journalPolicy.mode == JOURNAL_SYNC_BYTES) {
+        unsigned long long appended = __atomic_load_n(&journalHeader->appendedBytes, __ATOMIC_SEQ_CST);
+        if (appended - __atomic_load_n(&journalHeader->syncedBytes, __ATOMIC_SEQ_CST) >= journalPolicy.bytes) {
+            syncJournal(appended);
+        }
+    }
+}
+
+
+/**
+ * Synchronisiert alle "interval" Millisekunden, was seit dem letzten Mal
+ * geschrieben wurde (JOURNAL_SYNC_INTERVAL).
+ *
+ * @param interval - Millisekunden
+ */
+void runJournalTimer (int interval)
+{
+    for (;;) {
+        usleep(interval * 1000);
+        reopenJournal();
+
+        unsigned long long appended = __atomic_load_n(&journalHeader->appendedBytes, __ATOMIC_SEQ_CST);
+        if (appended > __atomic_load_n(&journalHeader->syncedBytes, __ATOMIC_SEQ_CST)) {
+            syncJournal(appended);
+        }
+    }
+}
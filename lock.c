@@ -4,61 +4,114 @@
 /*
  * Synchronisations-Mechanismus
  *
- * Stellt mithilfe von Semaphoren einen Mechanismus für die Erhaltung der
- * Datenkonsistenz bei gleichzeitigem Zugriff und einen exklusiven Modus
- * für das Storage bereit.
+ * Stellt mithilfe eines Futex-basierten Leser/Schreiber-Locks im Shared Memory
+ * einen Mechanismus für die Erhaltung der Datenkonsistenz bei gleichzeitigem
+ * Zugriff und einen exklusiven Modus für das Storage bereit. Ohne Konkurrenz
+ * kommt das Lock ganz ohne Systemaufrufe aus (atomare Operationen), nur
+ * wartende Prozesse schlafen per FUTEX_WAIT.
  *
  */
 
 
-// SEM_UNDO macht Operationen eines Prozesses rückgängig, wenn er sich beendet.
-// D.h. in diesem Fall, dass ein Client den Storage automatisch wieder freigibt,
-// wenn er sich im exklusiven Modus beendet.
-static int storageSemaphoreId = 0;
-static struct sembuf enterStorage = {.sem_num=0, .sem_op=-1, .sem_flg=SEM_UNDO};
-static struct sembuf leaveStorage = {.sem_num=0, .sem_op=1, .sem_flg=SEM_UNDO};
-static struct sembuf enterReaderCounter = {.sem_num=1, .sem_op=-1, .sem_flg=SEM_UNDO};
-static struct sembuf leaveReaderCounter = {.sem_num=1, .sem_op=1, .sem_flg=SEM_UNDO};
-
-static int shmReaderCounterId = 0;
-static int* readerCounter = NULL;
+static int shmLockSegmentId = 0;
+static LockHeader *lockHeader = NULL;
 
+static int lockPolicy = LOCK_POLICY_READER;
 static bool exclusiveMode = false;
 
+// Robust-Futex-Liste des Prozesses. Wie SEM_UNDO beim Semaphore gibt der Kernel
+// damit das Schreib-Lock frei, wenn sich ein Prozess beendet während er es hält
+// (z.B. ein Client im exklusiven Modus). Ersetzt die Liste der glibc, die nur
+// für robuste pthread-Mutexe gebraucht wird.
+static struct robust_list_head robustListHead;
+static unsigned int lockOwnerTid = 0;
+
+static const char *lockPolicyNames[] = {"reader", "writer", "fair"};
+
+
+/**
+ * Meldet die Robust-Futex-Liste des aufrufenden Prozesses beim Kernel an.
+ * Der Kernel findet das Futex-Wort eines Eintrags über "futex_offset", der
+ * für alle RwLock-Objekte gleich ist.
+ *
+ */
+static void registerRobustList ()
+{
+    robustListHead.list.next = &robustListHead.list;
+    robustListHead.futex_offset = (long)offsetof(RwLock, writer) -
+                                  (long)offsetof(RwLock, robustEntry);
+    robustListHead.list_op_pending = NULL;
+
+    if (syscall(SYS_set_robust_list, &robustListHead, sizeof(robustListHead)) != 0) {
+        perror("registerRobustList set_robust_list");
+    }
+    lockOwnerTid = (unsigned int)syscall(SYS_gettid);
+}
+
 
-void initModuleLock ()
+void initModuleLock (int policy)
 {
     registerCommandEntry("BEG", 0, false, eventCommandBeginn);
     registerCommandEntry("END", 0, false, eventCommandEnd);
+    registerCommandEntry("STAT", 0, false, eventCommandStat);
 
-    shmReaderCounterId = shmget(IPC_PRIVATE, sizeof(int), IPC_CREAT | SHM_R | SHM_W);
-    if (shmReaderCounterId == -1) {
+    lockPolicy = policy;
+
+    // Neue Segmente sind immer mit Nullen initialisiert
+    shmLockSegmentId = shmget(IPC_PRIVATE, sizeof(LockHeader), IPC_CREAT | SHM_R | SHM_W);
+    if (shmLockSegmentId == -1) {
         fatalError("initModuleLock shmget");
     }
-    readerCounter = shmat(shmReaderCounterId, NULL, 0);
-    *readerCounter = 0;
+    lockHeader = shmat(shmLockSegmentId, NULL, 0);
 
-    unsigned short marker[2] = {1, 1};
-    storageSemaphoreId = semget(IPC_PRIVATE, 2, IPC_CREAT | 0644);
-    if (shmReaderCounterId == -1) {
-        fatalError("initModuleLock semget");
-    }
-    semctl(storageSemaphoreId, 1, SETALL, marker);
+    // Nach fork() hat der Kind-Prozess keine Robust-Futex-Liste mehr
+    registerRobustList();
+    pthread_atfork(NULL, NULL, registerRobustList);
 
-    printf("Synchronization mechanisms created (Semaphore-Id %d, Sh.Mem.-Id %d).\n",
-           storageSemaphoreId, shmReaderCounterId);
+    printf("Synchronization mechanisms created (Sh.Mem.-Id %d, Policy %s).\n",
+           shmLockSegmentId, getLockPolicyName(lockPolicy));
 }
 
 
 void freeModuleLock ()
 {
-    semctl(storageSemaphoreId, 0, IPC_RMID);
+    if (lockHeader == NULL) return; // Modul nicht initialisiert
 
-    shmdt(readerCounter);
-    shmctl(shmReaderCounterId, IPC_RMID, NULL);
+    for (int accessType = READ_ACCESS; accessType <= WRITE_ACCESS; accessType++) {
+        printf("Lock wait %s: %lu calls, p50 %luns, p99 %luns.\n",
+               (accessType == READ_ACCESS) ? "read" : "write",
+               lockHeader->waitStats[accessType].count,
+               getLockWaitPercentile(accessType, 0.50),
+               getLockWaitPercentile(accessType, 0.99));
+    }
+
+    shmdt(lockHeader);
+    shmctl(shmLockSegmentId, IPC_RMID, NULL);
 
-    printf("Synchronization mechanisms deleted (Semaphore-Id %d, Sh.Mem.-Id %d).\n",
-           storageSemaphoreId, shmReaderCounterId);
+    printf("Synchronization mechanisms deleted (Sh.Mem.-Id %d).\n", shmLockSegmentId);
+}
+
+
+/**
+ * Liefert die Sperr-Strategie zu einem Namen ("reader", "writer", "fair"),
+ * bei unbekannten Namen -1.
+ *
+ * @param name - Name der Strategie
+ */
+int parseLockPolicy (const char *name)
+{
+    for (size_t i = 0; i < sizeof(lockPolicyNames) / sizeof(*lockPolicyNames); i++) {
+        if (strcmp(lockPolicyNames[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+
+const char* getLockPolicyName (int policy)
+{
+    return lockPolicyNames[policy];
 }
 
 
@@ -74,64 +127,558 @@ void eventCommandEnd (Command *cmd)
 }
 
 
+void eventCommandStat (Command *cmd)
+{
+    responseRecordsAdd(cmd->responseRecords, "policy", getLockPolicyName(lockPolicy));
+
+    char value[128];
+    for (int accessType = READ_ACCESS; accessType <= WRITE_ACCESS; accessType++) {
+        const LockWaitStats *stats = &lockHeader->waitStats[accessType];
+        snprintf(value, sizeof(value), "calls=%lu avg_ns=%lu p50_ns=%lu p99_ns=%lu",
+                 stats->count, (stats->count > 0) ? stats->totalNanos / stats->count : 0,
+                 getLockWaitPercentile(accessType, 0.50),
+                 getLockWaitPercentile(accessType, 0.99));
+
+        responseRecordsAdd(cmd->responseRecords,
+                           (accessType == READ_ACCESS) ? "lock_wait_read" : "lock_wait_write",
+                           value);
+    }
+
+#ifdef ALLOC_COUNTER
+    // Allokationen dieses Prozesses seit dem letzten STAT (ohne diesen Befehl)
+    static unsigned long lastAllocations = 0;
+    static unsigned long lastReleases = 0;
+    static unsigned long lastCommands = 0;
+    unsigned long allocations = getAllocationCount();
+    unsigned long releases = getReleaseCount();
+    unsigned long commands = getExecutedCommandCount() - 1;
+
+    snprintf(value, sizeof(value), "commands=%lu mallocs=%lu frees=%lu per_command=%.2f",
+             commands - lastCommands, allocations - lastAllocations, releases - lastReleases,
+             (commands > lastCommands) ?
+             (double)(allocations - lastAllocations) / (double)(commands - lastCommands) : 0.0);
+    responseRecordsAdd(cmd->responseRecords, "allocations", value);
+
+    lastAllocations = getAllocationCount();
+    lastReleases = getReleaseCount();
+    lastCommands = commands + 1;
+#endif
+}
+
+
+static unsigned long getNanoseconds ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000000ul + (unsigned long)now.tv_nsec;
+}
+
+
+/**
+ * Ermittelt den Histogramm-Bucket einer Wartezeit. Werte unter 4ns
+ * bekommen je einen Bucket, danach teilt sich jede Zweierpotenz in 4 Buckets.
+ *
+ * @param nanos - Wartezeit in Nanosekunden
+ */
+static int getLockWaitBucket (unsigned long nanos)
+{
+    if (nanos < 4) {
+        return (int)nanos;
+    }
+
+    int power = 63 - __builtin_clzl(nanos);
+    int bucket = 4 * (power - 1) + (int)((nanos >> (power - 2)) & 3);
+
+    return (bucket < LOCK_WAIT_BUCKETS) ? bucket : LOCK_WAIT_BUCKETS - 1;
+}
+
+
+/**
+ * Liefert die obere Grenze eines Histogramm-Buckets in Nanosekunden.
+ *
+ * @param bucket - Histogramm-Bucket
+ */
+static unsigned long getLockWaitBucketLimit (int bucket)
+{
+    if (bucket < 4) {
+        return (unsigned long)bucket;
+    }
+
+    int power = bucket / 4 + 1;
+    return ((4ul + bucket % 4 + 1) << (power - 2)) - 1;
+}
+
+
+/**
+ * Zählt eine Wartezeit im Histogramm der Zugriffs-Art. Mehrere Leser können
+ * gleichzeitig zählen, deshalb sind die Zähler atomar.
+ *
+ * @param accessType - Datenzugriffs-Art
+ * @param start - Zeitpunkt der Anfrage in Nanosekunden
+ */
+static void recordLockWait (int accessType, unsigned long start)
+{
+    unsigned long nanos = getNanoseconds() - start;
+    LockWaitStats *stats = &lockHeader->waitStats[accessType];
+
+    __atomic_fetch_add(&stats->buckets[getLockWaitBucket(nanos)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->totalNanos, nanos, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Liefert ein Perzentil der Wartezeiten einer Zugriffs-Art in Nanosekunden
+ * (obere Grenze des Histogramm-Buckets).
+ *
+ * @param accessType - Datenzugriffs-Art
+ * @param percentile - Perzentil (0.0 bis 1.0)
+ */
+unsigned long getLockWaitPercentile (int accessType, double percentile)
+{
+    const LockWaitStats *stats = &lockHeader->waitStats[accessType];
+    unsigned long count = __atomic_load_n(&stats->count, __ATOMIC_RELAXED);
+    if (count == 0) {
+        return 0;
+    }
+
+    unsigned long rank = (unsigned long)(percentile * (double)count);
+    unsigned long sum = 0;
+    for (int i = 0; i < LOCK_WAIT_BUCKETS; i++) {
+        sum += __atomic_load_n(&stats->buckets[i], __ATOMIC_RELAXED);
+        if (sum > rank) {
+            return getLockWaitBucketLimit(i);
+        }
+    }
+    return getLockWaitBucketLimit(LOCK_WAIT_BUCKETS - 1);
+}
+
+
+static inline void futexWait (unsigned int *address, unsigned int value)
+{
+    syscall(SYS_futex, address, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+
+static inline void futexWake (unsigned int *address, int count)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+
+/**
+ * Drehkreuz für die faire Strategie: Ein Ticket-Lock, d.h. Leser und
+ * Schreiber kommen in der Reihenfolge ihrer Anfragen dran.
+ *
+ * @param lock - Zielobjekt
+ */
+static void enterTurnstile (RwLock *lock)
+{
+    unsigned int ticket = __atomic_fetch_add(&lock->ticketNext, 1, __ATOMIC_SEQ_CST);
+    unsigned int serving;
+    while ((serving = __atomic_load_n(&lock->ticketServing, __ATOMIC_SEQ_CST)) != ticket) {
+        futexWait(&lock->ticketServing, serving);
+    }
+}
+
+
+static void leaveTurnstile (RwLock *lock)
+{
+    unsigned int serving = __atomic_add_fetch(&lock->ticketServing, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lock->ticketNext, __ATOMIC_SEQ_CST) != serving) {
+        futexWake(&lock->ticketServing, INT_MAX);
+    }
+}
+
+
+/**
+ * Setzt das Schreiber-Wort nach dem Absturz eines Schreibers (FUTEX_OWNER_DIED
+ * vom Kernel gesetzt) zurück und weckt alle Wartenden, da der Kernel nur
+ * einen weckt.
+ *
+ * @param lock - Zielobjekt
+ * @param word - Zuletzt gelesener Wert des Schreiber-Worts
+ */
+static void repairWriterWord (RwLock *lock, unsigned int word)
+{
+    if (__atomic_compare_exchange_n(&lock->writer, &word, 0, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) &&
+            (word & FUTEX_WAITERS)) {
+        futexWake(&lock->writer, INT_MAX);
+    }
+}
+
+
+/**
+ * Wartet bis sich das Schreiber-Wort ändert. FUTEX_WAITERS zeigt dem
+ * Schreiber an, dass er beim Freigeben wecken muss.
+ *
+ * @param lock - Zielobjekt
+ */
+static void waitForWriter (RwLock *lock)
+{
+    unsigned int word = __atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST);
+    if (word & FUTEX_OWNER_DIED) {
+        repairWriterWord(lock, word);
+        return;
+    }
+    if (!(word & FUTEX_WAITERS) &&
+            !__atomic_compare_exchange_n(&lock->writer, &word, word | FUTEX_WAITERS, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return; // Wort hat sich geändert, neu prüfen
+    }
+    futexWait(&lock->writer, word | FUTEX_WAITERS);
+}
+
+
+/**
+ * Belegt das Schreiber-Wort mit der Thread-Id des Prozesses und trägt es in
+ * die Robust-Futex-Liste ein. "list_op_pending" deckt den Zeitraum ab, in dem
+ * das Wort schon belegt, aber noch nicht eingetragen ist.
+ *
+ * @param lock - Zielobjekt
+ */
+static void acquireWriterWord (RwLock *lock)
+{
+    robustListHead.list_op_pending = &lock->robustEntry;
+
+    for (;;) {
+        unsigned int word = __atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST);
+        if ((word & FUTEX_TID_MASK) == 0) {
+            // Frei, ggf. mit FUTEX_OWNER_DIED eines abgestürzten Schreibers
+            if (__atomic_compare_exchange_n(&lock->writer, &word,
+                                            lockOwnerTid | (word & FUTEX_WAITERS), false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                break;
+            }
+            continue;
+        }
+        waitForWriter(lock);
+    }
+
+    lock->robustEntry.next = robustListHead.list.next;
+    robustListHead.list.next = &lock->robustEntry;
+    robustListHead.list_op_pending = NULL;
+}
+
+
+static void releaseWriterWord (RwLock *lock)
+{
+    robustListHead.list_op_pending = &lock->robustEntry;
+
+    struct robust_list *entry = &robustListHead.list;
+    while (entry->next != &lock->robustEntry) {
+        entry = entry->next;
+    }
+    entry->next = lock->robustEntry.next;
+
+    unsigned int word = __atomic_exchange_n(&lock->writer, 0, __ATOMIC_SEQ_CST);
+    if (word & FUTEX_WAITERS) {
+        futexWake(&lock->writer, INT_MAX);
+    }
+
+    robustListHead.list_op_pending = NULL;
+}
+
+
+/**
+ * Wartet bis keine Leser mehr im kritischen Abschnitt sind.
+ *
+ * @param lock - Zielobjekt
+ */
+static void waitForReaders (RwLock *lock)
+{
+    __atomic_fetch_add(&lock->drainWaiting, 1, __ATOMIC_SEQ_CST);
+
+    unsigned int readers;
+    while ((readers = __atomic_load_n(&lock->readers, __ATOMIC_SEQ_CST)) != 0) {
+        futexWait(&lock->readers, readers);
+    }
+
+    __atomic_fetch_sub(&lock->drainWaiting, 1, __ATOMIC_SEQ_CST);
+}
+
+
+static void releaseReadLock (RwLock *lock)
+{
+    if (__atomic_sub_fetch(&lock->readers, 1, __ATOMIC_SEQ_CST) == 0 &&
+            __atomic_load_n(&lock->drainWaiting, __ATOMIC_SEQ_CST) > 0) {
+        futexWake(&lock->readers, INT_MAX);
+    }
+}
+
+
+/**
+ * Leser melden sich optimistisch im Leser-Zähler an und prüfen danach das
+ * Schreiber-Wort (Schreiber prüfen in umgekehrter Reihenfolge), so dass
+ * immer mindestens einer den anderen sieht. Bei Konflikt nimmt sich der
+ * Leser wieder heraus und wartet.
+ *
+ * @param lock - Zielobjekt
+ */
+static void acquireReadLock (RwLock *lock)
+{
+    if (lockPolicy == LOCK_POLICY_FAIR) {
+        enterTurnstile(lock);
+    }
+
+    for (;;) {
+        __atomic_add_fetch(&lock->readers, 1, __ATOMIC_SEQ_CST);
+
+        unsigned int word = __atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST);
+        if ((word & FUTEX_TID_MASK) == 0 &&
+                (lockPolicy != LOCK_POLICY_WRITER ||
+                 __atomic_load_n(&lock->writersWaiting, __ATOMIC_SEQ_CST) == 0)) {
+            if (word & FUTEX_OWNER_DIED) {
+                repairWriterWord(lock, word);
+            }
+            break;
+        }
+
+        releaseReadLock(lock);
+        waitForWriter(lock);
+    }
+
+    if (lockPolicy == LOCK_POLICY_FAIR) {
+        leaveTurnstile(lock);
+    }
+}
+
+
+static void acquireWriteLock (RwLock *lock)
+{
+    if (lockPolicy == LOCK_POLICY_FAIR) {
+        enterTurnstile(lock);
+    }
+    else if (lockPolicy == LOCK_POLICY_WRITER) {
+        __atomic_fetch_add(&lock->writersWaiting, 1, __ATOMIC_SEQ_CST);
+    }
+
+    for (;;) {
+        acquireWriterWord(lock);
+        if (__atomic_load_n(&lock->readers, __ATOMIC_SEQ_CST) == 0) {
+            break;
+        }
+
+        // Leser bevorzugt: Neue Leser nicht aufhalten, solange noch welche aktiv sind
+        if (lockPolicy == LOCK_POLICY_READER) {
+            releaseWriterWord(lock);
+            waitForReaders(lock);
+        }
+        else {
+            waitForReaders(lock);
+            break;
+        }
+    }
+
+    if (lockPolicy == LOCK_POLICY_FAIR) {
+        leaveTurnstile(lock);
+    }
+    else if (lockPolicy == LOCK_POLICY_WRITER) {
+        // Erst nach dem Belegen, damit wartende Leser sicher geweckt werden
+        __atomic_fetch_sub(&lock->writersWaiting, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+
+static void releaseWriteLock (RwLock *lock)
+{
+    releaseWriterWord(lock);
+}
+
+
 /**
  * Multi-Reader/Single-Writer Lock
  *
- * In dieser Lösung des Leser/Schreiber-Problems werden Leser stark bevorzugt
- * und haben uneingeschränkten gleichzeitigen Zugriff. Schreibzugriffe sind nur
- * möglich wenn es gerade keine Leser gibt. Der Nachteil ist, das die Gefahr
- * besteht dass Schreiber verhungern.
+ * Die Strategie wird beim Start festgelegt:
+ * - LOCK_POLICY_READER: Leser werden stark bevorzugt und haben uneingeschränkten
+ *   gleichzeitigen Zugriff. Schreibzugriffe sind nur möglich wenn es gerade keine
+ *   Leser gibt, d.h. Schreiber können verhungern.
+ * - LOCK_POLICY_WRITER: Solange Schreiber warten, werden keine neuen Leser
+ *   zugelassen. Schreiber kommen vor neuen Lesern dran, dafür können bei
+ *   Dauerlast Leser verhungern.
+ * - LOCK_POLICY_FAIR: Leser und Schreiber stellen sich an einem Drehkreuz
+ *   (Ticket-Lock) an und kommen in der Reihenfolge der Anfragen dran,
+ *   aufeinanderfolgende Leser teilen sich den Zugriff.
+ *
+ * Das Storage ist über den Schlüssel-Hash in LOCK_STRIPES Teile aufgeteilt,
+ * die jeweils ein eigenes Lock haben. Diese Funktion sperrt alle Teile (in
+ * aufsteigender Reihenfolge, damit sich Prozesse nicht gegenseitig blockieren)
+ * und ist für Zugriffe auf das ganze Storage gedacht (Wildcards, Dateien).
  *
  * @param accessType - Datenzugriffs-Art
  */
-inline void enterCriticalSection (int accessType)
+void enterCriticalSection (int accessType)
 {
     if (exclusiveMode) return;
 
-    if (accessType == READ_ACCESS) {
-        semop(storageSemaphoreId, &enterReaderCounter, 1);
-        (*readerCounter)++;
-        if (*readerCounter == 1) {
-            semop(storageSemaphoreId, &enterStorage, 1);
+    unsigned long start = getNanoseconds();
+
+    for (int i = 0; i < LOCK_STRIPES; i++) {
+        if (accessType == READ_ACCESS) {
+            acquireReadLock(&lockHeader->stripes[i]);
         }
-        semop(storageSemaphoreId, &leaveReaderCounter, 1);
+        else if (accessType == WRITE_ACCESS) {
+            acquireWriteLock(&lockHeader->stripes[i]);
+        }
+    }
+
+    recordLockWait(accessType, start);
+}
+
+
+void leaveCriticalSection (int accessType)
+{
+    if (exclusiveMode) return;
+
+    for (int i = LOCK_STRIPES - 1; i >= 0; i--) {
+        if (accessType == READ_ACCESS) {
+            releaseReadLock(&lockHeader->stripes[i]);
+        }
+        else if (accessType == WRITE_ACCESS) {
+            releaseWriteLock(&lockHeader->stripes[i]);
+        }
+    }
+}
+
+
+/**
+ * Sperrt nur den Teil des Storage, zu dem ein Schlüssel gehört. Zugriffe auf
+ * Schlüssel in anderen Teilen laufen ungehindert weiter.
+ *
+ * @param hash - Hash des Schlüssels
+ * @param accessType - Datenzugriffs-Art
+ */
+inline void enterStripeSection (unsigned int hash, int accessType)
+{
+    if (exclusiveMode) return;
+
+    unsigned long start = getNanoseconds();
+    RwLock *lock = &lockHeader->stripes[getLockStripe(hash)];
+
+    if (accessType == READ_ACCESS) {
+        acquireReadLock(lock);
     }
     else if (accessType == WRITE_ACCESS) {
-        semop(storageSemaphoreId, &enterStorage, 1);
+        acquireWriteLock(lock);
     }
+
+    recordLockWait(accessType, start);
 }
 
 
-inline void leaveCriticalSection (int accessType)
+inline void leaveStripeSection (unsigned int hash, int accessType)
 {
     if (exclusiveMode) return;
 
+    RwLock *lock = &lockHeader->stripes[getLockStripe(hash)];
+
     if (accessType == READ_ACCESS) {
-        semop(storageSemaphoreId, &enterReaderCounter, 1);
-        (*readerCounter)--;
-        if (*readerCounter == 0) {
-            semop(storageSemaphoreId, &leaveStorage, 1);
-        }
-        semop(storageSemaphoreId, &leaveReaderCounter, 1);
+        releaseReadLock(lock);
     }
     else if (accessType == WRITE_ACCESS) {
-        semop(storageSemaphoreId, &leaveStorage, 1);
+        releaseWriteLock(lock);
     }
 }
 
 
 /**
- * Realisiert den exklusiven Zugriff mit einer Down-Operation des
- * Semaphore welcher den kritischen Bereich schützt. Wenn ein Client
- * in den exklusiven Modus geht während dieser bereits genutzt wird,
- * wird er selbst blockiert. (Schlecht für menschliche Interaktion,
- * akzeptabel für IPC?)
+ * Sperrt mehrere Teile des Storage mit einem Aufruf, z.B. alle Teile der
+ * Schlüssel eines Befehls mit mehreren Schlüsseln. Gesperrt wird wie bei
+ * "enterCriticalSection" in aufsteigender Reihenfolge.
+ *
+ * @param stripes - Menge der Teile (Bit i = Teil i)
+ * @param accessType - Datenzugriffs-Art
+ */
+void enterStripeSetSection (StripeSet stripes, int accessType)
+{
+    if (exclusiveMode) return;
+
+    unsigned long start = getNanoseconds();
+
+    for (int i = 0; i < LOCK_STRIPES; i++) {
+        if (!(stripes & (1ULL << i))) continue;
+
+        if (accessType == READ_ACCESS) {
+            acquireReadLock(&lockHeader->stripes[i]);
+        }
+        else if (accessType == WRITE_ACCESS) {
+            acquireWriteLock(&lockHeader->stripes[i]);
+        }
+    }
+
+    recordLockWait(accessType, start);
+}
+
+
+void leaveStripeSetSection (StripeSet stripes, int accessType)
+{
+    if (exclusiveMode) return;
+
+    for (int i = LOCK_STRIPES - 1; i >= 0; i--) {
+        if (!(stripes & (1ULL << i))) continue;
+
+        if (accessType == READ_ACCESS) {
+            releaseReadLock(&lockHeader->stripes[i]);
+        }
+        else if (accessType == WRITE_ACCESS) {
+            releaseWriteLock(&lockHeader->stripes[i]);
+        }
+    }
+}
+
+
+/**
+ * Schützt die von allen Teilen gemeinsam genutzten Strukturen (freie Plätze,
+ * Slab-Allokator). Nur innerhalb eines kritischen Abschnitts und nur kurz
+ * halten, sonst ist die Reihenfolge der Locks nicht mehr garantiert.
+ *
+ */
+inline void enterAllocationSection ()
+{
+    if (exclusiveMode) return;
+    acquireWriterWord(&lockHeader->allocationLock);
+}
+
+
+inline void leaveAllocationSection ()
+{
+    if (exclusiveMode) return;
+    releaseWriterWord(&lockHeader->allocationLock);
+}
+
+
+/**
+ * Serialisiert das Synchronisieren des Journals (Group-Commit). Wird ohne
+ * andere Locks gehalten und gilt auch im exklusiven Modus, weil der
+ * Journal-Prozess unabhängig von den Clients synchronisiert.
+ *
+ */
+void enterJournalSection ()
+{
+    acquireWriterWord(&lockHeader->journalLock);
+}
+
+
+void leaveJournalSection ()
+{
+    releaseWriterWord(&lockHeader->journalLock);
+}
+
+
+/**
+ * Realisiert den exklusiven Zugriff, indem alle Schreib-Locks bis zum END
+ * gehalten werden. Wenn ein Client in den exklusiven Modus geht während dieser
+ * bereits genutzt wird, wird er selbst blockiert. (Schlecht für menschliche
+ * Interaktion, akzeptabel für IPC?) Beendet sich der Client im exklusiven
+ * Modus, gibt der Kernel die Locks über die Robust-Futex-Liste frei.
  *
  */
 bool enterExclusiveMode ()
 {
     if (!exclusiveMode) {
-        semop(storageSemaphoreId, &enterStorage, 1);
+        enterCriticalSection(WRITE_ACCESS);
+        acquireWriterWord(&lockHeader->exclusiveLock);
         exclusiveMode = true;
         return true;
     }
@@ -143,9 +690,22 @@ bool leaveExclusiveMode ()
 {
     if (exclusiveMode) {
         exclusiveMode = false;
-        semop(storageSemaphoreId, &leaveStorage, 1);
+        releaseWriterWord(&lockHeader->exclusiveLock);
+        leaveCriticalSection(WRITE_ACCESS);
         return true;
     }
     return false;
 }
 
+
+/**
+ * Prüft ob irgendein Prozess im exklusiven Modus ist. Für Leser die ohne Lock
+ * auf das Storage zugreifen und sonst am exklusiven Modus vorbei lesen würden.
+ * Das Schreiber-Wort wird wie die Locks beim Absturz vom Kernel freigegeben.
+ *
+ */
+bool isExclusiveModeActive ()
+{
+    return exclusiveMode ||
+           (__atomic_load_n(&lockHeader->exclusiveLock.writer, __ATOMIC_ACQUIRE) & FUTEX_TID_MASK) != 0;
+}
@@ -2,6 +2,8 @@
 #include "command.h"
 #include "lock.h"
 #include "storage.h"
+#include "journal.h"
+#include "slab.h"
 #include "newsletter.h"
 #include "systemExec.h"
 #include "network.h"
@@ -9,18 +11,26 @@
 
 static int argSnapshotInterval = 0; // 0 = Snapshot-Timer deaktiviert
 static bool argHttpInterface = true;
+static bool argBinaryInterface = true;
 static bool argNewsletter = true;
 static bool argSystemExec = true;
+static int argLockPolicy = LOCK_POLICY_READER;
+static int argWorkers = 0; // 0 = ein Prozess pro Verbindung
+static bool argEventLoop = false;
+static int argStorageFormat = STORAGE_FORMAT_BINARY;
+static JournalPolicy argJournalPolicy = {JOURNAL_SYNC_INTERVAL, 1000, 0}; // fdatasync() jede Sekunde
 
 
 static void initAllModules ()
 {
     initModuleCommand();
-    initModuleLock();
-    initModuleStorage(argSnapshotInterval);
+    initModuleLock(argLockPolicy);
+    initModuleSlab();
+    initModuleJournal(argJournalPolicy);
+    initModuleStorage(argSnapshotInterval, argStorageFormat);
     if (argNewsletter) initModuleNewsletter();
     if (argSystemExec) initModuleSystemExec();
-    initModuleNetwork(argHttpInterface);
+    initModuleNetwork(argHttpInterface, argBinaryInterface, argEventLoop);
 }
 
 
@@ -30,6 +40,8 @@ static void freeAllModules ()
     if (argSystemExec) freeModuleSystemExec();
     if (argNewsletter) freeModuleNewsletter();
     freeModuleStorage();
+    freeModuleJournal();
+    freeModuleSlab();
     freeModuleLock();
     freeModuleCommand();
 }
@@ -51,8 +63,54 @@ void fatalError (const char *message)
 }
 
 
+static void parseArguments (int argc, char *argv[])
+{
+    int option;
+    while ((option = getopt(argc, argv, "l:w:es:j:i:")) != -1) {
+        bool valid = false;
+        switch (option) {
+            case 'l':
+                argLockPolicy = parseLockPolicy(optarg);
+                valid = (argLockPolicy != -1);
+                break;
+            case 'w':
+                argWorkers = atoi(optarg);
+                valid = (argWorkers >= 0 && argWorkers <= SERVER_MAX_WORKERS);
+                break;
+            case 'e':
+                argEventLoop = true;
+                valid = true;
+                break;
+            case 's':
+                argStorageFormat = (strcmp(optarg, "csv") == 0) ? STORAGE_FORMAT_CSV : STORAGE_FORMAT_BINARY;
+                valid = (strcmp(optarg, "csv") == 0 || strcmp(optarg, "binary") == 0);
+                break;
+            case 'j':
+                valid = parseJournalPolicy(optarg, &argJournalPolicy);
+                break;
+            case 'i':
+                argSnapshotInterval = atoi(optarg);
+                valid = (argSnapshotInterval >= 0);
+                break;
+            default:
+                break;
+        }
+        if (!valid) {
+            fprintf(stderr, "Usage: %s [-l reader|writer|fair] [-w workers] [-e] [-s binary|csv]"
+                            " [-j off|none|always|<n>ms|<n>kb] [-i snapshot-seconds]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
 int main (int argc, char *argv[])
 {
+    parseArguments(argc, argv);
+    if (argEventLoop && argWorkers == 0) {
+        argWorkers = 1; // Die Event-Loop läuft in Worker-Prozessen
+    }
+
     // Verwerfe den exit-Status der Kind-Prozesse, um Zombie-Prozesse zu verhindern
     signal(SIGCHLD, SIG_IGN);
 
@@ -62,7 +120,7 @@ int main (int argc, char *argv[])
     signal(SIGTERM, freeResourcesAndExit); // Beenden mit kill #pid
 
     prctl(PR_SET_NAME, (unsigned long)"kvsvr(cmd)");
-    runServerLoop("Command", COMMAND_SERVER_PORT, clientHandlerCommand);
+    runServerLoop("Command", COMMAND_SERVER_PORT, clientHandlerCommand, argWorkers);
 
     return EXIT_SUCCESS;
 }
@@ -5,22 +5,59 @@
  * Netzwerk-Kommunikation
  *
  * Server-Loop zur Annahme eingehender TCP/IP Verbindungen und
- * Client-Handler zur Ein- und Ausgabe der Nutzdaten.
+ * Client-Handler zur Ein- und Ausgabe der Nutzdaten. Verbindungen werden
+ * entweder von einem eigenen Prozess pro Verbindung oder von einer festen
+ * Anzahl vorab erzeugter Worker-Prozesse bedient. Command-Worker können
+ * statt einer Verbindung nach der anderen auch viele Verbindungen gleichzeitig
+ * in einer epoll Event-Loop bedienen.
  *
  */
 
 
 static const char *commandQuitName = "QUIT";
+static CommandEntry *commandQuitEntry = NULL;
 SOCKET processSocket = 0;
 
+static bool eventLoopWorkers = false;
 
-void initModuleNetwork (bool httpInterface)
+// Befehle, deren Zustand am Prozess hängt (exklusiver Modus, Observer) oder die
+// ein externes Programm abwarten. Die Event-Loop gibt solche Verbindungen an
+// einen eigenen Prozess ab, statt alle anderen Verbindungen zu blockieren.
+static const char *dedicatedProcessCommands[] = {"BEG", "SUB", "OP"};
+static CommandEntry *dedicatedProcessEntries[sizeof(dedicatedProcessCommands) / sizeof(char*)];
+
+// Verbindungen der Event-Loop, über den Socket-Deskriptor indiziert
+static Connection **eventConnections = NULL;
+static int eventConnectionCapacity = 0;
+static int eventPollFd = -1;
+static SOCKET eventServerSocket = -1;
+static bool eventAcceptPaused = false;
+static RingBuffer *eventInput = NULL; // Gemeinsamer Eingabepuffer, solange keine Zeile unvollständig bleibt
+static ResponseStream *eventSpareStream = NULL; // Wiederverwendbarer Stream einer gesendeten Antwort
+
+
+void initModuleNetwork (bool httpInterface, bool binaryInterface, bool eventLoop)
 {
     registerCommandEntry(commandQuitName, 0, false, eventCommandQuit);
 
+    // Die Befehle werden beim Interpretieren aufgelöst, danach genügt ein Zeigervergleich
+    commandQuitEntry = lookupCommandEntry(commandQuitName);
+    for (size_t i = 0; i < sizeof(dedicatedProcessCommands) / sizeof(char*); i++) {
+        dedicatedProcessEntries[i] = lookupCommandEntry(dedicatedProcessCommands[i]);
+    }
+
+    eventLoopWorkers = eventLoop;
+
     if (httpInterface && fork() == 0) {
         prctl(PR_SET_NAME, (unsigned long)"kvsvr(http)");
-        runServerLoop("Http", HTTP_SERVER_PORT, clientHandlerHttp);
+        runServerLoop("Http", HTTP_SERVER_PORT, clientHandlerHttp, 0);
+
+        exit(EXIT_SUCCESS);
+    }
+
+    if (binaryInterface && fork() == 0) {
+        prctl(PR_SET_NAME, (unsigned long)"kvsvr(bin)");
+        runServerLoop("Binary", BINARY_SERVER_PORT, clientHandlerBinary, 0);
 
         exit(EXIT_SUCCESS);
     }
@@ -75,16 +112,154 @@ size_t receiveMessage (SOCKET socket, String *message)
 }
 
 
+/**
+ * Empfängt die verfügbaren Daten einer Socket-Verbindung in den freien Platz
+ * eines Ringpuffers (ein readv() auch über das Pufferende hinweg). Der
+ * Rückgabewert entspricht dem von recv().
+ *
+ * @param socket - Verbindungs-Deskriptor
+ * @param input - Eingabepuffer
+ */
+ssize_t receiveIntoRingBuffer (SOCKET socket, RingBuffer *input)
+{
+    struct iovec segments[2];
+    int count = ringBufferGetFreeSegments(input, segments);
+
+    ssize_t size = readv(socket, segments, count);
+    if (size > 0) {
+        ringBufferCommitWrite(input, size);
+    }
+    return size;
+}
+
+
+/**
+ * Führt den Client-Handler für eine angenommene Verbindung aus und schließt
+ * sie danach.
+ *
+ * @param name - Server-Name
+ * @param clientSocket - Verbindungs-Descriptor
+ * @param clientAddr - Adresse des Clients
+ * @param clientHandler - Eintrittsfunktion für Clients
+ */
+static void serveClient (const char* name, SOCKET clientSocket, struct sockaddr_in *clientAddr,
+                         void (*clientHandler)(SOCKET socket))
+{
+    printf("%s-Client %d (%s) connected\n", name, getpid(), inet_ntoa(clientAddr->sin_addr));
+    clientHandler(clientSocket);
+    close(clientSocket);
+    printf("%s-Client %d (%s) disconnected\n", name, getpid(), inet_ntoa(clientAddr->sin_addr));
+}
+
+
+/**
+ * Eintrittsfunktion eines Worker-Prozesses. Nimmt Verbindungen am gemeinsamen
+ * Socket an und bedient sie nacheinander. Der Kernel verteilt eingehende
+ * Verbindungen auf die in accept() wartenden Worker. Nach jeder Verbindung
+ * wird der Zustand zurückgesetzt, den ein Client-Prozess sonst mit seinem
+ * Ende aufgegeben hätte (exklusiver Modus, Subscriptions).
+ *
+ * @param name - Server-Name
+ * @param serverSocket - Gemeinsamer "Rendezvous-Descriptor"
+ * @param clientHandler - Eintrittsfunktion für Clients
+ */
+static void runServerWorker (const char* name, SOCKET serverSocket, void (*clientHandler)(SOCKET socket))
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    struct sockaddr_in clientAddr;
+    unsigned int len;
+
+    for (;;) {
+        len = sizeof(clientAddr);
+        SOCKET clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &len);
+        if (clientSocket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("runServerWorker accept");
+            exit(EXIT_FAILURE);
+        }
+
+        processSocket = clientSocket;
+        serveClient(name, clientSocket, &clientAddr, clientHandler);
+        processSocket = serverSocket;
+
+        leaveExclusiveMode();
+        stopStorageObserver();
+    }
+}
+
+
+static pid_t startServerWorker (const char* name, void (*clientHandler)(SOCKET socket))
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (eventLoopWorkers && clientHandler == clientHandlerCommand) {
+            runCommandEventLoop(name, processSocket);
+        }
+        else {
+            runServerWorker(name, processSocket, clientHandler);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    if (pid == -1) {
+        perror("startServerWorker fork");
+    }
+    return pid;
+}
+
+
+/**
+ * Erzeugt "workers" Worker-Prozesse und startet beendete Worker (z.B. nach
+ * einem Absturz) neu. Kehrt nicht zurück.
+ *
+ * @param name - Server-Name
+ * @param clientHandler - Eintrittsfunktion für Clients
+ * @param workers - Anzahl der Worker-Prozesse
+ */
+static void runWorkerPool (const char* name, void (*clientHandler)(SOCKET socket), int workers)
+{
+    pid_t workerPids[SERVER_MAX_WORKERS];
+
+    // Beendete Kind-Prozesse werden selbst abgeholt, um Worker neu zu starten
+    signal(SIGCHLD, SIG_DFL);
+
+    for (int i = 0; i < workers; i++) {
+        workerPids[i] = startServerWorker(name, clientHandler);
+    }
+    printf("%s-Server started %d worker processes\n", name, workers);
+
+    for (;;) {
+        pid_t pid = wait(NULL);
+        if (pid == -1) {
+            if (errno != EINTR) sleep(1);
+            continue;
+        }
+
+        for (int i = 0; i < workers; i++) {
+            if (workerPids[i] == pid) {
+                printf("%s-Worker %d terminated, restarting\n", name, pid);
+                workerPids[i] = startServerWorker(name, clientHandler);
+            }
+        }
+    }
+}
+
+
 /**
  * Starte eine Schleife mit der TCP/IP Verbindungsannahme an einem bestimmten Port.
- * Für jede eingehende Verbindung wird ein neuer Prozess erzeugt, der dann
- * den Client-Handler ausführt.
+ * Ohne Worker wird für jede eingehende Verbindung ein neuer Prozess erzeugt,
+ * der dann den Client-Handler ausführt. Mit Worker-Prozessen nehmen diese die
+ * Verbindungen selbst an, ein Prozess bedient dann viele Verbindungen.
  *
  * @param name - Server-Name
  * @param port - Server-Port
  * @param clientHandler - Eintrittsfunktion für Clients
+ * @param workers - Anzahl der Worker-Prozesse, 0 = ein Prozess pro Verbindung
  */
-void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET socket))
+void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET socket), int workers)
 {
     struct sockaddr_in serverAddr;
 
@@ -113,12 +288,16 @@ void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET soc
     }
 
     // Eingehende Verbindungen in einer Warteschlange aufnehmen
-    if (listen(processSocket, 5) == -1) {
+    if (listen(processSocket, SERVER_LISTEN_BACKLOG) == -1) {
         fatalError("runServerLoop listen");
     }
 
     printf("%s-Server listening on port %i\n", name, port);
 
+    if (workers > 0) {
+        runWorkerPool(name, clientHandler, workers);
+    }
+
     struct sockaddr_in clientAddr;
     unsigned int len = sizeof(clientAddr);
     SOCKET clientSocket;
@@ -138,11 +317,7 @@ void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET soc
             close(processSocket);
 
             processSocket = clientSocket;
-
-            printf("%s-Client %d (%s) connected\n", name, getpid(), inet_ntoa(clientAddr.sin_addr));
-            clientHandler(clientSocket);
-            close(clientSocket);
-            printf("%s-Client %d (%s) disconnected\n", name, getpid(), inet_ntoa(clientAddr.sin_addr));
+            serveClient(name, clientSocket, &clientAddr, clientHandler);
 
             exit(EXIT_SUCCESS);
         }
@@ -154,9 +329,145 @@ void runServerLoop (const char* name, int port, void (*clientHandler)(SOCKET soc
 }
 
 
+static bool isDedicatedProcessCommand (const Command *cmd)
+{
+    if (cmd->entry == NULL) return false;
+
+    for (size_t i = 0; i < sizeof(dedicatedProcessCommands) / sizeof(char*); i++) {
+        if (cmd->entry == dedicatedProcessEntries[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Verarbeitet alle vollständigen Zeilen im Eingabepuffer einer Verbindung
+ * in ihrer Reihenfolge (Pipelining) und hängt die Antworten an "batch" an,
+ * damit sie mit einem einzigen Systemaufruf gesendet werden können. Gibt
+ * zurück, warum die Verarbeitung beendet wurde (BATCH_...). Bei
+ * BATCH_DEDICATED ist der Befehl bereits in "cmd" interpretiert, aber noch
+ * nicht ausgeführt.
+ *
+ * @param socket - Verbindungs-Descriptor (nur für die Ausgabe)
+ * @param input - Eingabepuffer der Verbindung
+ * @param cmd - Befehlsobjekt
+ * @param line - Puffer für die aktuelle Zeile
+ * @param response - Puffer für eine einzelne Antwort
+ * @param batch - Gesammelte Antworten
+ * @param stopAtDedicated - Bei BEG, SUB, OP anhalten (Event-Loop)
+ */
+static int processCommandBatch (SOCKET socket, RingBuffer *input, Command *cmd, String *line,
+                                String *response, String *batch, bool stopAtDedicated)
+{
+    while (stringLength(batch) < SEND_BATCH_SIZE) {
+        int state = ringBufferReadLine(input, line);
+        if (state == RING_LINE_NONE) {
+            return BATCH_DONE;
+        }
+        if (state == RING_LINE_EXCEEDED) {
+            stringAppend(batch, "BUFFER_EXCEEDED\r\n");
+            continue;
+        }
+
+        commandParseInputMessage(cmd, line);
+        printf("Cmd-%d/%d: %s %s %s\n", getpid(), socket,
+               cmd->name->cStr, cmd->key->cStr, cmd->value->cStr);
+
+        if (stopAtDedicated && isDedicatedProcessCommand(cmd)) {
+            return BATCH_DEDICATED;
+        }
+
+        commandExecute(cmd);
+        commandFormatResponseMessage(cmd, response);
+        stringAppend(batch, response->cStr);
+
+        if (cmd->entry == commandQuitEntry) {
+            ringBufferClear(input);
+            return BATCH_QUIT;
+        }
+        if (cmd->stream != NULL && responseStreamIsOpen(cmd->stream)) {
+            return BATCH_STREAM;
+        }
+    }
+    return BATCH_FULL;
+}
+
+
+/**
+ * Sendet eine gestreamte Antwort im Anschluss an die gesammelten Antworten
+ * in Abschnitten von SEND_BATCH_SIZE. Gibt false zurück, wenn die Verbindung
+ * abgebrochen ist.
+ *
+ * @param socket - Verbindungs-Descriptor
+ * @param stream - Geöffneter Antwort-Stream
+ * @param batch - Gesammelte Antworten, danach leer
+ */
+static bool sendResponseStream (SOCKET socket, ResponseStream *stream, String *batch)
+{
+    bool streaming;
+    do {
+        streaming = responseStreamWrite(stream, batch, SEND_BATCH_SIZE);
+        if (send(socket, batch->cStr, stringLength(batch), MSG_NOSIGNAL) == -1) {
+            responseStreamClose(stream);
+            stringCopy(batch, "");
+            return false;
+        }
+        stringCopy(batch, "");
+    } while (streaming);
+
+    return true;
+}
+
+
+/**
+ * Bedient eine blockierende Command-Verbindung bis zum QUIT oder bis der
+ * Client sie schließt. Pro Empfang werden alle darin vollständigen Befehle
+ * ausgeführt und ihre Antworten mit einem send() zurückgegeben.
+ *
+ * @param socket - Verbindungs-Descriptor
+ * @param input - Eingabepuffer, kann bereits empfangene Daten enthalten
+ */
+static void runCommandConnection (SOCKET socket, RingBuffer *input)
+{
+    String *line = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    String *response = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    String *batch = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    Command *cmd = commandCreate();
+    cmd->stream = responseStreamCreate();
+
+    for (;;) {
+        int state = processCommandBatch(socket, input, cmd, line, response, batch, false);
+        if (state == BATCH_STREAM) {
+            if (!sendResponseStream(socket, cmd->stream, batch)) break;
+            continue;
+        }
+        if (stringLength(batch) > 0) {
+            send(socket, batch->cStr, stringLength(batch), MSG_NOSIGNAL);
+            stringCopy(batch, "");
+        }
+        if (state == BATCH_QUIT) break;
+        if (state == BATCH_FULL) continue;
+
+        ssize_t size = receiveIntoRingBuffer(socket, input);
+        if (size == -1 && errno == EINTR) continue;
+        if (size <= 0) break;
+    }
+
+    responseStreamFree(cmd->stream);
+    commandFree(cmd);
+    stringFree(batch);
+    stringFree(response);
+    stringFree(line);
+}
+
+
 /**
  * Eintrittsfunktion für Command-Clients. Nimmt in einer Schleife Befehle entgegen,
  * verarbeitet Sie, und gibt dann die Ergebnisse zurück (persistente Verbindung).
+ * Befehle werden an ihrem Zeilenende getrennt, ein Client kann mehrere Befehle
+ * senden ohne auf die Antworten zu warten.
  *
  * @param socket - Verbindungs-Descriptor
  */
@@ -164,32 +475,80 @@ void clientHandlerCommand (SOCKET socket)
 {
     prctl(PR_SET_NAME, (unsigned long)"kvsvr(cmd-cli)");
 
-    String *buffer = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    RingBuffer *input = ringBufferCreate(RECV_RING_SIZE, RECV_BUFFER_SIZE - 1);
+    runCommandConnection(socket, input);
+    ringBufferFree(input);
+}
+
+
+/**
+ * Eintrittsfunktion für Clients des binären Protokolls. Wie beim Text-Protokoll
+ * werden alle vollständig empfangenen Anfragen nacheinander ausgeführt und
+ * ihre Antworten mit einem send() zurückgegeben (persistente Verbindung).
+ *
+ * @param socket - Verbindungs-Descriptor
+ */
+void clientHandlerBinary (SOCKET socket)
+{
+    prctl(PR_SET_NAME, (unsigned long)"kvsvr(bin-cli)");
+
+    BinaryBuffer *input = binaryBufferCreate(RECV_RING_SIZE);
+    BinaryBuffer *output = binaryBufferCreate(RECV_RING_SIZE);
     Command *cmd = commandCreate();
+    bool quit = false;
 
-    do {
-        size_t size = receiveMessage(socket, buffer);
-        if (size > RECV_BUFFER_SIZE) {
-            const char *exceedMsg = "BUFFER_EXCEEDED\r\n";
-            send(socket, exceedMsg, strlen(exceedMsg), 0);
-            continue;
-        }
-        else if (size <= 0) {
-            break;
-        }
+    for (;;) {
+        size_t offset = 0;
+        size_t frameSize = BINARY_REQUEST_HEADER_SIZE; // Benötigte Bytes für die nächste Anfrage
 
-        commandParseInputMessage(cmd, buffer);
-        printf("Cmd-%d: %s %s %s\n", getpid(),
-               cmd->name->cStr, cmd->key->cStr, cmd->value->cStr);
-        commandExecute(cmd);
-        commandFormatResponseMessage(cmd, buffer);
+        while (!quit && output->length < SEND_BATCH_SIZE &&
+               input->length - offset >= BINARY_REQUEST_HEADER_SIZE) {
+            BinaryRequestHeader header;
+            binaryParseRequestHeader(&input->data[offset], &header);
 
-        send(socket, buffer->cStr, stringLength(buffer), 0);
+            size_t payloadSize = header.keyLength + header.valueLength;
+            if (payloadSize > BINARY_MAX_PAYLOAD_SIZE) {
+                binaryFormatResponse(cmd, header.opcode, BINARY_STATUS_TOO_LARGE, output);
+                quit = true;
+                break;
+            }
+            frameSize = BINARY_REQUEST_HEADER_SIZE + payloadSize;
+            if (input->length - offset < frameSize) break;
 
-    } while (!stringEquals(cmd->name, commandQuitName));
+            int status = binaryParseRequest(cmd, &header, &input->data[offset + BINARY_REQUEST_HEADER_SIZE]);
+            if (status == BINARY_STATUS_OK) {
+                printf("Bin-%d: %s %s %s\n", getpid(),
+                       cmd->name->cStr, cmd->key->cStr, cmd->value->cStr);
+                if (!commandExecute(cmd)) {
+                    status = BINARY_STATUS_REJECTED;
+                }
+                quit = (header.opcode == BINARY_OP_QUIT);
+            }
+            binaryFormatResponse(cmd, header.opcode, status, output);
+
+            offset += frameSize;
+            frameSize = BINARY_REQUEST_HEADER_SIZE;
+        }
+
+        if (output->length > 0) {
+            send(socket, output->data, output->length, MSG_NOSIGNAL);
+            output->length = 0;
+        }
+        binaryBufferConsume(input, offset);
+        if (quit) break;
+        if (input->length >= frameSize) continue; // Antworten wurden vorzeitig gesendet
+
+        binaryBufferReserve(input, (frameSize > input->length + RECV_BUFFER_SIZE) ?
+                                   frameSize : input->length + RECV_BUFFER_SIZE);
+        ssize_t size = recv(socket, &input->data[input->length], input->capacity - input->length, 0);
+        if (size == -1 && errno == EINTR) continue;
+        if (size <= 0) break;
+        input->length += size;
+    }
 
     commandFree(cmd);
-    stringFree(buffer);
+    binaryBufferFree(output);
+    binaryBufferFree(input);
 }
 
 
@@ -235,3 +594,434 @@ void clientHandlerHttp (SOCKET socket) {
     httpRequestFree(request);
     stringFree(buffer);
 }
+
+
+/**
+ * Hebt das Limit für offene Dateideskriptoren auf das Maximum an, damit ein
+ * Worker mehr als die üblichen 1024 Verbindungen halten kann.
+ *
+ */
+static void raiseFileLimit ()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+
+/**
+ * Meldet EPOLLOUT für eine Verbindung nur an, solange Antworten auf das
+ * Senden warten, sonst würde epoll ständig "beschreibbar" melden. Während
+ * eine Antwort gestreamt wird, wird keine weitere Eingabe gelesen, damit die
+ * Antworten in der Reihenfolge der Befehle bleiben.
+ *
+ * @param conn - Zielobjekt
+ */
+static void updateConnectionEvents (Connection *conn)
+{
+    unsigned int events = ((conn->stream == NULL) ? EPOLLIN : 0) |
+                          ((conn->output != NULL || conn->stream != NULL) ? EPOLLOUT : 0);
+    if (events == conn->events) return;
+
+    struct epoll_event event = {.events = events, .data.ptr = conn};
+    epoll_ctl(eventPollFd, EPOLL_CTL_MOD, conn->socket, &event);
+    conn->events = events;
+}
+
+
+static Connection* openConnection (SOCKET socket)
+{
+    if (socket >= eventConnectionCapacity) {
+        int capacity = (eventConnectionCapacity > 0) ? eventConnectionCapacity : 1024;
+        while (capacity <= socket) capacity *= 2;
+
+        eventConnections = realloc(eventConnections, capacity * sizeof(Connection*));
+        memset(&eventConnections[eventConnectionCapacity], 0,
+               (capacity - eventConnectionCapacity) * sizeof(Connection*));
+        eventConnectionCapacity = capacity;
+    }
+
+    Connection *conn = calloc(1, sizeof(Connection));
+    conn->socket = socket;
+    conn->events = EPOLLIN;
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+    if (epoll_ctl(eventPollFd, EPOLL_CTL_ADD, socket, &event) == -1) {
+        perror("openConnection epoll_ctl");
+        close(socket);
+        free(conn);
+        return NULL;
+    }
+    eventConnections[socket] = conn;
+    return conn;
+}
+
+
+static void closeConnection (Connection *conn)
+{
+    // close() allein entfernt den Socket nicht aus epoll, solange ein
+    // abgegebener Prozess noch eine Kopie des Deskriptors hat
+    eventConnections[conn->socket] = NULL;
+    epoll_ctl(eventPollFd, EPOLL_CTL_DEL, conn->socket, NULL);
+    close(conn->socket);
+
+    if (conn->input != NULL) ringBufferFree(conn->input);
+    if (conn->output != NULL) stringFree(conn->output);
+    if (conn->stream != NULL) responseStreamFree(conn->stream);
+    free(conn);
+
+    // Ein Deskriptor ist wieder frei, Verbindungen werden wieder angenommen
+    if (eventAcceptPaused) {
+        struct epoll_event event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+        epoll_ctl(eventPollFd, EPOLL_CTL_ADD, eventServerSocket, &event);
+        eventAcceptPaused = false;
+    }
+}
+
+
+/**
+ * Sendet so viel vom Ausgabepuffer wie der Socket ohne Blockieren annimmt.
+ * Der Rest wird gesendet, sobald epoll den Socket wieder als beschreibbar
+ * meldet. Gibt false zurück, wenn die Verbindung geschlossen wurde.
+ *
+ * @param conn - Zielobjekt
+ */
+static bool flushConnection (Connection *conn)
+{
+    while (conn->output != NULL && conn->outputOffset < stringLength(conn->output)) {
+        ssize_t size = send(conn->socket, &conn->output->cStr[conn->outputOffset],
+                            stringLength(conn->output) - conn->outputOffset, MSG_NOSIGNAL);
+        if (size == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeConnection(conn);
+            return false;
+        }
+        conn->outputOffset += size;
+    }
+
+    if (conn->output != NULL && conn->outputOffset == stringLength(conn->output)) {
+        stringFree(conn->output);
+        conn->output = NULL;
+        conn->outputOffset = 0;
+    }
+    if (conn->output == NULL && conn->closing) {
+        closeConnection(conn);
+        return false;
+    }
+
+    updateConnectionEvents(conn);
+    return true;
+}
+
+
+/**
+ * Hängt eine Antwort an den Ausgabepuffer einer Verbindung an. Ohne wartende
+ * Antworten wird direkt gesendet und nur ein nicht gesendeter Rest gepuffert.
+ * Gibt false zurück, wenn die Verbindung geschlossen wurde.
+ *
+ * @param conn - Zielobjekt
+ * @param response - Antwort
+ */
+static bool queueConnectionOutput (Connection *conn, String *response)
+{
+    size_t offset = 0;
+
+    if (conn->output == NULL) {
+        while (offset < stringLength(response)) {
+            ssize_t size = send(conn->socket, &response->cStr[offset],
+                                stringLength(response) - offset, MSG_NOSIGNAL);
+            if (size == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                closeConnection(conn);
+                return false;
+            }
+            offset += size;
+        }
+        if (offset == stringLength(response)) {
+            return flushConnection(conn);
+        }
+        conn->output = stringCreate("");
+    }
+
+    stringAppend(conn->output, &response->cStr[offset]);
+    return flushConnection(conn);
+}
+
+
+/**
+ * Gibt eine Verbindung an einen eigenen Prozess ab. Dieser sendet die bis
+ * dahin gesammelten Antworten, führt den angefangenen Befehl aus und bedient
+ * die Verbindung mit der restlichen Eingabe danach wie bei einem Prozess pro
+ * Verbindung. Der Worker schließt seine Kopie des Sockets.
+ *
+ * @param conn - Abzugebende Verbindung
+ * @param input - Eingabepuffer der Verbindung
+ * @param cmd - Angefangener Befehl
+ * @param response - Puffer für die Antwort
+ * @param batch - Gesammelte, noch nicht gesendete Antworten
+ */
+static void handOffConnection (Connection *conn, RingBuffer *input, Command *cmd,
+                               String *response, String *batch)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGCHLD, SIG_DFL);
+
+        // Die übrigen Verbindungen gehören weiter dem Worker
+        for (int fd = 0; fd < eventConnectionCapacity; fd++) {
+            if (eventConnections[fd] != NULL && fd != conn->socket) close(fd);
+        }
+        close(eventPollFd);
+        close(eventServerSocket);
+
+        SOCKET socket = conn->socket;
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) & ~O_NONBLOCK);
+        processSocket = socket;
+        prctl(PR_SET_NAME, (unsigned long)"kvsvr(cmd-cli)");
+
+        if (conn->output != NULL) {
+            send(socket, &conn->output->cStr[conn->outputOffset],
+                 stringLength(conn->output) - conn->outputOffset, MSG_NOSIGNAL);
+        }
+        commandExecute(cmd);
+        commandFormatResponseMessage(cmd, response);
+        stringAppend(batch, response->cStr);
+        send(socket, batch->cStr, stringLength(batch), MSG_NOSIGNAL);
+
+        runCommandConnection(socket, input);
+        close(socket);
+        exit(EXIT_SUCCESS);
+    }
+    if (pid == -1) {
+        perror("handOffConnection fork");
+    }
+    closeConnection(conn);
+}
+
+
+/**
+ * Verarbeitet alle vollständigen Befehle im Eingabepuffer einer Verbindung.
+ * Ihre Antworten werden gemeinsam gesendet. Eine unvollständige Zeile, oder
+ * die Eingabe hinter einem gestreamten Befehl, bleibt im Eingabepuffer der
+ * Verbindung. Ohne solchen Rest benutzen alle Verbindungen denselben
+ * Eingabepuffer des Workers.
+ *
+ * @param conn - Zielobjekt
+ * @param input - Eingabepuffer mit den empfangenen Daten
+ * @param cmd - Befehlsobjekt des Workers
+ * @param line - Puffer für die aktuelle Zeile
+ * @param response - Puffer für eine einzelne Antwort
+ * @param batch - Puffer für die gesammelten Antworten
+ */
+static void processConnectionInput (Connection *conn, RingBuffer *input, Command *cmd,
+                                    String *line, String *response, String *batch)
+{
+    // Der Eingabepuffer wird von der Verbindung gelöst, da diese beim
+    // Verarbeiten geschlossen oder abgegeben werden kann
+    conn->input = NULL;
+    bool open = true;
+    int state;
+
+    do {
+        state = processCommandBatch(conn->socket, input, cmd, line, response, batch, true);
+        if (state == BATCH_DEDICATED) {
+            handOffConnection(conn, input, cmd, response, batch);
+            open = false;
+        }
+        else {
+            if (state == BATCH_STREAM) {
+                // Die Verbindung übernimmt den Stream, bis die Antwort gesendet ist
+                conn->stream = cmd->stream;
+                cmd->stream = (eventSpareStream != NULL) ? eventSpareStream : responseStreamCreate();
+                eventSpareStream = NULL;
+            }
+            conn->closing = (state == BATCH_QUIT);
+            if (stringLength(batch) > 0 || conn->closing) {
+                open = queueConnectionOutput(conn, batch);
+            }
+            else {
+                updateConnectionEvents(conn);
+            }
+        }
+        stringCopy(batch, "");
+    } while (open && state == BATCH_FULL);
+
+    if (open && !ringBufferIsEmpty(input)) {
+        conn->input = input;
+        if (input == eventInput) {
+            eventInput = ringBufferCreate(RECV_RING_SIZE, RECV_BUFFER_SIZE - 1);
+        }
+    }
+    else if (input == eventInput) {
+        ringBufferClear(input);
+    }
+    else {
+        ringBufferFree(input);
+    }
+}
+
+
+/**
+ * Liest die verfügbaren Daten einer Verbindung und verarbeitet alle darin
+ * vollständigen Befehle.
+ *
+ * @param conn - Zielobjekt
+ * @param cmd - Befehlsobjekt des Workers
+ * @param line - Puffer für die aktuelle Zeile
+ * @param response - Puffer für eine einzelne Antwort
+ * @param batch - Puffer für die gesammelten Antworten
+ */
+static void readConnection (Connection *conn, Command *cmd, String *line, String *response, String *batch)
+{
+    RingBuffer *input = (conn->input != NULL) ? conn->input : eventInput;
+
+    ssize_t size = receiveIntoRingBuffer(conn->socket, input);
+    if (size == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (size <= 0) {
+        closeConnection(conn);
+        return;
+    }
+    if (conn->closing) { // Nach QUIT wird nichts mehr verarbeitet
+        ringBufferClear(input);
+        return;
+    }
+
+    processConnectionInput(conn, input, cmd, line, response, batch);
+}
+
+
+/**
+ * Sendet den nächsten Abschnitt einer gestreamten Antwort, nachdem der
+ * vorherige vollständig gesendet wurde. Pro Aufruf wird nur ein Abschnitt
+ * geschrieben, damit die übrigen Verbindungen des Workers nicht warten. Ist
+ * die Antwort vollständig, werden die zurückgehaltenen Befehle verarbeitet.
+ *
+ * @param conn - Zielobjekt
+ * @param cmd - Befehlsobjekt des Workers
+ * @param line - Puffer für die aktuelle Zeile
+ * @param response - Puffer für eine einzelne Antwort
+ * @param batch - Puffer für die gesammelten Antworten
+ */
+static void writeConnectionStream (Connection *conn, Command *cmd, String *line, String *response, String *batch)
+{
+    bool streaming = responseStreamWrite(conn->stream, batch, SEND_BATCH_SIZE);
+    if (!streaming) {
+        if (eventSpareStream == NULL) {
+            eventSpareStream = conn->stream;
+        }
+        else {
+            responseStreamFree(conn->stream);
+        }
+        conn->stream = NULL;
+    }
+
+    bool open = queueConnectionOutput(conn, batch);
+    stringCopy(batch, "");
+
+    if (open && !streaming && conn->input != NULL) {
+        processConnectionInput(conn, conn->input, cmd, line, response, batch);
+    }
+}
+
+
+/**
+ * Nimmt alle wartenden Verbindungen an. Sind keine Deskriptoren mehr frei,
+ * wird der Server-Socket bis zum Schließen einer Verbindung abgemeldet, da
+ * epoll ihn sonst ununterbrochen als lesbar meldet.
+ *
+ */
+static void acceptConnections ()
+{
+    for (;;) {
+        SOCKET socket = accept(eventServerSocket, NULL, NULL);
+        if (socket == -1) {
+            if (errno == EMFILE || errno == ENFILE) {
+                perror("acceptConnections accept");
+                epoll_ctl(eventPollFd, EPOLL_CTL_DEL, eventServerSocket, NULL);
+                eventAcceptPaused = true;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+                     errno != ECONNABORTED) {
+                perror("acceptConnections accept");
+            }
+            return;
+        }
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+        openConnection(socket);
+    }
+}
+
+
+/**
+ * Eintrittsfunktion eines Command-Workers mit Event-Loop. Alle Sockets sind
+ * nicht-blockierend, epoll meldet welche Verbindungen lesbar oder wieder
+ * beschreibbar sind. Mehrere Worker teilen sich den Server-Socket,
+ * EPOLLEXCLUSIVE weckt für eine neue Verbindung nur einen von ihnen.
+ *
+ * @param name - Server-Name
+ * @param serverSocket - Gemeinsamer "Rendezvous-Descriptor"
+ */
+void runCommandEventLoop (const char* name, SOCKET serverSocket)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_IGN); // Prozesse abgegebener Verbindungen
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    prctl(PR_SET_NAME, (unsigned long)"kvsvr(cmd-evl)");
+    raiseFileLimit();
+
+    eventServerSocket = serverSocket;
+    fcntl(serverSocket, F_SETFL, fcntl(serverSocket, F_GETFL) | O_NONBLOCK);
+
+    eventPollFd = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+    if (eventPollFd == -1 || epoll_ctl(eventPollFd, EPOLL_CTL_ADD, serverSocket, &event) == -1) {
+        perror("runCommandEventLoop epoll");
+        exit(EXIT_FAILURE);
+    }
+    printf("%s-Worker %d running event loop\n", name, getpid());
+
+    eventInput = ringBufferCreate(RECV_RING_SIZE, RECV_BUFFER_SIZE - 1);
+    String *line = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    String *response = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    String *batch = stringCreateWithCapacity("", RECV_BUFFER_SIZE);
+    Command *cmd = commandCreate();
+    cmd->stream = responseStreamCreate();
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    for (;;) {
+        int count = epoll_wait(eventPollFd, events, EVENT_LOOP_MAX_EVENTS, -1);
+        if (count == -1) {
+            if (errno == EINTR) continue;
+            perror("runCommandEventLoop epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < count; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                acceptConnections();
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flushConnection(conn)) {
+                continue;
+            }
+            if (conn->stream != NULL) {
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    closeConnection(conn);
+                }
+                else if (conn->output == NULL) {
+                    writeConnectionStream(conn, cmd, line, response, batch);
+                }
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readConnection(conn, cmd, line, response, batch);
+            }
+        }
+    }
+}
@@ -7,8 +7,9 @@
  * Pub/Sub System mit einem Observer Prozess pro Subscriber
  * der die Benachrichtigungen aus einer Message Queue liest und
  * ggf. über den Socket an den Client weiterleitet. Benutzt eigene Ids
- * die als Bit-Maske gespeichert sind, um die Datenmenge gering zu halten,
- * trotz fehlender Dynamik auf dem Shared Memory Segment.
+ * die als Bit-Maske gespeichert sind, um die Datenmenge gering zu halten.
+ * Die Bit-Masken liegen in Chunks, die genauso groß wie die Storage-Chunks
+ * sind und erst bei der ersten Subscription eines Eintrags erzeugt werden.
  *
  */
 
@@ -17,8 +18,10 @@ static int observerPid = 0;
 static RecordSubscriberMask subscriberId = 0;
 
 static int shmNewsletterSegmentId = 0;
+static NewsletterHeader *newsletterHeader = NULL;
 static RecordSubscriberMask *subscriberRegistry = NULL;
-static RecordSubscriberMask *subscribers = NULL;
+// Lokal eingehängte Chunks (werden bei Bedarf nachgeladen)
+static RecordSubscriberMask *subscriberChunks[STORAGE_MAX_CHUNKS];
 
 static int msqNotifierId = 0;
 
@@ -27,9 +30,7 @@ void initModuleNewsletter ()
 {
     registerCommandEntry("SUB", 1, false, eventCommandSubscribe);
 
-    int segmentSize = sizeof(RecordSubscriberMask) * STORAGE_ENTRY_SIZE + 1;
-
-    shmNewsletterSegmentId = shmget(IPC_PRIVATE, segmentSize, IPC_CREAT | SHM_R | SHM_W);
+    shmNewsletterSegmentId = shmget(IPC_PRIVATE, sizeof(NewsletterHeader), IPC_CREAT | SHM_R | SHM_W);
     if (shmNewsletterSegmentId == -1) {
         fatalError("initModuleNewsletter shmget");
     }
@@ -37,9 +38,9 @@ void initModuleNewsletter ()
 
     // Hängt das Shared-Memory-Segment in den lokalen Adressenraum ein
     // (Das Einhängen wird beim Erzeugen von Kind-Prozessen vererbt)
-    subscriberRegistry = shmat(shmNewsletterSegmentId, NULL, 0);
-    subscribers = &subscriberRegistry[1];
-    memset(subscriberRegistry, 0, segmentSize);
+    newsletterHeader = shmat(shmNewsletterSegmentId, NULL, 0);
+    subscriberRegistry = &newsletterHeader->subscriberRegistry;
+    memset(newsletterHeader, 0, sizeof(NewsletterHeader));
 
     msqNotifierId = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
 }
@@ -49,8 +50,16 @@ void freeModuleNewsletter ()
 {
     msgctl(msqNotifierId, IPC_RMID, NULL);
 
+    // Löscht alle Chunks, auch die von Client-Prozessen erzeugten
+    for (int i = 0; i < STORAGE_MAX_CHUNKS; i++) {
+        if (subscriberChunks[i] != NULL) shmdt(subscriberChunks[i]);
+        if (newsletterHeader->chunkSegmentIds[i] != 0) {
+            shmctl(newsletterHeader->chunkSegmentIds[i] - 1, IPC_RMID, NULL);
+        }
+    }
+
     // Hängt das Shared-Memory-Segment aus dem lokalen Adressenraum aus
-    shmdt(subscribers);
+    shmdt(newsletterHeader);
     // Löscht das Shared-Memory-Segment
     shmctl(shmNewsletterSegmentId, IPC_RMID, NULL);
 
@@ -72,6 +81,47 @@ void eventCommandSubscribe (Command *cmd)
 }
 
 
+/**
+ * Liefert die Subscriber-Bitmaske eines Storage-Eintrags. Der zugehörige
+ * Chunk wird bei Bedarf eingehängt oder (mit "create") erzeugt. Existiert
+ * der Chunk nicht, hat der Eintrag keine Subscriber und es wird NULL
+ * zurückgegeben.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param recordIndex - Betreffender Eintrag
+ * @param create - Chunk ggf. erzeugen
+ */
+static RecordSubscriberMask* getSubscriberMask (int recordIndex, bool create)
+{
+    int chunk = (unsigned)recordIndex / STORAGE_CHUNK_SIZE;
+
+    if (subscriberChunks[chunk] == NULL) {
+        // Segment-Ids werden um 1 verschoben gespeichert, 0 heisst "kein Chunk"
+        int segmentId = newsletterHeader->chunkSegmentIds[chunk] - 1;
+        if (segmentId == -1) {
+            if (!create) return NULL;
+
+            segmentId = shmget(IPC_PRIVATE, sizeof(RecordSubscriberMask) * STORAGE_CHUNK_SIZE,
+                               IPC_CREAT | SHM_R | SHM_W);
+            if (segmentId == -1) {
+                perror("getSubscriberMask shmget");
+                return NULL;
+            }
+            newsletterHeader->chunkSegmentIds[chunk] = segmentId + 1;
+        }
+
+        RecordSubscriberMask *address = shmat(segmentId, NULL, 0);
+        if (address == (void*)-1) {
+            perror("getSubscriberMask shmat");
+            return NULL;
+        }
+        subscriberChunks[chunk] = address;
+    }
+
+    return &subscriberChunks[chunk][(unsigned)recordIndex % STORAGE_CHUNK_SIZE];
+}
+
+
 /**
  * Schickt eine Nachricht durch die Message Queue an jeden Observer Prozess
  * dessen zugehörige Subscriber Id einen Eintrag in den Subscriptions hat,
@@ -85,18 +135,23 @@ void eventCommandSubscribe (Command *cmd)
 void notifyAllObservers (int notificationId, int recordIndex, const char* key, const char* value)
 {
     if (shmNewsletterSegmentId == 0) return; // Modul nicht initialisiert
-    
+
+    RecordSubscriberMask *subscribers = getSubscriberMask(recordIndex, false);
+    if (subscribers == NULL || *subscribers == 0) return;
+
     MsqBuffer msqBuffer;
     msqBuffer.newsletter.notification = notificationId;
-    strcpy(msqBuffer.newsletter.key, key);
-    strcpy(msqBuffer.newsletter.value, value);
+    strncpy(msqBuffer.newsletter.key, key, NEWSLETTER_KEY_SIZE - 1);
+    strncpy(msqBuffer.newsletter.value, value, NEWSLETTER_VALUE_SIZE - 1);
+    msqBuffer.newsletter.key[NEWSLETTER_KEY_SIZE - 1] = '\0';
+    msqBuffer.newsletter.value[NEWSLETTER_VALUE_SIZE - 1] = '\0';
 
     for (int i = 0; i < NEWSLETTER_MAX_SUBS; i++) {
-        msqBuffer.subscriberId = subscribers[recordIndex] & ((RecordSubscriberMask)1 << i);
+        msqBuffer.subscriberId = *subscribers & ((RecordSubscriberMask)1 << i);
 
         if (msqBuffer.subscriberId != 0) {
             if (notificationId == NL_NOTIFICATION_DEL) {
-                subscribers[recordIndex] &= ~msqBuffer.subscriberId;
+                *subscribers &= ~msqBuffer.subscriberId;
 
                 // Wenn der Subscriber selbst einen seiner beobachteten Einträge löscht,
                 // soll er keine DEL Notification bekommen, aber der Observer muss trotzdem
@@ -134,16 +189,17 @@ int subscribeStorageRecord (const char* key)
         return 3; // key_nonexistent
     }
 
-    if (subscriberId == 0 && !startStorageObserver()) {
+    RecordSubscriberMask *subscribers = getSubscriberMask(recordIndex, true);
+    if (subscribers == NULL || (subscriberId == 0 && !startStorageObserver())) {
         leaveCriticalSection(WRITE_ACCESS);
         return 2; // subscribers_full
     }
-    if (subscriberId & subscribers[recordIndex]) {
+    if (subscriberId & *subscribers) {
         leaveCriticalSection(WRITE_ACCESS);
         return 1; // already_subscribed
     }
 
-    subscribers[recordIndex] |= subscriberId;
+    *subscribers |= subscriberId;
 
     MsqBuffer msqBuffer = {.subscriberId=subscriberId,.newsletter={.notification=NL_NOTIFICATION_SUB}};
     if (msgsnd(msqNotifierId, &msqBuffer, sizeof(Newsletter), 0) < 0) {
@@ -181,6 +237,31 @@ bool startStorageObserver ()
 }
 
 
+/**
+ * Beendet den Observer-Prozess und gibt damit alle Subscriptions des Clients
+ * frei. Für Worker-Prozesse, die nach dem Ende einer Verbindung weitere
+ * Clients bedienen.
+ *
+ */
+void stopStorageObserver ()
+{
+    // Verhindert dass "sigChldNoSubscriptions" den Observer dazwischen abholt
+    sigset_t mask, oldMask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &oldMask);
+
+    if (observerPid != 0) {
+        kill(observerPid, SIGTERM);
+        waitpid(observerPid, NULL, 0);
+        observerPid = 0;
+        subscriberId = 0;
+    }
+
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+
 void sigChldNoSubscriptions ()
 {
     if (waitpid(observerPid, NULL, WNOHANG) > 0) {
@@ -224,7 +305,7 @@ void runStorageObserver ()
         }
 
         if (*commandName != '\0') {
-            stringCopy(command->name, commandName);
+            commandSetName(command, commandName);
             stringCopy(command->key, msqBuffer.newsletter.key);
             stringCopy(command->value, msqBuffer.newsletter.value);
             responseRecordsFree(command->responseRecords);
@@ -258,8 +339,13 @@ void sigTermCleanupSubscriptions ()
 
     if (subscriptionCounter > 0) {
         // Entfernt alle verbleibenden Subscriptions aus der Tabelle
-        for (int i = 0; i < STORAGE_ENTRY_SIZE; i++) {
-            subscribers[i] &= ~subscriberId;
+        for (int i = 0; i < STORAGE_MAX_CHUNKS; i++) {
+            if (newsletterHeader->chunkSegmentIds[i] == 0) continue;
+
+            RecordSubscriberMask *subscribers = getSubscriberMask(i * STORAGE_CHUNK_SIZE, false);
+            for (int j = 0; subscribers != NULL && j < STORAGE_CHUNK_SIZE; j++) {
+                subscribers[j] &= ~subscriberId;
+            }
         }
     }
 
@@ -0,0 +1,173 @@
+#include "ringBuffer.h"
+
+
+/*
+ * Ringpuffer für zeilenbasierte Protokolle
+ *
+ * Nimmt die empfangenen Bytes einer Verbindung auf und liefert daraus
+ * vollständige Zeilen. Der freie Platz wird als bis zu zwei Segmente
+ * herausgegeben, damit ein einzelnes readv() den Puffer auch über das Ende
+ * hinweg füllen kann. Zeilen können beliebig auf Pakete verteilt sein, ein
+ * Paket kann beliebig viele Zeilen enthalten.
+ *
+ */
+
+
+/**
+ * Erzeugt einen neuen Ringpuffer auf dem Heap-Speicher.
+ *
+ * @param capacity - Kapazität in Bytes (Zweierpotenz, größer als maxLineLength)
+ * @param maxLineLength - Längere Zeilen werden verworfen
+ */
+RingBuffer* ringBufferCreate (size_t capacity, size_t maxLineLength)
+{
+    RingBuffer *ring = malloc(sizeof(RingBuffer));
+
+    ring->data = malloc(capacity);
+    ring->capacity = capacity;
+    ring->maxLineLength = maxLineLength;
+    ringBufferClear(ring);
+
+    return ring;
+}
+
+
+/**
+ * Gibt den Heap-Speicher des Ringpuffers wieder frei.
+ *
+ * @param ring - Zielobjekt
+ */
+void ringBufferFree (RingBuffer *ring)
+{
+    free(ring->data);
+    free(ring);
+}
+
+
+void ringBufferClear (RingBuffer *ring)
+{
+    ring->readPos = 0;
+    ring->writePos = 0;
+    ring->scanPos = 0;
+    ring->discarding = false;
+}
+
+
+size_t ringBufferLength (const RingBuffer *ring)
+{
+    return ring->writePos - ring->readPos;
+}
+
+
+/**
+ * Prüft ob der Puffer weder Daten enthält noch den Rest einer zu langen
+ * Zeile verwirft.
+ *
+ * @param ring - Zielobjekt
+ */
+bool ringBufferIsEmpty (const RingBuffer *ring)
+{
+    return ringBufferLength(ring) == 0 && !ring->discarding;
+}
+
+
+/**
+ * Liefert den freien Platz des Puffers als Segmente für readv(). Gibt die
+ * Anzahl der Segmente zurück (0 wenn der Puffer voll ist).
+ *
+ * @param ring - Zielobjekt
+ * @param segments - Ausgabe der freien Segmente
+ */
+int ringBufferGetFreeSegments (RingBuffer *ring, struct iovec segments[2])
+{
+    size_t free = ring->capacity - ringBufferLength(ring);
+    if (free == 0) return 0;
+
+    size_t start = ring->writePos & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+    if (first > free) first = free;
+
+    segments[0].iov_base = &ring->data[start];
+    segments[0].iov_len = first;
+    if (first == free) return 1;
+
+    segments[1].iov_base = ring->data;
+    segments[1].iov_len = free - first;
+    return 2;
+}
+
+
+/**
+ * Übernimmt "length" in die freien Segmente geschriebene Bytes.
+ *
+ * @param ring - Zielobjekt
+ * @param length - Anzahl der geschriebenen Bytes
+ */
+void ringBufferCommitWrite (RingBuffer *ring, size_t length)
+{
+    ring->writePos += length;
+}
+
+
+/**
+ * Entnimmt die nächste vollständige Zeile. Zeilen enden mit '\n' oder einer
+ * String-Terminierung, das Zeilenende gehört nicht zur Zeile ("\r" wird
+ * beim Interpretieren als Leerzeichen entfernt). Leere Zeilen, die mit einer
+ * String-Terminierung enden, werden übersprungen (C-Clients schicken die
+ * Terminierung oft nach dem Zeilenumbruch mit). Hat folgende Rückgabewerte:
+ * - RING_LINE_COMPLETE Eine Zeile wurde nach "line" kopiert
+ * - RING_LINE_NONE Keine vollständige Zeile im Puffer
+ * - RING_LINE_EXCEEDED Eine Zeile ist länger als "maxLineLength", sie wird
+ *   bis zu ihrem Ende verworfen.
+ *
+ * @param ring - Zielobjekt
+ * @param line - Ausgabe der Zeile
+ */
+int ringBufferReadLine (RingBuffer *ring, String *line)
+{
+    size_t mask = ring->capacity - 1;
+
+    for (;;) {
+        size_t end = (ring->scanPos > ring->readPos) ? ring->scanPos : ring->readPos;
+        while (end < ring->writePos && ring->data[end & mask] != '\n' &&
+               ring->data[end & mask] != '\0') {
+            end++;
+        }
+
+        if (end == ring->writePos) {
+            ring->scanPos = end;
+            if (ring->discarding) {
+                ring->readPos = end;
+            }
+            else if (end - ring->readPos > ring->maxLineLength) {
+                ring->readPos = end;
+                ring->discarding = true;
+                return RING_LINE_EXCEEDED;
+            }
+            return RING_LINE_NONE;
+        }
+
+        size_t length = end - ring->readPos;
+        bool skip = ring->discarding || (length == 0 && ring->data[end & mask] == '\0');
+        if (!skip && length > ring->maxLineLength) {
+            ring->readPos = end + 1;
+            return RING_LINE_EXCEEDED;
+        }
+
+        if (!skip) {
+            if (line->capacity < length) {
+                stringReserve(line, length);
+            }
+            size_t start = ring->readPos & mask;
+            size_t first = (start + length > ring->capacity) ? ring->capacity - start : length;
+            memcpy(line->cStr, &ring->data[start], first);
+            memcpy(&line->cStr[first], ring->data, length - first);
+            line->cStr[length] = '\0';
+            line->length = length;
+        }
+
+        ring->readPos = end + 1;
+        ring->discarding = false;
+        if (!skip) return RING_LINE_COMPLETE;
+    }
+}
@@ -0,0 +1,379 @@
+#include "slab.h"
+
+
+/*
+ * Slab-Allokator für Shared Memory
+ *
+ * Vergibt Blöcke variabler Größe aus Shared-Memory Chunks, damit Einträge
+ * nur so viel Speicher belegen wie ihre Nutzdaten. Die Blockgrößen sind in
+ * Größenklassen eingeteilt, freigegebene Blöcke kommen in eine Free-List pro
+ * Klasse. Neue Blöcke werden am Ende des letzten Chunks abgeschnitten.
+ * Blöcke werden über Offsets referenziert, da jeder Prozess die Chunks an
+ * einer anderen Adresse einhängt.
+ *
+ */
+
+
+static int shmSlabSegmentId = 0;
+
+static SlabHeader *slabHeader = NULL;
+// Lokal eingehängte Chunks (werden bei Bedarf nachgeladen)
+static char *slabChunks[SLAB_MAX_CHUNKS];
+
+
+void initModuleSlab ()
+{
+    // Neue Segmente sind immer mit Nullen initialisiert
+    shmSlabSegmentId = shmget(IPC_PRIVATE, sizeof(SlabHeader), IPC_CREAT | SHM_R | SHM_W);
+    if (shmSlabSegmentId == -1) {
+        fatalError("initModuleSlab shmget");
+    }
+    slabHeader = shmat(shmSlabSegmentId, NULL, 0);
+
+    printf("Slab shared memory segment created (Id %d).\n", shmSlabSegmentId);
+}
+
+
+void freeModuleSlab ()
+{
+    if (slabHeader == NULL) return; // Modul nicht initialisiert
+
+    // Löscht alle Chunks, auch die von Client-Prozessen erzeugten
+    for (int i = 0; i < slabHeader->chunkCount; i++) {
+        if (slabChunks[i] != NULL) shmdt(slabChunks[i]);
+        shmctl(slabHeader->chunkSegmentIds[i], IPC_RMID, NULL);
+    }
+    printf("Slab chunks deleted (%d chunks, %ld bytes allocated).\n",
+           slabHeader->chunkCount, slabHeader->allocatedBytes);
+
+    shmdt(slabHeader);
+    shmctl(shmSlabSegmentId, IPC_RMID, NULL);
+    printf("Slab shared memory segment deleted (Id %d).\n", shmSlabSegmentId);
+}
+
+
+/**
+ * Ermittelt die Größenklasse für eine Blockgröße.
+ *
+ * @param size - Blockgröße in Bytes (1 bis SLAB_MAX_BLOCK_SIZE)
+ */
+static int getSlabClass (unsigned int size)
+{
+    if (size <= 128) {
+        return (int)((size + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT) - 1;
+    }
+
+    int power = 31 - __builtin_clz(size - 1); // 2^power < size <= 2^(power+1)
+    unsigned int step = (1u << power) / 4;
+    unsigned int quarter = (size - (1u << power) + step - 1) / step; // 1..4
+
+    return 16 + (power - 7) * 4 + (int)quarter - 1;
+}
+
+
+/**
+ * Liefert die Blockgröße einer Größenklasse.
+ *
+ * @param slabClass - Größenklasse
+ */
+static unsigned int getSlabClassSize (int slabClass)
+{
+    if (slabClass < 16) {
+        return (unsigned int)(slabClass + 1) * SLAB_ALIGNMENT;
+    }
+
+    int power = 7 + (slabClass - 16) / 4;
+    unsigned int quarter = (slabClass - 16) % 4 + 1;
+
+    return (1u << power) + quarter * ((1u << power) / 4);
+}
+
+
+/**
+ * Liefert die tatsächlich belegte Größe eines Blocks mit "size" Bytes.
+ *
+ * @param size - Angeforderte Blockgröße in Bytes
+ */
+unsigned int getSlabBlockSize (unsigned int size)
+{
+    return getSlabClassSize(getSlabClass(size));
+}
+
+
+static char* attachSlabChunk (int chunk)
+{
+    char *address = shmat(slabHeader->chunkSegmentIds[chunk], NULL, 0);
+    if (address == (void*)-1) {
+        perror("attachSlabChunk shmat");
+        exit(EXIT_FAILURE);
+    }
+    slabChunks[chunk] = address;
+    return address;
+}
+
+
+/**
+ * Wandelt eine Block-Referenz in eine Adresse im lokalen Adressenraum um.
+ * Der Chunk wird bei Bedarf eingehängt.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param ref - Block-Referenz
+ */
+void* getSlabBlockAddress (SlabRef ref)
+{
+    unsigned long offset = (unsigned long)(ref - 1) * SLAB_ALIGNMENT;
+    int chunk = (int)(offset / SLAB_CHUNK_SIZE);
+
+    char *address = slabChunks[chunk];
+    if (address == NULL) {
+        address = attachSlabChunk(chunk);
+    }
+    return &address[offset % SLAB_CHUNK_SIZE];
+}
+
+
+/**
+ * Wie "getSlabBlockAddress", prüft aber ob die Referenz auf einen Block der
+ * angegebenen Größe in einem existierenden Chunk zeigt, sonst NULL.
+ * Für Leser ohne Lock, die eine halb geschriebene Referenz gelesen haben können.
+ *
+ * @param ref - Block-Referenz
+ * @param size - Größe des Blocks in Bytes
+ */
+void* getSlabBlockAddressChecked (SlabRef ref, unsigned int size)
+{
+    if (ref == SLAB_NULL || size > SLAB_MAX_BLOCK_SIZE) return NULL;
+
+    unsigned long offset = (unsigned long)(ref - 1) * SLAB_ALIGNMENT;
+    int chunk = (int)(offset / SLAB_CHUNK_SIZE);
+    if (chunk >= __atomic_load_n(&slabHeader->chunkCount, __ATOMIC_ACQUIRE) ||
+            offset % SLAB_CHUNK_SIZE + size > SLAB_CHUNK_SIZE) {
+        return NULL;
+    }
+
+    char *address = slabChunks[chunk];
+    if (address == NULL) {
+        address = attachSlabChunk(chunk);
+    }
+    return &address[offset % SLAB_CHUNK_SIZE];
+}
+
+
+static SlabRef makeSlabRef (int chunk, unsigned int offset)
+{
+    return (SlabRef)(((unsigned long)chunk * SLAB_CHUNK_SIZE + offset) / SLAB_ALIGNMENT + 1);
+}
+
+
+/**
+ * Verteilt den Rest des letzten Chunks auf die Free-Lists, bevor ein
+ * neuer Chunk angelegt wird, damit kein Speicher verloren geht.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ */
+static void releaseSlabChunkRest ()
+{
+    int chunk = slabHeader->chunkCount - 1;
+
+    while (SLAB_CHUNK_SIZE - slabHeader->chunkOffset >= SLAB_ALIGNMENT) {
+        unsigned int rest = SLAB_CHUNK_SIZE - slabHeader->chunkOffset;
+        if (rest > SLAB_MAX_BLOCK_SIZE) rest = SLAB_MAX_BLOCK_SIZE;
+
+        int slabClass = getSlabClass(rest);
+        if (getSlabClassSize(slabClass) > rest) {
+            slabClass--;
+        }
+
+        SlabRef ref = makeSlabRef(chunk, slabHeader->chunkOffset);
+        *(SlabRef*)getSlabBlockAddress(ref) = slabHeader->freeLists[slabClass];
+        slabHeader->freeLists[slabClass] = ref;
+
+        slabHeader->chunkOffset += getSlabClassSize(slabClass);
+    }
+}
+
+
+/**
+ * Legt einen neuen Chunk an, aus dem neue Blöcke abgeschnitten werden.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ */
+static bool growSlab ()
+{
+    int chunk = slabHeader->chunkCount;
+    if (chunk == SLAB_MAX_CHUNKS) {
+        return false;
+    }
+
+    int segmentId = shmget(IPC_PRIVATE, SLAB_CHUNK_SIZE, IPC_CREAT | SHM_R | SHM_W);
+    if (segmentId == -1) {
+        perror("growSlab shmget");
+        return false;
+    }
+
+    if (chunk > 0) {
+        releaseSlabChunkRest();
+    }
+
+    slabHeader->chunkSegmentIds[chunk] = segmentId;
+    attachSlabChunk(chunk);
+    __atomic_store_n(&slabHeader->chunkCount, chunk + 1, __ATOMIC_RELEASE);
+    slabHeader->chunkOffset = 0;
+
+    return true;
+}
+
+
+/**
+ * Reserviert einen Block mit mindestens "size" Bytes. Bei Fehlschlag
+ * (zu groß oder kein Speicher mehr) ist der Rückgabewert SLAB_NULL.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param size - Blockgröße in Bytes
+ */
+SlabRef allocateSlabBlock (unsigned int size)
+{
+    if (size == 0 || size > SLAB_MAX_BLOCK_SIZE) {
+        return SLAB_NULL;
+    }
+
+    int slabClass = getSlabClass(size);
+    unsigned int blockSize = getSlabClassSize(slabClass);
+
+    // Zuletzt freigegebenen Block der Größenklasse wiederverwenden
+    SlabRef ref = slabHeader->freeLists[slabClass];
+    if (ref != SLAB_NULL) {
+        slabHeader->freeLists[slabClass] = *(SlabRef*)getSlabBlockAddress(ref);
+        slabHeader->allocatedBytes += blockSize;
+        return ref;
+    }
+
+    // Sonst einen neuen Block am Ende des letzten Chunks abschneiden
+    if (slabHeader->chunkCount == 0 ||
+            SLAB_CHUNK_SIZE - slabHeader->chunkOffset < blockSize) {
+        if (!growSlab()) {
+            return SLAB_NULL;
+        }
+    }
+
+    ref = makeSlabRef(slabHeader->chunkCount - 1, slabHeader->chunkOffset);
+    slabHeader->chunkOffset += blockSize;
+    slabHeader->allocatedBytes += blockSize;
+
+    return ref;
+}
+
+
+/**
+ * Gibt einen Block wieder frei. "size" muss der bei der Reservierung
+ * angeforderten Größe entsprechen.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param ref - Block-Referenz
+ * @param size - Blockgröße in Bytes
+ */
+void freeSlabBlock (SlabRef ref, unsigned int size)
+{
+    if (ref == SLAB_NULL) return;
+
+    int slabClass = getSlabClass(size);
+
+    *(SlabRef*)getSlabBlockAddress(ref) = slabHeader->freeLists[slabClass];
+    slabHeader->freeLists[slabClass] = ref;
+    slabHeader->allocatedBytes -= getSlabClassSize(slabClass);
+}
+
+
+/**
+ * Kopiert alle belegten Chunks in privaten Speicher des Prozesses, damit die
+ * Blöcke nach dem Verlassen des kritischen Abschnitts ohne Lock gelesen
+ * werden können (Snapshot). Schon reservierte Kopien werden weiterverwendet.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param copy - Zielobjekt (beim ersten Aufruf mit Nullen initialisiert)
+ */
+bool copySlabChunks (SlabCopy *copy)
+{
+    int chunkCount = slabHeader->chunkCount;
+
+    for (int i = 0; i < chunkCount; i++) {
+        if (copy->chunks[i] == NULL) {
+            copy->chunks[i] = malloc(SLAB_CHUNK_SIZE);
+            if (copy->chunks[i] == NULL) {
+                perror("copySlabChunks malloc");
+                return false;
+            }
+        }
+        char *address = slabChunks[i];
+        if (address == NULL) {
+            address = attachSlabChunk(i);
+        }
+        memcpy(copy->chunks[i], address, (i == chunkCount - 1) ? slabHeader->chunkOffset : SLAB_CHUNK_SIZE);
+    }
+    copy->chunkCount = chunkCount;
+    return true;
+}
+
+
+/**
+ * Kopiert einen einzelnen Block an dieselbe Position in der Kopie der Chunks
+ * (inkrementelle Snapshots). Fehlende Chunks der Kopie werden reserviert.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param copy - Kopie der Chunks
+ * @param ref - Block-Referenz
+ * @param size - Zu kopierende Bytes
+ */
+bool copySlabBlock (SlabCopy *copy, SlabRef ref, unsigned int size)
+{
+    unsigned long offset = (unsigned long)(ref - 1) * SLAB_ALIGNMENT;
+    int chunk = (int)(offset / SLAB_CHUNK_SIZE);
+
+    if (copy->chunks[chunk] == NULL) {
+        copy->chunks[chunk] = malloc(SLAB_CHUNK_SIZE);
+        if (copy->chunks[chunk] == NULL) {
+            perror("copySlabBlock malloc");
+            return false;
+        }
+    }
+    memcpy(&copy->chunks[chunk][offset % SLAB_CHUNK_SIZE], getSlabBlockAddress(ref), size);
+    if (chunk >= copy->chunkCount) {
+        copy->chunkCount = chunk + 1;
+    }
+    return true;
+}
+
+
+/**
+ * Wie "getSlabBlockAddress", aber in einer Kopie der Chunks.
+ *
+ * @param copy - Kopie der Chunks
+ * @param ref - Block-Referenz
+ */
+void* getSlabCopyAddress (const SlabCopy *copy, SlabRef ref)
+{
+    unsigned long offset = (unsigned long)(ref - 1) * SLAB_ALIGNMENT;
+    return &copy->chunks[offset / SLAB_CHUNK_SIZE][offset % SLAB_CHUNK_SIZE];
+}
+
+
+void freeSlabCopy (SlabCopy *copy)
+{
+    for (int i = 0; i < SLAB_MAX_CHUNKS; i++) {
+        free(copy->chunks[i]);
+        copy->chunks[i] = NULL;
+    }
+    copy->chunkCount = 0;
+}
+
+
+long getSlabAllocatedBytes ()
+{
+    return slabHeader->allocatedBytes;
+}
+
+
+long getSlabReservedBytes ()
+{
+    return (long)slabHeader->chunkCount * SLAB_CHUNK_SIZE;
+}
@@ -4,32 +4,91 @@
 /*
  * In-memory Verwaltung der Datenbank
  *
- * Hält die Daten in einem Shared Memory Segment, bietet abgesicherte
+ * Hält die Daten in Shared Memory Segmenten, bietet abgesicherte
  * Zugriffs-Funktionen darauf und läd/speichert die Daten aus/in eine Datei.
- * Leider nur ein statisches Array...
+ * Die Einträge liegen in Chunks fester Größe, die bei Bedarf erzeugt und
+ * von jedem Prozess erst beim ersten Zugriff eingehängt werden. Ein
+ * Verzeichnis-Segment hält die Ids aller Chunks und des Hash-Index.
+ * Zugriffe auf einzelne Schlüssel sperren nur den Lock-Stripe ihres Hashs,
+ * jeder Stripe hat seine eigene Partition des Hash-Index. Einzelne GETs lesen
+ * zuerst ohne Lock und prüfen über den Sequenz-Zähler des Eintrags, ob ein
+ * Schreiber dazwischen war (Seqlock). Zusätzlich hat jede Partition einen
+ * Präfix-Index (Crit-Bit-Baum über die Schlüssel), dessen innere Knoten in den
+ * Plätzen der Einträge liegen. Wildcard-Zugriffe mit festem Anfang besuchen
+ * darüber nur die Einträge mit diesem Präfix. Alle Änderungen werden im
+ * Journal protokolliert und nach dem Verlassen des Locks festgeschrieben,
+ * geänderte Einträge werden außerdem für inkrementelle Snapshots markiert.
  *
  */
 
 
 static int shmStorageSegmentId = 0;
+static int storageFormat = STORAGE_FORMAT_BINARY;
 
-static Record *storage = NULL;
-static int *storageEndIndex = NULL;
+static StorageHeader *storageHeader = NULL;
+// Lokal eingehängte Chunks und Index (werden bei Bedarf nachgeladen)
+static StorageChunk *storageChunks[STORAGE_MAX_CHUNKS];
+static StorageIndexEntry *storageIndexes[LOCK_STRIPES];
+static int storageIndexSegmentIds[LOCK_STRIPES];
+static int storageIndexSizes[LOCK_STRIPES];
 
 const static char* keyDeletedMsg = "key_deleted";
 
+// Arbeitspuffer der Befehle mit mehreren Schlüsseln, pro Prozess wiederverwendet
+static String *batchArgumentBuffer = NULL;
+static Array *batchArguments = NULL;
+static Array *batchKeys = NULL;
+static Array *batchValues = NULL;
+static size_t *batchKeyLengths = NULL;
+static unsigned int *batchKeyHashes = NULL;
+static size_t batchKeyCapacity = 0;
+
+// Arbeitsstapel für Durchläufe des Präfix-Index, pro Prozess wiederverwendet
+static unsigned int *prefixStack = NULL;
+static size_t prefixStackSize = 0;
+static size_t prefixStackCapacity = 0;
+// Treffer eines Wildcard-DELs, werden erst nach der Suche gelöscht
+static int *wildcardMatches = NULL;
+static size_t wildcardMatchCount = 0;
+static size_t wildcardMatchCapacity = 0;
+// Kopf des zuletzt geladenen oder gespeicherten Snapshots, Bezug der Deltas
+static StorageSnapshotHeader storageSnapshotBase;
+
+// Nur im Snapshot-Timer-Prozess, bleibt im binären Format zwischen den Snapshots reserviert
+static StorageCopy snapshotTimerCopy;
+// Gültige Bytes der Delta-Datei zum letzten Snapshot, -1 = nächster vollständig
+static long long snapshotTimerDeltaSize = -1;
+
+
+static double getMonotonicSeconds ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
 
-void initModuleStorage (int snapshotInterval)
+
+void initModuleStorage (int snapshotInterval, int format)
 {
+    storageFormat = format;
+
     registerCommandEntry("GET", 1, true, eventCommandGet);
     registerCommandEntry("PUT", 2, false, eventCommandPut);
     registerCommandEntry("DEL", 1, true, eventCommandDel);
     registerCommandEntry("CNT", 1, true, eventCommandCount);
-
-    int storageSegmentSize = sizeof(Record) * STORAGE_ENTRY_SIZE + sizeof(int);
-
-    // Erzeugt ein neues Shared-Memory-Segment
-    shmStorageSegmentId = shmget(IPC_PRIVATE, storageSegmentSize, IPC_CREAT | SHM_R | SHM_W);
+    registerCommandEntry("MGET", 1, false, eventCommandMultiGet);
+    registerCommandEntry("MPUT", 2, false, eventCommandMultiPut);
+    registerCommandEntry("MDEL", 1, false, eventCommandMultiDel);
+    registerCommandEntry("SCAN", 1, false, eventCommandScan);
+
+    batchArgumentBuffer = stringCreate("");
+    batchArguments = arrayCreate();
+    batchKeys = arrayCreate();
+    batchValues = arrayCreate();
+
+    // Erzeugt ein neues Shared-Memory-Segment für das Chunk-Verzeichnis
+    // (Neue Segmente sind immer mit Nullen initialisiert)
+    shmStorageSegmentId = shmget(IPC_PRIVATE, sizeof(StorageHeader), IPC_CREAT | SHM_R | SHM_W);
     if (shmStorageSegmentId == -1) {
         fatalError("initModuleStorage shmget");
     }
@@ -37,13 +96,39 @@ void initModuleStorage (int snapshotInterval)
 
     // Hängt das Shared-Memory-Segment in den lokalen Adressenraum ein
     // (Das Einhängen wird beim Erzeugen von Kind-Prozessen vererbt)
-    storage = shmat(shmStorageSegmentId, NULL, 0);
-    storageEndIndex = (int*)&storage[STORAGE_ENTRY_SIZE];
-    memset(storage, 0, storageSegmentSize);
+    storageHeader = shmat(shmStorageSegmentId, NULL, 0);
+
+    if (!growStorage()) {
+        fatalError("initModuleStorage growStorage");
+    }
+    for (int i = 0; i < LOCK_STRIPES; i++) {
+        storageHeader->indexPartitions[i].segmentId = -1;
+        storageHeader->indexPartitions[i].prefixRoot = PREFIX_INDEX_EMPTY;
+        if (!rebuildStorageIndex(i, STORAGE_INITIAL_INDEX_SIZE)) {
+            fatalError("initModuleStorage rebuildStorageIndex");
+        }
+    }
+
+    // Ohne binären Snapshot werden die Daten aus der CSV-Datei importiert
+    clock_t clockTime = clock();
+    if (format == STORAGE_FORMAT_BINARY && loadStorageFromSnapshot()) {
+        long deltas = loadStorageFromDelta();
+        printf("Storage data was loaded from snapshot and %ld deltas (time taken: %f sec).\n",
+               deltas, (double)(clock() - clockTime) / CLOCKS_PER_SEC);
+    }
+    else if (loadStorageFromFile()) {
+        printf("Storage data was loaded from file (time taken: %f sec).\n",
+               (double)(clock() - clockTime) / CLOCKS_PER_SEC);
+    }
 
-    if (loadStorageFromFile()) {
-        printf("Storage data was loaded from file.\n");
+    // Änderungen seit dem letzten Snapshot, erst danach wird protokolliert
+    clockTime = clock();
+    long replayed = loadStorageFromJournal();
+    if (replayed > 0) {
+        printf("Journal replayed (%ld records, time taken: %f sec).\n",
+               replayed, (double)(clock() - clockTime) / CLOCKS_PER_SEC);
     }
+    openJournal();
 
     if (snapshotInterval > 0 && fork() == 0) {
         prctl(PR_SET_NAME, (unsigned long)"kvsvr(snapshot)");
@@ -57,29 +142,218 @@ void initModuleStorage (int snapshotInterval)
 
 void freeModuleStorage ()
 {
-    if (saveStorageToFile()) {
-        printf("Storage data saved to file.\n");
+    if (storageHeader == NULL) return; // Modul nicht initialisiert
+
+    double start = getMonotonicSeconds();
+    if (saveStorage()) {
+        unlink(STORAGE_DELTA_FILE);
+        resetJournal();
+        printf("Storage data saved to %s (time taken: %f sec).\n",
+               (storageFormat == STORAGE_FORMAT_BINARY) ? STORAGE_SNAPSHOT_FILE : STORAGE_FILE,
+               getMonotonicSeconds() - start);
+    }
+
+    // Löscht alle Chunks und den Index, auch die von Client-Prozessen erzeugten
+    for (int i = 0; i < storageHeader->chunkCount; i++) {
+        if (storageChunks[i] != NULL) shmdt(storageChunks[i]);
+        shmctl(storageHeader->chunkSegmentIds[i], IPC_RMID, NULL);
     }
+    for (int i = 0; i < LOCK_STRIPES; i++) {
+        if (storageIndexes[i] != NULL) shmdt(storageIndexes[i]);
+        if (storageHeader->indexPartitions[i].segmentId != -1) {
+            shmctl(storageHeader->indexPartitions[i].segmentId, IPC_RMID, NULL);
+        }
+    }
+    printf("Storage chunks deleted (%d chunks, %d records).\n",
+           storageHeader->chunkCount, storageHeader->chunkCount * STORAGE_CHUNK_SIZE);
+
+    stringFree(batchArgumentBuffer);
+    arrayFree(batchArguments);
+    arrayFree(batchKeys);
+    arrayFree(batchValues);
+    free(batchKeyLengths);
+    free(batchKeyHashes);
+    free(prefixStack);
+    free(wildcardMatches);
 
     // Hängt das Shared-Memory-Segment aus dem lokalen Adressenraum aus
-    shmdt(storage);
+    shmdt(storageHeader);
     // Löscht das Shared-Memory-Segment
     shmctl(shmStorageSegmentId, IPC_RMID, NULL);
     printf("Storage shared memory segment deleted (Id %d).\n", shmStorageSegmentId);
 }
 
 
+/**
+ * Hängt einen Chunk, der ggf. von einem anderen Prozess erzeugt wurde,
+ * in den lokalen Adressenraum ein.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param chunk - Nummer des Chunks
+ */
+static StorageChunk* attachStorageChunk (int chunk)
+{
+    StorageChunk *address = shmat(storageHeader->chunkSegmentIds[chunk], NULL, 0);
+    if (address == (void*)-1) {
+        perror("attachStorageChunk shmat");
+        exit(EXIT_FAILURE);
+    }
+    storageChunks[chunk] = address;
+    return address;
+}
+
+
+static inline StorageChunk* getStorageChunk (int chunk)
+{
+    StorageChunk *address = storageChunks[chunk];
+    return (address != NULL) ? address : attachStorageChunk(chunk);
+}
+
+
+static inline Record* getRecord (int index)
+{
+    return &getStorageChunk((unsigned)index / STORAGE_CHUNK_SIZE)->
+            records[(unsigned)index % STORAGE_CHUNK_SIZE];
+}
+
+
+static inline char* getRecordKey (const Record *record)
+{
+    return getSlabBlockAddress(record->data);
+}
+
+
+static inline char* getRecordValue (const Record *record)
+{
+    return getRecordKey(record) + record->keyLength + 1;
+}
+
+
+static inline unsigned int getRecordDataSize (const Record *record)
+{
+    return record->keyLength + record->valueLength + 2;
+}
+
+
+/**
+ * Markiert einen Eintrag als seit dem letzten Snapshot geändert (siehe
+ * copyStorageChanges()). Ein Wort der Bitmap teilen sich Einträge
+ * verschiedener Stripes, deshalb atomar.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param index - Index des Eintrags
+ */
+static inline void markRecordDirty (int index)
+{
+    unsigned int offset = (unsigned)index % STORAGE_CHUNK_SIZE;
+    __atomic_fetch_or(&getStorageChunk((unsigned)index / STORAGE_CHUNK_SIZE)->dirtyRecords[offset / 64],
+                      1UL << (offset % 64), __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Markiert den Beginn einer Änderung an einem Eintrag für Leser ohne Lock.
+ * Schreiber sind über das Stripe-Lock bereits untereinander ausgeschlossen.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param record - Zielobjekt
+ */
+static inline void beginRecordWrite (Record *record)
+{
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static inline void endRecordWrite (Record *record)
+{
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+
+static inline int* getFreeSlot (int pos)
+{
+    return &getStorageChunk((unsigned)pos / STORAGE_CHUNK_SIZE)->
+            freeSlots[(unsigned)pos % STORAGE_CHUNK_SIZE];
+}
+
+
+static inline int* getFreeSlotPos (int index)
+{
+    return &getStorageChunk((unsigned)index / STORAGE_CHUNK_SIZE)->
+            freeSlotPos[(unsigned)index % STORAGE_CHUNK_SIZE];
+}
+
+
+/**
+ * Hängt eine Partition des Storage-Index in den lokalen Adressenraum ein,
+ * falls sie seit dem letzten Zugriff von einem anderen Prozess neu aufgebaut
+ * wurde.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param partition - Partition (Lock-Stripe)
+ */
+static inline StorageIndexEntry* getStorageIndex (int partition)
+{
+    int segmentId = storageHeader->indexPartitions[partition].segmentId;
+
+    if (storageIndexes[partition] == NULL || storageIndexSegmentIds[partition] != segmentId) {
+        if (storageIndexes[partition] != NULL) shmdt(storageIndexes[partition]);
+
+        storageIndexes[partition] = shmat(segmentId, NULL, 0);
+        if (storageIndexes[partition] == (void*)-1) {
+            perror("getStorageIndex shmat");
+            exit(EXIT_FAILURE);
+        }
+        storageIndexSegmentIds[partition] = segmentId;
+        storageIndexSizes[partition] = storageHeader->indexPartitions[partition].size;
+    }
+    return storageIndexes[partition];
+}
+
+
+/**
+ * Vergrößert das Storage um einen Chunk. Laufende Client-Prozesse hängen
+ * das neue Segment beim nächsten Zugriff ein.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ */
+bool growStorage ()
+{
+    int chunk = storageHeader->chunkCount;
+    if (chunk == STORAGE_MAX_CHUNKS) {
+        return false;
+    }
+
+    int segmentId = shmget(IPC_PRIVATE, sizeof(StorageChunk), IPC_CREAT | SHM_R | SHM_W);
+    if (segmentId == -1) {
+        perror("growStorage shmget");
+        return false;
+    }
+    storageHeader->chunkSegmentIds[chunk] = segmentId;
+    attachStorageChunk(chunk);
+    __atomic_store_n(&storageHeader->chunkCount, chunk + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
 void eventCommandGet (Command *cmd)
 {
     if (stringMatchAnyChar(cmd->key, "*?", STR_MATCH_NOGROUP) != -1) {
+        if (cmd->stream != NULL) {
+            // Die Treffer werden erst beim Senden abschnittsweise gesucht
+            responseStreamOpen(cmd->stream, cmd, streamMultipleStorageRecords);
+            return;
+        }
         getMultipleStorageRecords(cmd->key->cStr, cmd->responseRecords);
     }
     else {
-        String *value = stringCreate("");
-        if (getStorageRecord(cmd->key->cStr, value)) {
-            responseRecordsAdd(cmd->responseRecords, cmd->key->cStr, value->cStr);
+        // Der Wert wird direkt in den Datensatz kopiert
+        ResponseRecord *record = responseRecordsAdd(cmd->responseRecords, cmd->key->cStr, "");
+        if (!getStorageRecord(cmd->key->cStr, record->value)) {
+            responseRecordsRemoveLast(cmd->responseRecords);
         }
-        stringFree(value);
     }
 
     if (cmd->responseRecords->size == 0) {
@@ -124,250 +398,2283 @@ void eventCommandDel (Command *cmd)
 
 void eventCommandCount (Command *cmd)
 {
-    int counter = 0;
-
-    enterCriticalSection(READ_ACCESS);
-    for (int i = 0; i < *storageEndIndex; i++) {
-        if (*storage[i].key != '\0' &&
-            strMatchWildcard(storage[i].key, cmd->key->cStr)) {
-            counter++;
-        }
-    }
-    leaveCriticalSection(READ_ACCESS);
-
-    String *strCounter = stringCreateWithFormat("%d", counter);
-    responseRecordsAdd(cmd->responseRecords, cmd->key->cStr, strCounter->cStr);
-    stringFree(strCounter);
+    char strCounter[24];
+    snprintf(strCounter, sizeof(strCounter), "%ld", countMultipleStorageRecords(cmd->key->cStr));
+    responseRecordsAdd(cmd->responseRecords, cmd->key->cStr, strCounter);
 }
 
 
 /**
- * Findet den Index eines Schlüssels im Storage, bei Fehlschlag -1.
- * Nicht gegen Race-Conditions gesichert.
- * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ * Zerlegt die Argumente eines Befehls mit mehreren Schlüsseln ("MGET k1 k2 ...")
+ * an Leerzeichen. Die Einträge von "args" zeigen in "buffer". Gibt false zurück
+ * und setzt die Fehlermeldung, wenn ein Schlüssel ungültige Zeichen enthält.
  *
- * @param key - Suchschlüssel
- * @param accessTyp - Zugriffsart des Aufrufers
- * @return - Index des gefundenen Eintrags
+ * @param cmd - Zielobjekt
+ * @param buffer - Puffer für die zerlegten Argumente
+ * @param args - Ausgabe der Argumente
+ * @param pairs - Argumente sind Schlüssel-Wert-Paare
  */
-int findStorageRecord (const char* key)
+static bool splitBatchArguments (Command *cmd, String *buffer, Array *args, bool pairs)
 {
-    for (int i = 0; i < *storageEndIndex; i++) {
-        if (strcmp(storage[i].key, key) == 0) {
-            return i;
+    stringAppend(stringAppend(stringCopy(buffer, cmd->key->cStr), " "), cmd->value->cStr);
+
+    for (char *arg = strtok(buffer->cStr, " \t"); arg != NULL; arg = strtok(NULL, " \t")) {
+        bool isKey = !pairs || arraySize(args) % 2 == 0;
+        if (isKey && !strMatchAllChar(arg, "", STR_MATCH_ALNUM)) {
+            stringCopy(cmd->responseMessage, "argument_bad_symbol");
+            return false;
         }
-        // Race-Conditions durch Trennung der Index-Iteration von der eigentlichen Operation.
-        // Schlechte Idee.
-        //leaveCriticalSection(accessType);
-        //enterCriticalSection(accessType);
+        arrayPushItem(args, arg);
+    }
+
+    if (pairs && arraySize(args) % 2 != 0) {
+        stringCopy(cmd->responseMessage, "argument_missing");
+        return false;
+    }
+    return true;
+}
+
+
+void eventCommandMultiGet (Command *cmd)
+{
+    arrayClear(batchKeys);
+    if (splitBatchArguments(cmd, batchArgumentBuffer, batchKeys, false)) {
+        getStorageRecordBatch(batchKeys, cmd->responseRecords);
+    }
+}
+
+
+void eventCommandMultiPut (Command *cmd)
+{
+    arrayClear(batchArguments);
+    if (!splitBatchArguments(cmd, batchArgumentBuffer, batchArguments, true)) {
+        return;
+    }
+
+    arrayClear(batchKeys);
+    arrayClear(batchValues);
+    for (size_t i = 0; i < arraySize(batchArguments); i += 2) {
+        arrayPushItem(batchKeys, arrayGetItem(batchArguments, i));
+        arrayPushItem(batchValues, arrayGetItem(batchArguments, i + 1));
+    }
+
+    putStorageRecordBatch(batchKeys, batchValues, cmd->responseRecords);
+}
+
+
+void eventCommandMultiDel (Command *cmd)
+{
+    arrayClear(batchKeys);
+    if (splitBatchArguments(cmd, batchArgumentBuffer, batchKeys, false)) {
+        deleteStorageRecordBatch(batchKeys, cmd->responseRecords);
     }
-    return -1;
 }
 
 
 /**
- * Sucht einen Schlüssel im Storage und kopiert dessen Wert nach "value".
+ * SCAN cursor [pattern] [count]: Liefert bis zu "count" Einträge, die auf den
+ * Wildcard-Suchschlüssel passen (Standard "*"), ab der Position "cursor" (0 =
+ * Anfang). Die letzte Zeile der Antwort ist der Cursor für den nächsten Aufruf,
+ * 0 wenn das Storage vollständig durchlaufen wurde.
  *
- * @param key - Suchschlüssel
- * @param value - Wert des gefundenen Eintrags
+ * @param cmd - Befehlsobjekt
  */
-bool getStorageRecord (const char* key, String* value)
+void eventCommandScan (Command *cmd)
 {
-    enterCriticalSection(READ_ACCESS);
+    if (!strMatchAllChar(cmd->key->cStr, "", STR_MATCH_DIGIT)) {
+        stringCopy(cmd->responseMessage, "argument_bad_symbol");
+        return;
+    }
 
-    int index = findStorageRecord(key);
-    if (index != -1) {
-        stringCopy(value, storage[index].value);
+    stringCopy(batchArgumentBuffer, cmd->value->cStr);
+    const char *pattern = strtok(batchArgumentBuffer->cStr, " \t");
+    const char *count = strtok(NULL, " \t");
+    if (pattern == NULL) pattern = "*";
 
-        leaveCriticalSection(READ_ACCESS);
-        return true;
+    if (!strMatchAllChar(pattern, "?*", STR_MATCH_ALNUM) ||
+            (count != NULL && (!strMatchAllChar(count, "", STR_MATCH_DIGIT) || atol(count) == 0)) ||
+            strtok(NULL, " \t") != NULL) {
+        stringCopy(cmd->responseMessage, "argument_bad_symbol");
+        return;
     }
 
-    leaveCriticalSection(READ_ACCESS);
-    return false;
+    long limit = (count != NULL) ? atol(count) : STORAGE_SCAN_DEFAULT_COUNT;
+    if (limit > STORAGE_SCAN_MAX_COUNT) limit = STORAGE_SCAN_MAX_COUNT;
+    long cursor = atol(cmd->key->cStr);
+    if (cursor > STORAGE_ENTRY_SIZE) cursor = STORAGE_ENTRY_SIZE;
+
+    char nextCursor[16];
+    snprintf(nextCursor, sizeof(nextCursor), "%d",
+             scanStorageRecords((int)cursor, pattern, (int)limit, cmd->responseRecords));
+    stringCopy(cmd->responseMessage, nextCursor);
+    cmd->responseTrailer = true;
 }
 
 
 /**
- * Macht einen Eintrag ins Storage. Hat folgende Rückgabewerte:
- * - 1 Der Eintrag existierte schon, sein Wert wurde verändert
- * - 2 Ein neuer Eintrag wurde angelegt
- * - 0 Es war kein freier Platz verfügbar.
+ * Hash-Funktion (FNV-1a) für die Schlüssel des Storage-Index.
  *
- * @param key - Schlüssel des einzufügenden Eintrags
- * @param value - Wert des einzufügenden Eintrags
+ * @param key - Schlüssel
  */
-int putStorageRecord (const char* key, const char* value)
+static unsigned int hashStorageKey (const char* key, size_t keyLength)
 {
-    enterCriticalSection(WRITE_ACCESS);
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < keyLength; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
 
-    // Sucht nach existierenden Einträgen
-    int index = findStorageRecord(key);
-    if (index != -1) {
-        notifyAllObservers(NL_NOTIFICATION_PUT, index, key, value);
 
-        strncpy(storage[index].value, value, STORAGE_VALUE_SIZE);
 
-        leaveCriticalSection(WRITE_ACCESS);
-        return 1; // RECORD_OVERWRITTEN
-    }
 
-    // Sucht nach dem ersten freien Platz oder einem Platz am Ende
-    index = findStorageRecord("");
-    if (index == -1 && *storageEndIndex < STORAGE_ENTRY_SIZE) {
-        index = (*storageEndIndex)++;
-    }
-    if (index != -1) {
-        strncpy(storage[index].key, key, STORAGE_KEY_SIZE);
-        strncpy(storage[index].value, value, STORAGE_VALUE_SIZE);
+static inline bool isPrefixNodeRef (unsigned int ref)
+{
+    return ref & 1;
+}
 
-        leaveCriticalSection(WRITE_ACCESS);
-        return 2; // RECORD_NEW
-    }
 
-    leaveCriticalSection(WRITE_ACCESS);
-    return 0; // STORAGE_FULL
+static inline int getPrefixRefIndex (unsigned int ref)
+{
+    return (int)(ref >> 1);
 }
 
 
-/**
- * Entfernt einen Eintrag aus dem Storage indem es seinen Schlüssel mit einem
- * Leerstring ersetzt (freier Platz).
- *
- * @param key - Schlüssel des zu löschenden Eintrags
- */
-bool deleteStorageRecord (const char* key)
+static inline PrefixNode* getPrefixNode (unsigned int ref)
 {
-    enterCriticalSection(WRITE_ACCESS);
+    return &getRecord(getPrefixRefIndex(ref))->prefixNode;
+}
 
-    int index = findStorageRecord(key);
-    if (index != -1) {
-        notifyAllObservers(NL_NOTIFICATION_DEL, index, storage[index].key, keyDeletedMsg);
 
-        *storage[index].key = '\0';
+static inline unsigned int getPrefixRefCount (unsigned int ref)
+{
+    return isPrefixNodeRef(ref) ? getPrefixNode(ref)->count : 1;
+}
 
-        leaveCriticalSection(WRITE_ACCESS);
-        return true;
-    }
 
-    leaveCriticalSection(WRITE_ACCESS);
-    return false;
+/**
+ * Gibt die Richtung im Crit-Bit-Baum zurück, 1 wenn das kritische Bit des
+ * Knotens im Schlüssel gesetzt ist. Hinter dem Ende zählt der Schlüssel als '\0'.
+ *
+ * @param node - Innerer Knoten
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ */
+static inline int getPrefixDirection (const PrefixNode *node, const char *key, size_t keyLength)
+{
+    unsigned char c = (node->byte < keyLength) ? (unsigned char)key[node->byte] : 0;
+    return (1 + (node->otherbits | c)) >> 8;
 }
 
 
 /**
- * Vergleicht alle Einträge mit dem Wildcard-Suchschlüssel und fügt alle Treffer
- * dem Ergebnis-Array hinzu.
+ * Gibt die Maske aller Bits außer dem höchsten unterschiedlichen Bit zweier
+ * Zeichen zurück (die Zeichen müssen verschieden sein).
  *
- * @param wildcardKey - Wildcard-Suchschlüssel
- * @param result - Ergebnis-Array
+ * @param a - Erstes Zeichen
+ * @param b - Zweites Zeichen
  */
-void getMultipleStorageRecords (const char* wildcardKey, Array* result)
+static inline unsigned char getPrefixOtherbits (unsigned char a, unsigned char b)
 {
-    enterCriticalSection(READ_ACCESS);
+    unsigned int bits = a ^ b;
+    bits |= bits >> 1;
+    bits |= bits >> 2;
+    bits |= bits >> 4;
+    return (unsigned char)((bits & ~(bits >> 1)) ^ 0xFF);
+}
+
 
-    for (int i = 0; i < *storageEndIndex; i++) {
-        if (*storage[i].key != '\0' &&
-                strMatchWildcard(storage[i].key, wildcardKey)) {
-            responseRecordsAdd(result, storage[i].key, storage[i].value);
+static void pushPrefixStack (unsigned int ref)
+{
+    if (prefixStackSize == prefixStackCapacity) {
+        size_t capacity = (prefixStackCapacity == 0) ? 64 : prefixStackCapacity * 2;
+        unsigned int *stack = realloc(prefixStack, sizeof(unsigned int) * capacity);
+        if (stack == NULL) {
+            fatalError("pushPrefixStack realloc");
         }
+        prefixStack = stack;
+        prefixStackCapacity = capacity;
     }
-
-    leaveCriticalSection(READ_ACCESS);
+    prefixStack[prefixStackSize++] = ref;
 }
 
 
 /**
- * Vergleicht alle Einträge mit dem Wildcard-Suchschlüssel und fügt alle Treffer
- * dem Ergebnis-Array hinzu. Entfernt alle gefundenen Einträge aus dem Storage
- * indem es ihre Schlüssel mit Leerstrings ersetzt (freier Platz).
+ * Fügt einen Eintrag in den Präfix-Index seiner Partition ein. Der neue
+ * innere Knoten liegt im Platz des Eintrags. Der Schlüssel darf noch nicht im
+ * Index enthalten sein.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
  *
- * @param wildcardKey - Wildcard-Suchschlüssel
- * @param result - Ergebnis-Array
+ * @param index - Index des Eintrags im Storage
  */
-void deleteMultipleStorageRecords (const char* wildcardKey, Array* result)
+static void insertPrefixIndex (int index)
 {
-    enterCriticalSection(WRITE_ACCESS);
+    Record *record = getRecord(index);
+    const char *key = getRecordKey(record);
+    size_t keyLength = record->keyLength;
+    unsigned int *root = &storageHeader->indexPartitions[getLockStripe(record->hash)].prefixRoot;
+    PrefixNode *newNode = &record->prefixNode;
+
+    newNode->used = false;
+    if (*root == PREFIX_INDEX_EMPTY) {
+        *root = (unsigned int)index << 1;
+        return;
+    }
 
-    for (int i = 0; i < *storageEndIndex; i++) {
-        if (*storage[i].key != '\0' &&
-                 strMatchWildcard(storage[i].key, wildcardKey)) {
-            responseRecordsAdd(result, storage[i].key, keyDeletedMsg);
+    // Blatt mit dem längsten gemeinsamen Präfix
+    unsigned int ref = *root;
+    while (isPrefixNodeRef(ref)) {
+        PrefixNode *node = getPrefixNode(ref);
+        ref = node->child[getPrefixDirection(node, key, keyLength)];
+    }
+    const unsigned char *bestKey = (const unsigned char*)getRecordKey(getRecord(getPrefixRefIndex(ref)));
 
-            notifyAllObservers(NL_NOTIFICATION_DEL, i, storage[i].key, keyDeletedMsg);
+    // Erstes unterschiedliches Bit (beide Schlüssel enden mit '\0')
+    unsigned int byte = 0;
+    while (byte <= keyLength && bestKey[byte] == (unsigned char)key[byte]) {
+        byte++;
+    }
+    if (byte > keyLength) return; // Schlüssel ist schon enthalten
 
-            strcpy(storage[i].key, "");
-        }
+    unsigned char otherbits = getPrefixOtherbits(bestKey[byte], (unsigned char)key[byte]);
+    int bestDirection = (1 + (otherbits | bestKey[byte])) >> 8;
+
+    // Der neue Knoten kommt über den ersten Knoten mit einem späteren kritischen Bit
+    unsigned int *where = root;
+    while (isPrefixNodeRef(*where)) {
+        PrefixNode *node = getPrefixNode(*where);
+        if (node->byte > byte || (node->byte == byte && node->otherbits > otherbits)) break;
+
+        node->count++;
+        where = &node->child[getPrefixDirection(node, key, keyLength)];
     }
 
-    leaveCriticalSection(WRITE_ACCESS);
+    newNode->byte = byte;
+    newNode->otherbits = otherbits;
+    newNode->child[bestDirection] = *where;
+    newNode->child[1 - bestDirection] = (unsigned int)index << 1;
+    newNode->count = getPrefixRefCount(*where) + 1;
+    newNode->used = true;
+    *where = ((unsigned int)index << 1) | 1;
 }
 
 
 /**
- * Befüllt das Storage mit den Einträgen aus der "STORAGE_FILE"-Datei.
- * Zeilenweise Einträge, Schlüssel und Wert kommasepariert.
+ * Entfernt einen Eintrag aus dem Präfix-Index seiner Partition. Mit dem Blatt
+ * fällt sein Eltern-Knoten weg; liegt der Knoten im Platz des Eintrags noch im
+ * Baum, wird er in den frei gewordenen Platz verschoben.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
  *
+ * @param index - Index des Eintrags im Storage
  */
-bool loadStorageFromFile ()
+static void removePrefixIndex (int index)
 {
-    char lineBuffer[FILE_BUFFER_SIZE];
-
-    FILE *file = fopen(STORAGE_FILE, "r");
-    if (file == NULL) {
-        return false;
+    Record *record = getRecord(index);
+    const char *key = getRecordKey(record);
+    size_t keyLength = record->keyLength;
+    unsigned int *root = &storageHeader->indexPartitions[getLockStripe(record->hash)].prefixRoot;
+
+    unsigned int *where = root;
+    unsigned int *whereParent = NULL;
+    unsigned int *whereOwn = NULL; // Verweis auf den Knoten im Platz des Eintrags
+    int direction = 0;
+
+    while (isPrefixNodeRef(*where)) {
+        if (getPrefixRefIndex(*where) == index) {
+            whereOwn = where;
+        }
+        PrefixNode *node = getPrefixNode(*where);
+        node->count--;
+        direction = getPrefixDirection(node, key, keyLength);
+        whereParent = where;
+        where = &node->child[direction];
     }
 
-    while (fgets(lineBuffer, sizeof(lineBuffer), file)) {
-        const char* key = strtok(lineBuffer,  ",");
-        const char* value = strtok(NULL, "\n");
-
-        if (key == NULL || value == NULL) continue;
+    if (whereParent == NULL) {
+        *root = PREFIX_INDEX_EMPTY;
+        return;
+    }
 
-        strncpy(storage[*storageEndIndex].key, key, STORAGE_KEY_SIZE);
-        strncpy(storage[*storageEndIndex].value, value, STORAGE_VALUE_SIZE);
+    // Der Eltern-Knoten wird durch den Geschwister-Teilbaum ersetzt
+    int parentIndex = getPrefixRefIndex(*whereParent);
+    PrefixNode *parent = getPrefixNode(*whereParent);
+    *whereParent = parent->child[1 - direction];
+    parent->used = false;
 
-        (*storageEndIndex)++;
+    if (parentIndex != index && record->prefixNode.used) {
+        *parent = record->prefixNode;
+        *whereOwn = ((unsigned int)parentIndex << 1) | 1;
+        record->prefixNode.used = false;
     }
-
-    fclose(file);
-    return true;
 }
 
 
 /**
- * Speichert den Inhalt des Storage in die "STORAGE_FILE"-Datei.
- * Zeilenweise Einträge, Schlüssel und Wert kommasepariert.
+ * Bereitet einen Durchlauf der Einträge einer Partition vor, deren Schlüssel
+ * mit "prefix" beginnen (aufsteigend sortiert, siehe nextPrefixIndex()). Mit
+ * "after" beginnt der Durchlauf hinter diesem Schlüssel, er muss ebenfalls mit
+ * "prefix" beginnen. Gibt die Anzahl aller Einträge mit dem Präfix zurück.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
  *
+ * @param partition - Partition (Lock-Stripe)
+ * @param prefix - Präfix der Schlüssel
+ * @param prefixLength - Länge des Präfixes
+ * @param after - Zuletzt gelieferter Schlüssel oder NULL
+ * @param afterLength - Länge von "after"
  */
-bool saveStorageToFile ()
+static unsigned int seekPrefixIndex (int partition, const char *prefix, size_t prefixLength,
+                                     const char *after, size_t afterLength)
 {
-    FILE *file = fopen(STORAGE_FILE, "w+");
-    if (file == NULL) {
-        return false;
+    prefixStackSize = 0;
+
+    unsigned int ref = storageHeader->indexPartitions[partition].prefixRoot;
+    if (ref == PREFIX_INDEX_EMPTY) return 0;
+
+    // Teilbaum unter dem letzten Knoten, der ein Bit innerhalb des Präfixes prüft
+    unsigned int top = ref;
+    while (isPrefixNodeRef(ref)) {
+        PrefixNode *node = getPrefixNode(ref);
+        ref = node->child[getPrefixDirection(node, prefix, prefixLength)];
+        if (node->byte < prefixLength) {
+            top = ref;
+        }
+    }
+    if (strncmp(getRecordKey(getRecord(getPrefixRefIndex(ref))), prefix, prefixLength) != 0) return 0;
+
+    if (after == NULL) {
+        pushPrefixStack(top);
+        return getPrefixRefCount(top);
     }
 
-    for (int i = 0; i < *storageEndIndex; i++) {
-        if (*storage[i].key != '\0') {
-            fprintf(file, "%s,%s\n", storage[i].key, storage[i].value);
+    // Erstes Bit, in dem sich "after" vom nächstgelegenen Schlüssel unterscheidet
+    ref = top;
+    while (isPrefixNodeRef(ref)) {
+        PrefixNode *node = getPrefixNode(ref);
+        ref = node->child[getPrefixDirection(node, after, afterLength)];
+    }
+    const unsigned char *bestKey = (const unsigned char*)getRecordKey(getRecord(getPrefixRefIndex(ref)));
+    size_t byte = 0;
+    while (byte <= afterLength && bestKey[byte] == (unsigned char)after[byte]) {
+        byte++;
+    }
+    bool exact = byte > afterLength;
+    unsigned char otherbits = exact ? 0 : getPrefixOtherbits(bestKey[byte], (unsigned char)after[byte]);
+
+    // Alle rechten Teilbäume entlang des Pfads von "after" sind größer
+    ref = top;
+    while (isPrefixNodeRef(ref)) {
+        PrefixNode *node = getPrefixNode(ref);
+        if (!exact && (node->byte > byte || (node->byte == byte && node->otherbits > otherbits))) break;
+
+        int direction = getPrefixDirection(node, after, afterLength);
+        if (direction == 0) {
+            pushPrefixStack(node->child[1]);
         }
+        ref = node->child[direction];
+    }
+    // Der Teilbaum an der Abweichung ist ganz größer oder ganz kleiner als "after"
+    if (!exact && ((1 + (otherbits | (unsigned char)after[byte])) >> 8) == 0) {
+        pushPrefixStack(ref);
     }
+    return getPrefixRefCount(top);
+}
 
-    fclose(file);
-    return true;
+
+/**
+ * Gibt den Index des nächsten Eintrags des mit seekPrefixIndex() begonnenen
+ * Durchlaufs zurück, -1 am Ende.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ */
+static int nextPrefixIndex ()
+{
+    while (prefixStackSize > 0) {
+        unsigned int ref = prefixStack[--prefixStackSize];
+        if (!isPrefixNodeRef(ref)) {
+            return getPrefixRefIndex(ref);
+        }
+        PrefixNode *node = getPrefixNode(ref);
+        pushPrefixStack(node->child[1]);
+        pushPrefixStack(node->child[0]);
+    }
+    return -1;
 }
 
 
-void eventSnapshotTimer ()
+/**
+ * Ruft "visit" für jeden Eintrag auf, dessen Schlüssel auf den
+ * Wildcard-Suchschlüssel passt. Beginnt der Suchschlüssel mit festen Zeichen,
+ * werden nur die Einträge mit diesem Präfix aus dem Präfix-Index jeder
+ * Partition besucht, sonst alle Einträge. "visit" darf das Storage nicht ändern.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!! (alle Stripes)
+ *
+ * @param wildcardKey - Wildcard-Suchschlüssel
+ * @param visit - Funktion für jeden Treffer
+ * @param context - Argument für "visit"
+ */
+static void findWildcardStorageRecords (const char* wildcardKey, void (*visit)(int, void*), void *context)
 {
-    clock_t clockTime = clock();
+    size_t prefixLength = strcspn(wildcardKey, "*?");
+    WildcardPattern pattern;
+    strCompileWildcard(&pattern, wildcardKey);
+
+    if (prefixLength > 0) {
+        for (int partition = 0; partition < LOCK_STRIPES; partition++) {
+            seekPrefixIndex(partition, wildcardKey, prefixLength, NULL, 0);
+            for (int i = nextPrefixIndex(); i != -1; i = nextPrefixIndex()) {
+                Record *record = getRecord(i);
+                if (strMatchCompiledWildcard(&pattern, getRecordKey(record), record->keyLength)) {
+                    visit(i, context);
+                }
+            }
+        }
+        return;
+    }
 
-    enterCriticalSection(READ_ACCESS);
-    saveStorageToFile();
+    for (int i = 0; i < storageHeader->endIndex; i++) {
+        Record *record = getRecord(i);
+        if (record->data != SLAB_NULL &&
+                strMatchCompiledWildcard(&pattern, getRecordKey(record), record->keyLength)) {
+            visit(i, context);
+        }
+    }
+}
+
+
+static void addWildcardRecord (int index, void *result)
+{
+    Record *record = getRecord(index);
+    responseRecordsAdd(result, getRecordKey(record), getRecordValue(record));
+}
+
+
+static void countWildcardRecord (int index, void *counter)
+{
+    (void)index;
+    (*(long*)counter)++;
+}
+
+
+static void collectWildcardRecord (int index, void *context)
+{
+    (void)context;
+    if (wildcardMatchCount == wildcardMatchCapacity) {
+        size_t capacity = (wildcardMatchCapacity == 0) ? 64 : wildcardMatchCapacity * 2;
+        int *matches = realloc(wildcardMatches, sizeof(int) * capacity);
+        if (matches == NULL) {
+            fatalError("collectWildcardRecord realloc");
+        }
+        wildcardMatches = matches;
+        wildcardMatchCapacity = capacity;
+    }
+    wildcardMatches[wildcardMatchCount++] = index;
+}
+
+
+/**
+ * Findet die Position eines Schlüssels im Storage-Index (Open Addressing,
+ * lineares Sondieren), bei Fehlschlag NULL. Die Partition wählen die unteren
+ * Bits des Hashs (wie der Lock-Stripe), die Position die übrigen. Nur
+ * Positionen mit gleichem Hash führen zum Lesen des Eintrags.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Suchschlüssel
+ * @param keyLength - Länge des Suchschlüssels
+ * @param hash - Hash des Suchschlüssels
+ * @return - Position im Storage-Index
+ */
+static StorageIndexEntry* findStorageIndexSlot (const char* key, size_t keyLength, unsigned int hash)
+{
+    int partition = (int)getLockStripe(hash);
+    StorageIndexEntry *index = getStorageIndex(partition);
+    unsigned int mask = storageHeader->indexPartitions[partition].size - 1;
+    unsigned int slot = (hash >> LOCK_STRIPE_BITS) & mask;
+
+    for (unsigned int probe = 0; probe <= mask; probe++) {
+        int recordIndex = index[slot].record;
+        if (recordIndex == STORAGE_INDEX_EMPTY) {
+            break;
+        }
+        if (recordIndex != STORAGE_INDEX_DELETED && index[slot].hash == hash) {
+            Record *record = getRecord(recordIndex);
+            if (record->keyLength == keyLength &&
+                    memcmp(getRecordKey(record), key, keyLength) == 0) {
+                return &index[slot];
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+
+/**
+ * Trägt einen Eintrag in seine Partition des Storage-Index und des
+ * Präfix-Index ein. Der Schlüssel darf noch nicht im Index enthalten sein.
+ * Wenn zu viele Positionen belegt sind, wird die Partition neu aufgebaut
+ * (ohne Grabsteine) und bei Bedarf verdoppelt.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param record - Index des Eintrags im Storage
+ */
+static void insertStorageIndex (int record)
+{
+    unsigned int hash = getRecord(record)->hash;
+    int partition = (int)getLockStripe(hash);
+    StorageIndexPartition *info = &storageHeader->indexPartitions[partition];
+
+    StorageIndexEntry *index = getStorageIndex(partition);
+    unsigned int mask = info->size - 1;
+    unsigned int slot = (hash >> LOCK_STRIPE_BITS) & mask;
+
+    while (index[slot].record >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    if (index[slot].record == STORAGE_INDEX_EMPTY) {
+        info->usage++;
+    }
+    StorageIndexEntry entry = {record, hash};
+    __atomic_store(&index[slot], &entry, __ATOMIC_RELEASE); // Für Leser ohne Lock
+    info->count++;
+    insertPrefixIndex(record);
+
+    if (info->usage > info->size / 4 * 3) {
+        rebuildStorageIndex(partition, (info->count * 2 > info->size) ? info->size * 2 : info->size);
+    }
+}
+
+
+/**
+ * Entfernt einen Eintrag aus dem Storage-Index (Grabstein) und dem Präfix-Index.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param slot - Position im Storage-Index
+ * @param hash - Hash des Schlüssels
+ */
+static inline void removeStorageIndex (StorageIndexEntry *slot, unsigned int hash)
+{
+    removePrefixIndex(slot->record);
+    slot->record = STORAGE_INDEX_DELETED;
+    storageHeader->indexPartitions[getLockStripe(hash)].count--;
+}
+
+
+/**
+ * Baut eine Partition des Storage-Index aus ihren bisherigen Einträgen in
+ * einem neuen Shared-Memory-Segment auf und entfernt dabei alle Grabsteine.
+ * Das alte Segment wird gelöscht, sobald es kein Prozess mehr eingehängt hat.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param partition - Partition (Lock-Stripe)
+ * @param indexSize - Anzahl der Positionen (Zweierpotenz!)
+ */
+bool rebuildStorageIndex (int partition, int indexSize)
+{
+    StorageIndexPartition *info = &storageHeader->indexPartitions[partition];
+
+    int segmentId = shmget(IPC_PRIVATE, sizeof(StorageIndexEntry) * indexSize, IPC_CREAT | SHM_R | SHM_W);
+    if (segmentId == -1) {
+        perror("rebuildStorageIndex shmget");
+        return false;
+    }
+    StorageIndexEntry *index = shmat(segmentId, NULL, 0);
+    if (index == (void*)-1) {
+        perror("rebuildStorageIndex shmat");
+        shmctl(segmentId, IPC_RMID, NULL);
+        return false;
+    }
+
+    // Alle Bits gesetzt entspricht STORAGE_INDEX_EMPTY
+    memset(index, 0xFF, sizeof(StorageIndexEntry) * indexSize);
+    unsigned int mask = indexSize - 1;
+    int count = 0;
+
+    if (info->segmentId != -1) {
+        StorageIndexEntry *oldIndex = getStorageIndex(partition);
+        for (int i = 0; i < info->size; i++) {
+            if (oldIndex[i].record < 0) continue;
+
+            unsigned int slot = (oldIndex[i].hash >> LOCK_STRIPE_BITS) & mask;
+            while (index[slot].record != STORAGE_INDEX_EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            index[slot] = oldIndex[i];
+            count++;
+        }
+
+        shmdt(oldIndex);
+        shmctl(info->segmentId, IPC_RMID, NULL);
+    }
+    storageIndexes[partition] = index;
+    storageIndexSegmentIds[partition] = segmentId;
+    storageIndexSizes[partition] = indexSize;
+
+    info->segmentId = segmentId;
+    info->size = indexSize;
+    info->usage = count;
+    info->count = count;
+    return true;
+}
+
+
+/**
+ * Legt einen freien Platz innerhalb von "endIndex" auf den
+ * Free-Slot-Stack. Die Position im Stack wird mitgeführt, damit ein Platz
+ * auch wieder aus der Mitte entfernt werden kann.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param index - Index des freien Platzes
+ */
+static void pushFreeStorageSlot (int index)
+{
+    *getFreeSlotPos(index) = storageHeader->freeCount;
+    *getFreeSlot(storageHeader->freeCount++) = index;
+}
+
+
+/**
+ * Entfernt einen freien Platz aus dem Free-Slot-Stack, indem er mit dem
+ * obersten Element vertauscht wird.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param index - Index des freien Platzes
+ */
+static void removeFreeStorageSlot (int index)
+{
+    int pos = *getFreeSlotPos(index);
+    int last = *getFreeSlot(--storageHeader->freeCount);
+
+    *getFreeSlot(pos) = last;
+    *getFreeSlotPos(last) = pos;
+}
+
+
+/**
+ * Reserviert einen Platz und einen Slab-Block für einen neuen Eintrag.
+ * Bevorzugt wird der zuletzt freigegebene Platz, sonst ein Platz am Ende.
+ * Wenn alle Chunks belegt sind wird das Storage vergrößert. Bei Fehlschlag -1.
+ * Platz und Block werden zusammen unter dem Allocation-Lock vergeben, damit
+ * andere Stripes einen reservierten Platz nie für frei halten.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param dataSize - Größe von "key\0value\0"
+ * @return - Index des reservierten Platzes
+ */
+static int allocateStorageSlot (unsigned int dataSize)
+{
+    enterAllocationSection();
+
+    SlabRef data = allocateSlabBlock(dataSize);
+    if (data == SLAB_NULL) {
+        leaveAllocationSection();
+        return -1;
+    }
+
+    int index;
+    if (storageHeader->freeCount > 0) {
+        index = *getFreeSlot(--storageHeader->freeCount);
+    }
+    else if (storageHeader->endIndex < storageHeader->chunkCount * STORAGE_CHUNK_SIZE ||
+             growStorage()) {
+        index = storageHeader->endIndex++;
+    }
+    else {
+        freeSlabBlock(data, dataSize);
+        leaveAllocationSection();
+        return -1;
+    }
+    // Schlüssel-Länge 0 bis der Eintrag befüllt ist, damit Leser ohne Lock
+    // den alten Inhalt des Blocks nie für einen Treffer halten
+    Record *record = getRecord(index);
+    beginRecordWrite(record);
+    record->data = data;
+    record->keyLength = 0;
+    endRecordWrite(record);
+
+    leaveAllocationSection();
+    return index;
+}
+
+
+/**
+ * Gibt den Platz eines Eintrags und den Slab-Block seiner Daten frei.
+ * Freie Plätze am Ende verkürzen "endIndex".
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param index - Index des Eintrags
+ */
+static void releaseStorageSlot (int index)
+{
+    Record *record = getRecord(index);
+
+    enterAllocationSection();
+
+    SlabRef data = record->data;
+    unsigned int dataSize = getRecordDataSize(record);
+
+    beginRecordWrite(record);
+    record->data = SLAB_NULL;
+    record->keyLength = 0;
+    endRecordWrite(record);
+    freeSlabBlock(data, dataSize);
+
+    if (index != storageHeader->endIndex - 1) {
+        pushFreeStorageSlot(index);
+    }
+    else {
+        storageHeader->endIndex--;
+        while (storageHeader->endIndex > 0 &&
+                getRecord(storageHeader->endIndex - 1)->data == SLAB_NULL) {
+            removeFreeStorageSlot(--storageHeader->endIndex);
+        }
+    }
+
+    leaveAllocationSection();
+}
+
+
+/**
+ * Findet den Index eines Schlüssels im Storage, bei Fehlschlag -1.
+ * Nicht gegen Race-Conditions gesichert.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Suchschlüssel
+ * @return - Index des gefundenen Eintrags
+ */
+int findStorageRecord (const char* key)
+{
+    size_t keyLength = strlen(key);
+    StorageIndexEntry *slot = findStorageIndexSlot(key, keyLength, hashStorageKey(key, keyLength));
+    return (slot != NULL) ? slot->record : -1;
+}
+
+
+/**
+ * Überschreibt den Wert eines Eintrags. Passt der neue Inhalt in die
+ * Größenklasse des alten Slab-Blocks, wird dieser weiterverwendet, sonst wird
+ * ein neuer Block reserviert und der alte freigegeben. Bei Fehlschlag bleibt
+ * der Eintrag unverändert.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param record - Zielobjekt
+ * @param value - Wert
+ * @param valueLength - Länge des Werts
+ */
+static bool overwriteRecordValue (Record *record, const char *value, size_t valueLength)
+{
+    unsigned int oldSize = getRecordDataSize(record);
+    unsigned int size = record->keyLength + valueLength + 2;
+
+    if (getSlabBlockSize(size) != getSlabBlockSize(oldSize)) {
+        enterAllocationSection();
+        SlabRef data = allocateSlabBlock(size);
+        leaveAllocationSection();
+
+        if (data == SLAB_NULL) {
+            return false;
+        }
+
+        SlabRef oldData = record->data;
+        memcpy(getSlabBlockAddress(data), getRecordKey(record), record->keyLength + 1);
+        memcpy((char*)getSlabBlockAddress(data) + record->keyLength + 1, value, valueLength + 1);
+
+        beginRecordWrite(record);
+        record->data = data;
+        record->valueLength = valueLength;
+        endRecordWrite(record);
+
+        // Erst nach dem Umhängen freigeben, Leser ohne Lock erkennen den
+        // Wechsel am Sequenz-Zähler
+        enterAllocationSection();
+        freeSlabBlock(oldData, oldSize);
+        leaveAllocationSection();
+        return true;
+    }
+
+    beginRecordWrite(record);
+    record->valueLength = valueLength;
+    memcpy(getRecordValue(record), value, valueLength + 1);
+    endRecordWrite(record);
+    return true;
+}
+
+
+/**
+ * Legt einen neuen Eintrag an und trägt ihn in den Index ein, bei Fehlschlag
+ * -1. Der Schlüssel darf noch nicht im Storage enthalten sein.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Schlüssel des Eintrags
+ * @param keyLength - Länge des Schlüssels
+ * @param hash - Hash des Schlüssels
+ * @param value - Wert des Eintrags
+ * @param valueLength - Länge des Werts
+ * @return - Index des Eintrags
+ */
+static int createStorageRecord (const char* key, size_t keyLength, unsigned int hash,
+                                const char* value, size_t valueLength)
+{
+    // Nimmt einen freien Platz aus dem Free-Slot-Stack oder einen Platz am Ende
+    int index = allocateStorageSlot(keyLength + valueLength + 2);
+    if (index == -1) {
+        return -1;
+    }
+
+    Record *record = getRecord(index);
+    beginRecordWrite(record);
+    record->hash = hash;
+    record->keyLength = keyLength;
+    record->valueLength = valueLength;
+    memcpy(getRecordKey(record), key, keyLength + 1);
+    memcpy(getRecordValue(record), value, valueLength + 1);
+    endRecordWrite(record);
+    insertStorageIndex(index);
+
+    return index;
+}
+
+
+/**
+ * Legt einen Eintrag an oder überschreibt seinen Wert, ohne Observer zu
+ * benachrichtigen. Rückgabewerte und Index wie bei "putStorageRecord".
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param key - Schlüssel des einzufügenden Eintrags
+ * @param keyLength - Länge des Schlüssels
+ * @param hash - Hash des Schlüssels
+ * @param value - Wert des einzufügenden Eintrags
+ * @param valueLength - Länge des Werts
+ * @param index - Index des Eintrags
+ */
+static int writeStorageRecord (const char* key, size_t keyLength, unsigned int hash,
+                               const char* value, size_t valueLength, int *index)
+{
+    int response;
+
+    // Sucht nach existierenden Einträgen
+    StorageIndexEntry *slot = findStorageIndexSlot(key, keyLength, hash);
+    if (slot != NULL) {
+        *index = slot->record;
+        response = overwriteRecordValue(getRecord(*index), value, valueLength) ? 1 : 0;
+    }
+    else {
+        *index = createStorageRecord(key, keyLength, hash, value, valueLength);
+        response = (*index != -1) ? 2 : 0;
+    }
+
+    if (response != 0) {
+        logJournalPut(key, keyLength, value, valueLength);
+        markRecordDirty(*index);
+    }
+    return response;
+}
+
+
+/**
+ * Entfernt einen Eintrag aus dem Index, gibt seinen Platz frei und
+ * protokolliert das Löschen, ohne Observer zu benachrichtigen.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param slot - Position des Eintrags im Storage-Index
+ * @param hash - Hash des Schlüssels
+ */
+static void eraseStorageRecord (StorageIndexEntry *slot, unsigned int hash)
+{
+    int index = slot->record;
+    Record *record = getRecord(index);
+
+    logJournalDelete(getRecordKey(record), record->keyLength);
+    markRecordDirty(index);
+    removeStorageIndex(slot, hash);
+    releaseStorageSlot(index);
+}
+
+
+/**
+ * Kopiert den Wert eines Eintrags ohne Lock, wenn der Eintrag zum Schlüssel
+ * gehört. Gibt 1 zurück wenn der Wert kopiert wurde, 0 wenn der Eintrag zu
+ * einem anderen Schlüssel gehört, und -1 wenn sich der Eintrag bei jedem
+ * Versuch während des Lesens geändert hat. Alle gelesenen Felder können
+ * halb geschrieben sein und werden erst durch den unveränderten
+ * Sequenz-Zähler gültig.
+ *
+ * @param record - Zielobjekt
+ * @param key - Suchschlüssel
+ * @param keyLength - Länge des Suchschlüssels
+ * @param hash - Hash des Suchschlüssels
+ * @param value - Wert des gefundenen Eintrags
+ */
+static int readRecordOptimistic (const Record *record, const char* key, size_t keyLength,
+                                 unsigned int hash, String* value)
+{
+    for (int attempt = 0; attempt < STORAGE_OPTIMISTIC_RETRIES; attempt++) {
+        unsigned int sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) continue; // Schreiber ist gerade dabei
+
+        SlabRef data = __atomic_load_n(&record->data, __ATOMIC_RELAXED);
+        unsigned int recordKeyLength = __atomic_load_n(&record->keyLength, __ATOMIC_RELAXED);
+        unsigned int valueLength = __atomic_load_n(&record->valueLength, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&record->hash, __ATOMIC_RELAXED) != hash ||
+                recordKeyLength != keyLength) {
+            return 0;
+        }
+
+        const char *block = getSlabBlockAddressChecked(data, keyLength + valueLength + 2);
+        if (block == NULL) continue;
+        if (memcmp(block, key, keyLength) != 0) {
+            return 0;
+        }
+
+        if (value->capacity < valueLength) {
+            stringReserve(value, valueLength);
+        }
+        memcpy(value->cStr, block + keyLength + 1, valueLength);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == sequence) {
+            value->cStr[valueLength] = '\0';
+            value->length = valueLength;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Sucht einen Schlüssel ohne Lock in der lokal eingehängten Partition des
+ * Storage-Index. Diese kann veraltet sein (sie wird nur unter Lock neu
+ * eingehängt), daher zählen nur Treffer, deren Eintrag noch zum Schlüssel
+ * gehört. Bei Fehlschlag muss unter Lock erneut gesucht werden.
+ *
+ * @param key - Suchschlüssel
+ * @param keyLength - Länge des Suchschlüssels
+ * @param hash - Hash des Suchschlüssels
+ * @param value - Wert des gefundenen Eintrags
+ */
+static bool findStorageRecordOptimistic (const char* key, size_t keyLength,
+                                         unsigned int hash, String* value)
+{
+    int partition = (int)getLockStripe(hash);
+    StorageIndexEntry *index = storageIndexes[partition];
+    if (index == NULL || isExclusiveModeActive() ||
+            __atomic_load_n(&storageHeader->indexPartitions[partition].segmentId, __ATOMIC_RELAXED) !=
+            storageIndexSegmentIds[partition]) {
+        return false;
+    }
+
+    int chunkCount = __atomic_load_n(&storageHeader->chunkCount, __ATOMIC_ACQUIRE);
+    unsigned int mask = storageIndexSizes[partition] - 1;
+    unsigned int slot = (hash >> LOCK_STRIPE_BITS) & mask;
+
+    for (unsigned int probe = 0; probe <= mask; probe++) {
+        StorageIndexEntry entry;
+        __atomic_load(&index[slot], &entry, __ATOMIC_ACQUIRE);
+        int recordIndex = entry.record;
+        if (recordIndex == STORAGE_INDEX_EMPTY) {
+            break;
+        }
+        if (recordIndex >= 0 && entry.hash == hash && recordIndex / STORAGE_CHUNK_SIZE < chunkCount) {
+            int result = readRecordOptimistic(getRecord(recordIndex), key, keyLength, hash, value);
+            if (result != 0) {
+                return result > 0;
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+
+/**
+ * Sucht einen Schlüssel im Storage und kopiert dessen Wert nach "value".
+ * Zuerst ohne Lock, bei Fehlschlag oder anhaltenden Änderungen am Eintrag
+ * unter dem Lock des Stripes.
+ *
+ * @param key - Suchschlüssel
+ * @param value - Wert des gefundenen Eintrags
+ */
+bool getStorageRecord (const char* key, String* value)
+{
+    size_t keyLength = strlen(key);
+    unsigned int hash = hashStorageKey(key, keyLength);
+
+    if (findStorageRecordOptimistic(key, keyLength, hash, value)) {
+        return true;
+    }
+
+    enterStripeSection(hash, READ_ACCESS);
+
+    StorageIndexEntry *slot = findStorageIndexSlot(key, keyLength, hash);
+    if (slot != NULL) {
+        stringCopy(value, getRecordValue(getRecord(slot->record)));
+
+        leaveStripeSection(hash, READ_ACCESS);
+        return true;
+    }
+
+    leaveStripeSection(hash, READ_ACCESS);
+    return false;
+}
+
+
+/**
+ * Macht einen Eintrag ins Storage. Hat folgende Rückgabewerte:
+ * - 1 Der Eintrag existierte schon, sein Wert wurde verändert
+ * - 2 Ein neuer Eintrag wurde angelegt
+ * - 0 Es war kein freier Platz verfügbar.
+ *
+ * @param key - Schlüssel des einzufügenden Eintrags
+ * @param value - Wert des einzufügenden Eintrags
+ */
+int putStorageRecord (const char* key, const char* value)
+{
+    size_t keyLength = strlen(key);
+    unsigned int hash = hashStorageKey(key, keyLength);
+
+    enterStripeSection(hash, WRITE_ACCESS);
+
+    int index;
+    int response = writeStorageRecord(key, keyLength, hash, value, strlen(value), &index);
+    if (response == 1) {
+        notifyAllObservers(NL_NOTIFICATION_PUT, index, key, value);
+    }
+    writeJournal();
+
+    leaveStripeSection(hash, WRITE_ACCESS);
+    commitJournal();
+    return response;
+}
+
+
+/**
+ * Entfernt einen Eintrag aus dem Storage und gibt seinen Platz frei.
+ *
+ * @param key - Schlüssel des zu löschenden Eintrags
+ */
+bool deleteStorageRecord (const char* key)
+{
+    size_t keyLength = strlen(key);
+    unsigned int hash = hashStorageKey(key, keyLength);
+
+    enterStripeSection(hash, WRITE_ACCESS);
+
+    StorageIndexEntry *slot = findStorageIndexSlot(key, keyLength, hash);
+    if (slot != NULL) {
+        notifyAllObservers(NL_NOTIFICATION_DEL, slot->record, key, keyDeletedMsg);
+
+        eraseStorageRecord(slot, hash);
+        writeJournal();
+
+        leaveStripeSection(hash, WRITE_ACCESS);
+        commitJournal();
+        return true;
+    }
+
+    leaveStripeSection(hash, WRITE_ACCESS);
+    return false;
+}
+
+
+/**
+ * Berechnet Länge und Hash aller Schlüssel eines Batches (in
+ * "batchKeyLengths" und "batchKeyHashes") und gibt die Menge der
+ * Lock-Stripes zurück, zu denen sie gehören.
+ *
+ * @param keys - Schlüssel (char*)
+ */
+static StripeSet hashStorageKeyBatch (const Array* keys)
+{
+    if (arraySize(keys) > batchKeyCapacity) {
+        batchKeyCapacity = arraySize(keys);
+        batchKeyLengths = realloc(batchKeyLengths, batchKeyCapacity * sizeof(size_t));
+        batchKeyHashes = realloc(batchKeyHashes, batchKeyCapacity * sizeof(unsigned int));
+    }
+
+    StripeSet stripes = 0;
+    for (size_t i = 0; i < arraySize(keys); i++) {
+        const char *key = arrayGetItem(keys, i);
+        batchKeyLengths[i] = strlen(key);
+        batchKeyHashes[i] = hashStorageKey(key, batchKeyLengths[i]);
+        stripes |= getLockStripeBit(batchKeyHashes[i]);
+    }
+    return stripes;
+}
+
+
+/**
+ * Sucht mehrere Schlüssel im Storage und fügt für jeden einen Datensatz mit
+ * seinem Wert (oder "key_nonexistent") dem Ergebnis-Array hinzu. Die Stripes
+ * aller Schlüssel werden nur einmal gesperrt.
+ *
+ * @param keys - Suchschlüssel (char*)
+ * @param result - Ergebnis-Array
+ */
+void getStorageRecordBatch (const Array* keys, Array* result)
+{
+    size_t count = arraySize(keys);
+    StripeSet stripes = hashStorageKeyBatch(keys);
+
+    enterStripeSetSection(stripes, READ_ACCESS);
+
+    for (size_t i = 0; i < count; i++) {
+        const char *key = arrayGetItem(keys, i);
+        StorageIndexEntry *slot = findStorageIndexSlot(key, batchKeyLengths[i], batchKeyHashes[i]);
+        responseRecordsAdd(result, key, (slot != NULL) ? getRecordValue(getRecord(slot->record)) : "key_nonexistent");
+    }
+
+    leaveStripeSetSection(stripes, READ_ACCESS);
+}
+
+
+/**
+ * Macht mehrere Einträge ins Storage (wie "putStorageRecord") und fügt für
+ * jeden einen Datensatz mit seinem Wert (oder "storage_full") dem
+ * Ergebnis-Array hinzu. Die Stripes aller Schlüssel werden nur einmal gesperrt.
+ *
+ * @param keys - Schlüssel der einzufügenden Einträge (char*)
+ * @param values - Werte der einzufügenden Einträge (char*)
+ * @param result - Ergebnis-Array
+ */
+void putStorageRecordBatch (const Array* keys, const Array* values, Array* result)
+{
+    size_t count = arraySize(keys);
+    StripeSet stripes = hashStorageKeyBatch(keys);
+
+    enterStripeSetSection(stripes, WRITE_ACCESS);
+
+    for (size_t i = 0; i < count; i++) {
+        const char *key = arrayGetItem(keys, i);
+        const char *value = arrayGetItem(values, i);
+
+        int index;
+        int response = writeStorageRecord(key, batchKeyLengths[i], batchKeyHashes[i],
+                                          value, strlen(value), &index);
+        if (response == 1) {
+            notifyAllObservers(NL_NOTIFICATION_PUT, index, key, value);
+        }
+        responseRecordsAdd(result, key, (response > 0) ? value : "storage_full");
+    }
+    writeJournal();
+
+    leaveStripeSetSection(stripes, WRITE_ACCESS);
+    commitJournal();
+}
+
+
+/**
+ * Entfernt mehrere Einträge aus dem Storage (wie "deleteStorageRecord") und
+ * fügt für jeden Schlüssel einen Datensatz mit "key_deleted" oder
+ * "key_nonexistent" dem Ergebnis-Array hinzu. Die Stripes aller Schlüssel
+ * werden nur einmal gesperrt.
+ *
+ * @param keys - Schlüssel der zu löschenden Einträge (char*)
+ * @param result - Ergebnis-Array
+ */
+void deleteStorageRecordBatch (const Array* keys, Array* result)
+{
+    size_t count = arraySize(keys);
+    StripeSet stripes = hashStorageKeyBatch(keys);
+
+    enterStripeSetSection(stripes, WRITE_ACCESS);
+
+    for (size_t i = 0; i < count; i++) {
+        const char *key = arrayGetItem(keys, i);
+        StorageIndexEntry *slot = findStorageIndexSlot(key, batchKeyLengths[i], batchKeyHashes[i]);
+        if (slot == NULL) {
+            responseRecordsAdd(result, key, "key_nonexistent");
+            continue;
+        }
+
+        notifyAllObservers(NL_NOTIFICATION_DEL, slot->record, key, keyDeletedMsg);
+
+        eraseStorageRecord(slot, batchKeyHashes[i]);
+        responseRecordsAdd(result, key, keyDeletedMsg);
+    }
+    writeJournal();
+
+    leaveStripeSetSection(stripes, WRITE_ACCESS);
+    commitJournal();
+}
+
+
+/**
+ * Sucht alle Treffer des Wildcard-Suchschlüssels (siehe
+ * findWildcardStorageRecords()) und fügt sie dem Ergebnis-Array hinzu.
+ *
+ * @param wildcardKey - Wildcard-Suchschlüssel
+ * @param result - Ergebnis-Array
+ */
+void getMultipleStorageRecords (const char* wildcardKey, Array* result)
+{
+    enterCriticalSection(READ_ACCESS);
+    findWildcardStorageRecords(wildcardKey, addWildcardRecord, result);
+    leaveCriticalSection(READ_ACCESS);
+}
+
+
+/**
+ * Zählt die Treffer des Wildcard-Suchschlüssels. Besteht er nur aus einem
+ * Präfix und "*", wird die Anzahl aus den Teilbäumen des Präfix-Index
+ * abgelesen, ohne die Einträge zu besuchen.
+ *
+ * @param wildcardKey - Wildcard-Suchschlüssel
+ */
+long countMultipleStorageRecords (const char* wildcardKey)
+{
+    size_t prefixLength = strcspn(wildcardKey, "*?");
+    long counter = 0;
+
+    enterCriticalSection(READ_ACCESS);
+    if (prefixLength > 0 && strcmp(&wildcardKey[prefixLength], "*") == 0) {
+        for (int partition = 0; partition < LOCK_STRIPES; partition++) {
+            counter += seekPrefixIndex(partition, wildcardKey, prefixLength, NULL, 0);
+        }
+    }
+    else {
+        findWildcardStorageRecords(wildcardKey, countWildcardRecord, &counter);
+    }
+    leaveCriticalSection(READ_ACCESS);
+
+    return counter;
+}
+
+
+/**
+ * Schreibt die nächsten Treffer eines Wildcard-Suchschlüssels mit festem Präfix
+ * in den Ausgabepuffer (siehe streamMultipleStorageRecords()). Pro Abschnitt
+ * wird nur der Stripe einer Partition gesperrt, der Durchlauf setzt hinter dem
+ * zuletzt besuchten Schlüssel fort (stream->resumeKey).
+ *
+ * @param stream - Antwort-Stream, "cursor" ist die aktuelle Partition
+ * @param output - Ausgabepuffer
+ * @param limit - Gewünschte Länge des Ausgabepuffers
+ * @param pattern - Vorbereiteter Wildcard-Suchschlüssel
+ * @param prefixLength - Länge des festen Präfixes
+ */
+static bool streamPrefixStorageRecords (ResponseStream* stream, String* output, size_t limit,
+                                        const WildcardPattern *pattern, size_t prefixLength)
+{
+    const char *wildcardKey = stream->key->cStr;
+
+    while (stringLength(output) < limit) {
+        if (stream->cursor >= LOCK_STRIPES) return true;
+
+        int partition = stream->cursor;
+        enterStripeSection(partition, READ_ACCESS);
+
+        if (stringIsEmpty(stream->resumeKey)) {
+            seekPrefixIndex(partition, wildcardKey, prefixLength, NULL, 0);
+        }
+        else {
+            seekPrefixIndex(partition, wildcardKey, prefixLength,
+                            stream->resumeKey->cStr, stringLength(stream->resumeKey));
+        }
+
+        int last = -1;
+        int i = nextPrefixIndex();
+        for (int visited = 0; i != -1; i = nextPrefixIndex()) {
+            Record *record = getRecord(i);
+            if (strMatchCompiledWildcard(pattern, getRecordKey(record), record->keyLength)) {
+                responseStreamAppendRecord(stream, output, getRecordKey(record), record->keyLength,
+                                           getRecordValue(record), record->valueLength);
+            }
+            last = i;
+            if (++visited >= STORAGE_SCAN_CHUNK_SIZE || output->length >= limit) break;
+        }
+
+        if (i == -1) {
+            stringCopy(stream->resumeKey, "");
+            stream->cursor++;
+        }
+        else {
+            stringCopy(stream->resumeKey, getRecordKey(getRecord(last)));
+        }
+
+        leaveStripeSection(partition, READ_ACCESS);
+    }
+    return false;
+}
+
+
+/**
+ * Schreibt die nächsten Treffer eines Wildcard-Suchschlüssels (stream->key)
+ * direkt in den Ausgabepuffer, bis dieser "limit" Zeichen enthält. Das Lock
+ * wird nur für jeweils STORAGE_SCAN_CHUNK_SIZE Einträge gehalten, nicht für
+ * das Senden, Schreiber kommen also zwischen den Abschnitten zum Zug. Anders
+ * als bei getMultipleStorageRecords() ist das Ergebnis deshalb kein Abbild
+ * eines Zeitpunkts, jeder Eintrag ist aber in sich konsistent. Gibt true
+ * zurück, wenn alle Einträge durchsucht wurden. Beginnt der Suchschlüssel mit
+ * festen Zeichen, wird stattdessen der Präfix-Index einer Partition nach der
+ * anderen durchlaufen und nur deren Stripe gesperrt.
+ *
+ * @param stream - Antwort-Stream, "cursor" ist der nächste Eintrag bzw. die Partition
+ * @param output - Ausgabepuffer
+ * @param limit - Gewünschte Länge des Ausgabepuffers
+ */
+bool streamMultipleStorageRecords (ResponseStream* stream, String* output, size_t limit)
+{
+    const char *wildcardKey = stream->key->cStr;
+    size_t prefixLength = strcspn(wildcardKey, "*?");
+    WildcardPattern pattern;
+    strCompileWildcard(&pattern, wildcardKey);
+
+    if (prefixLength > 0) {
+        return streamPrefixStorageRecords(stream, output, limit, &pattern, prefixLength);
+    }
+
+    while (stringLength(output) < limit) {
+        enterCriticalSection(READ_ACCESS);
+
+        int end = storageHeader->endIndex;
+        int scanEnd = (end - stream->cursor > STORAGE_SCAN_CHUNK_SIZE) ?
+                      stream->cursor + STORAGE_SCAN_CHUNK_SIZE : end;
+        int i = stream->cursor;
+        for (; i < scanEnd && output->length < limit; i++) {
+            Record *record = getRecord(i);
+            if (record->data != SLAB_NULL &&
+                    strMatchCompiledWildcard(&pattern, getRecordKey(record), record->keyLength)) {
+                responseStreamAppendRecord(stream, output, getRecordKey(record), record->keyLength,
+                                           getRecordValue(record), record->valueLength);
+            }
+        }
+
+        leaveCriticalSection(READ_ACCESS);
+
+        stream->cursor = i;
+        if (i >= end) return true;
+    }
+    return false;
+}
+
+
+/**
+ * Durchsucht die Einträge ab Position "cursor" und fügt bis zu "count" Treffer
+ * dem Ergebnis-Array hinzu. Das Lock wird nur für jeweils
+ * STORAGE_SCAN_CHUNK_SIZE Einträge gehalten, pro Aufruf werden höchstens
+ * STORAGE_SCAN_MAX_ENTRIES Einträge durchsucht (auch ohne Treffer). Einträge
+ * behalten ihre Position, ein Eintrag der während des ganzen Durchlaufs
+ * existiert wird also genau einmal geliefert. Gibt die Position für den
+ * nächsten Aufruf zurück, 0 wenn alle Einträge durchsucht wurden.
+ *
+ * @param cursor - Erste zu durchsuchende Position
+ * @param wildcardKey - Wildcard-Suchschlüssel
+ * @param count - Maximale Anzahl an Treffern
+ * @param result - Ergebnis-Array
+ */
+int scanStorageRecords (int cursor, const char* wildcardKey, int count, Array* result)
+{
+    int i = cursor;
+    int end;
+    WildcardPattern pattern;
+    strCompileWildcard(&pattern, wildcardKey);
+
+    do {
+        enterCriticalSection(READ_ACCESS);
+
+        end = storageHeader->endIndex;
+        int chunkEnd = (end - i > STORAGE_SCAN_CHUNK_SIZE) ? i + STORAGE_SCAN_CHUNK_SIZE : end;
+        for (; i < chunkEnd && result->size < (size_t)count; i++) {
+            Record *record = getRecord(i);
+            if (record->data != SLAB_NULL &&
+                    strMatchCompiledWildcard(&pattern, getRecordKey(record), record->keyLength)) {
+                responseRecordsAdd(result, getRecordKey(record), getRecordValue(record));
+            }
+        }
+
+        leaveCriticalSection(READ_ACCESS);
+    } while (i < end && result->size < (size_t)count && i - cursor < STORAGE_SCAN_MAX_ENTRIES);
+
+    return (i < end) ? i : 0;
+}
+
+
+/**
+ * Sucht alle Treffer des Wildcard-Suchschlüssels (siehe
+ * findWildcardStorageRecords()) und fügt sie dem Ergebnis-Array hinzu.
+ * Entfernt alle gefundenen Einträge aus dem Storage und gibt ihre Plätze frei.
+ *
+ * @param wildcardKey - Wildcard-Suchschlüssel
+ * @param result - Ergebnis-Array
+ */
+void deleteMultipleStorageRecords (const char* wildcardKey, Array* result)
+{
+    enterCriticalSection(WRITE_ACCESS);
+
+    // Erst suchen, dann löschen (das Löschen ändert den Präfix-Index)
+    wildcardMatchCount = 0;
+    findWildcardStorageRecords(wildcardKey, collectWildcardRecord, NULL);
+
+    for (size_t m = 0; m < wildcardMatchCount; m++) {
+        int i = wildcardMatches[m];
+        Record *record = getRecord(i);
+        const char *key = getRecordKey(record);
+
+        responseRecordsAdd(result, key, keyDeletedMsg);
+
+        notifyAllObservers(NL_NOTIFICATION_DEL, i, key, keyDeletedMsg);
+
+        eraseStorageRecord(findStorageIndexSlot(key, record->keyLength, record->hash),
+                           record->hash);
+    }
+    writeJournal();
+
+    leaveCriticalSection(WRITE_ACCESS);
+    commitJournal();
+}
+
+
+/**
+ * Befüllt das Storage mit den Einträgen aus der "STORAGE_FILE"-Datei.
+ * Zeilenweise Einträge, Schlüssel und Wert kommasepariert.
+ * Nur beim Start in ein leeres Storage aufrufen.
+ *
+ */
+bool loadStorageFromFile ()
+{
+    char lineBuffer[FILE_BUFFER_SIZE];
+
+    FILE *file = fopen(STORAGE_FILE, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    storageHeader->endIndex = 0;
+    storageHeader->freeCount = 0;
+
+    while (fgets(lineBuffer, sizeof(lineBuffer), file)) {
+        const char* key = strtok(lineBuffer,  ",");
+        const char* value = strtok(NULL, "\n");
+
+        if (key == NULL || value == NULL) continue;
+
+        // Doppelte Schlüssel überschreiben den vorherigen Wert
+        size_t keyLength = strlen(key);
+        int index;
+        if (writeStorageRecord(key, keyLength, hashStorageKey(key, keyLength),
+                               value, strlen(value), &index) == 0) break;
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+/**
+ * Wendet einen Datensatz des Journals beim Start auf das Storage an.
+ * Schlüssel und Wert müssen genau ihre Länge lang und danach terminiert sein
+ * (Länge + 1 Byte muss lesbar sein), sonst wird der Datensatz verworfen.
+ * Nur beim Start in ein noch nicht geteiltes Storage aufrufen.
+ *
+ * @param type - JOURNAL_PUT oder JOURNAL_DEL
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ * @param value - Wert (nur JOURNAL_PUT)
+ * @param valueLength - Länge des Werts
+ */
+static void applyJournalRecord (int type, const char *key, size_t keyLength,
+                                const char *value, size_t valueLength)
+{
+    if (strnlen(key, keyLength + 1) != keyLength || strnlen(value, valueLength + 1) != valueLength) {
+        fprintf(stderr, "applyJournalRecord: damaged record ignored\n");
+        return;
+    }
+
+    unsigned int hash = hashStorageKey(key, keyLength);
+
+    if (type == JOURNAL_PUT) {
+        int index;
+        writeStorageRecord(key, keyLength, hash, value, valueLength, &index);
+    }
+    else {
+        StorageIndexEntry *slot = findStorageIndexSlot(key, keyLength, hash);
+        if (slot != NULL) {
+            eraseStorageRecord(slot, hash);
+        }
+    }
+}
+
+
+/**
+ * Wiederholt die Änderungen aus dem Journal (siehe replayJournal()) auf dem
+ * geladenen Snapshot. Gibt die Anzahl der Datensätze zurück, -1 ohne Journal.
+ * Nur beim Start nach dem Laden des Snapshots aufrufen.
+ *
+ */
+long loadStorageFromJournal ()
+{
+    return replayJournal(applyJournalRecord);
+}
+
+
+/**
+ * Kopiert die Einträge bis "endIndex" und alle Slab-Chunks in privaten
+ * Speicher des Prozesses (große memcpy()-Blöcke statt eines Durchlaufs über
+ * die einzelnen Einträge). Die Kopie kann danach ohne Lock gespeichert
+ * werden. Schon reservierter Speicher wird weiterverwendet.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param copy - Zielobjekt (beim ersten Aufruf mit Nullen initialisiert)
+ */
+static bool copyStorage (StorageCopy *copy)
+{
+    int endIndex = storageHeader->endIndex;
+    if (endIndex > copy->capacity) {
+        Record *records = realloc(copy->records, (size_t)endIndex * sizeof(Record));
+        if (records == NULL) {
+            perror("copyStorage realloc");
+            return false;
+        }
+        copy->records = records;
+        copy->capacity = endIndex;
+    }
+
+    for (int chunk = 0; chunk * STORAGE_CHUNK_SIZE < endIndex; chunk++) {
+        int count = endIndex - chunk * STORAGE_CHUNK_SIZE;
+        if (count > STORAGE_CHUNK_SIZE) count = STORAGE_CHUNK_SIZE;
+        memcpy(&copy->records[chunk * STORAGE_CHUNK_SIZE], getStorageChunk(chunk)->records,
+               (size_t)count * sizeof(Record));
+    }
+    // Die Kopie ist ab jetzt der Stand, auf den sich die nächsten Änderungen beziehen
+    for (int chunk = 0; chunk < storageHeader->chunkCount; chunk++) {
+        memset(getStorageChunk(chunk)->dirtyRecords, 0, sizeof(getStorageChunk(chunk)->dirtyRecords));
+    }
+    copy->endIndex = endIndex;
+
+    return copySlabChunks(&copy->slab);
+}
+
+
+static void freeStorageCopy (StorageCopy *copy)
+{
+    free(copy->records);
+    free(copy->changed);
+    free(copy->deleted);
+    freeSlabCopy(&copy->slab);
+    memset(copy, 0, sizeof(StorageCopy));
+}
+
+
+static inline const char* getCopiedRecordKey (const StorageCopy *copy, const Record *record)
+{
+    return getSlabCopyAddress(&copy->slab, record->data);
+}
+
+
+static inline size_t getSnapshotRecordSize (unsigned int keyLength, unsigned int valueLength)
+{
+    return sizeof(StorageSnapshotRecord) + (((size_t)keyLength + valueLength + 2 + 3) & ~(size_t)3);
+}
+
+
+/**
+ * Packt einen Eintrag im Format des Snapshots (siehe StorageSnapshotRecord).
+ *
+ * @param target - Ziel mit getSnapshotRecordSize() Bytes
+ * @param hash - Hash des Schlüssels
+ * @param key - Schlüssel
+ * @param keyLength - Länge des Schlüssels
+ * @param value - Wert
+ * @param valueLength - Länge des Werts
+ */
+static void packSnapshotRecord (char *target, unsigned int hash, const char *key, unsigned int keyLength,
+                                const char *value, unsigned int valueLength)
+{
+    StorageSnapshotRecord *packed = (StorageSnapshotRecord*)target;
+    packed->hash = hash;
+    packed->keyLength = keyLength;
+    packed->valueLength = valueLength;
+
+    char *block = (char*)&packed[1];
+    size_t padding = getSnapshotRecordSize(keyLength, valueLength) - sizeof(StorageSnapshotRecord) -
+                     keyLength - valueLength - 1;
+    memcpy(block, key, keyLength);
+    block[keyLength] = '\0';
+    memcpy(&block[keyLength + 1], value, valueLength);
+    memset(&block[keyLength + 1 + valueLength], 0, padding);
+}
+
+
+/**
+ * Merkt sich den Schlüssel eines Eintrags der Kopie als gelöscht (gepackt
+ * mit leerem Wert), bevor sein Platz in der Kopie überschrieben wird.
+ *
+ * @param copy - Kopie des Storage
+ * @param record - Eintrag in der Kopie
+ */
+static bool addDeletedStorageKey (StorageCopy *copy, const Record *record)
+{
+    size_t size = getSnapshotRecordSize(record->keyLength, 0);
+    if (copy->deletedSize + size > copy->deletedCapacity) {
+        size_t capacity = (copy->deletedCapacity > 0) ? copy->deletedCapacity * 2 : FILE_BUFFER_SIZE;
+        while (capacity < copy->deletedSize + size) capacity *= 2;
+
+        char *deleted = realloc(copy->deleted, capacity);
+        if (deleted == NULL) {
+            perror("addDeletedStorageKey realloc");
+            return false;
+        }
+        copy->deleted = deleted;
+        copy->deletedCapacity = capacity;
+    }
+
+    packSnapshotRecord(&copy->deleted[copy->deletedSize], record->hash,
+                       getCopiedRecordKey(copy, record), record->keyLength, "", 0);
+    copy->deletedSize += size;
+    copy->deleteCount++;
+    return true;
+}
+
+
+/**
+ * Bringt eine Kopie (siehe copyStorage()) auf den aktuellen Stand, indem
+ * nur die seit der letzten Kopie geänderten Einträge (Bitmap der Chunks)
+ * und ihre Slab-Blöcke kopiert werden. Danach stehen in "changed" die
+ * geänderten Plätze und in "deleted" alle Schlüssel, die dabei aus der
+ * Kopie verschwunden sind (gelöscht oder an einen anderen Platz gewandert).
+ * Auf einen Snapshot angewendet ergeben erst die gelöschten Schlüssel, dann
+ * die geänderten Einträge den Stand der Kopie. Die Blöcke der übrigen
+ * Einträge wurden seit der letzten Kopie nicht verändert und bleiben gültig.
+ * Bei Fehlschlag ist die Kopie unbrauchbar, es muss wieder vollständig
+ * kopiert werden.
+ * NICHT AUSSERHALB EINES KRITISCHEN ABSCHNITTS AUFRUFEN!!!
+ *
+ * @param copy - Kopie des Storage
+ */
+static bool copyStorageChanges (StorageCopy *copy)
+{
+    int endIndex = storageHeader->endIndex;
+    if (endIndex > copy->capacity) {
+        Record *records = realloc(copy->records, (size_t)endIndex * sizeof(Record));
+        if (records == NULL) {
+            perror("copyStorageChanges realloc");
+            return false;
+        }
+        copy->records = records;
+        copy->capacity = endIndex;
+    }
+    for (int i = copy->endIndex; i < endIndex; i++) {
+        copy->records[i].data = SLAB_NULL;
+    }
+
+    copy->changedCount = 0;
+    copy->deletedSize = 0;
+    copy->deleteCount = 0;
+
+    // Erst die alten Schlüssel sichern, ihre Blöcke können gleich überschrieben werden
+    for (int chunk = 0; chunk < storageHeader->chunkCount; chunk++) {
+        unsigned long *dirtyRecords = getStorageChunk(chunk)->dirtyRecords;
+
+        for (int word = 0; word < STORAGE_CHUNK_SIZE / 64; word++) {
+            unsigned long bits = __atomic_exchange_n(&dirtyRecords[word], 0, __ATOMIC_RELAXED);
+            while (bits != 0) {
+                int index = chunk * STORAGE_CHUNK_SIZE + word * 64 + __builtin_ctzl(bits);
+                bits &= bits - 1;
+                if (index >= endIndex && index >= copy->endIndex) continue;
+
+                const Record *old = &copy->records[index];
+                const Record *record = getRecord(index);
+                bool live = index < endIndex && record->data != SLAB_NULL;
+                if (old->data != SLAB_NULL &&
+                        !(live && record->hash == old->hash && record->keyLength == old->keyLength &&
+                          memcmp(getRecordKey(record), getCopiedRecordKey(copy, old), old->keyLength) == 0) &&
+                        !addDeletedStorageKey(copy, old)) {
+                    return false;
+                }
+
+                if (copy->changedCount == copy->changedCapacity) {
+                    int capacity = (copy->changedCapacity > 0) ? copy->changedCapacity * 2 : 1024;
+                    int *changed = realloc(copy->changed, (size_t)capacity * sizeof(int));
+                    if (changed == NULL) {
+                        perror("copyStorageChanges realloc");
+                        return false;
+                    }
+                    copy->changed = changed;
+                    copy->changedCapacity = capacity;
+                }
+                copy->changed[copy->changedCount++] = index;
+            }
+        }
+    }
+
+    for (int i = 0; i < copy->changedCount; i++) {
+        int index = copy->changed[i];
+        if (index >= endIndex) continue;
+
+        const Record *record = getRecord(index);
+        copy->records[index] = *record;
+        if (record->data != SLAB_NULL &&
+                !copySlabBlock(&copy->slab, record->data, getRecordDataSize(record))) {
+            return false;
+        }
+    }
+    copy->endIndex = endIndex;
+    return true;
+}
+
+
+/**
+ * Führt die Prüfsumme eines Snapshots über weitere Daten fort (Fletcher-64
+ * über 32-Bit-Wörter, die Summen werden nur alle 4096 Wörter reduziert).
+ *
+ * @param checksum - Bisherige Prüfsumme, 0 am Anfang
+ * @param data - Daten (an 4 Byte ausgerichtet)
+ * @param length - Länge der Daten (Vielfaches von 4)
+ */
+static unsigned long long checksumSnapshotData (unsigned long long checksum, const void *data, size_t length)
+{
+    const unsigned int *words = data;
+    size_t count = length / 4;
+    unsigned long long sum1 = checksum & 0xFFFFFFFF;
+    unsigned long long sum2 = checksum >> 32;
+
+    while (count > 0) {
+        size_t block = (count > 4096) ? 4096 : count;
+        count -= block;
+        while (block-- > 0) {
+            sum1 += *words++;
+            sum2 += sum1;
+        }
+        sum1 %= 0xFFFFFFFF;
+        sum2 %= 0xFFFFFFFF;
+    }
+    return (sum2 << 32) | sum1;
+}
+
+
+static bool writeSnapshotData (int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            perror("writeSnapshotData write");
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+/**
+ * Bereitet einen gepufferten Schreiber für die Datei ab ihrer aktuellen
+ * Position vor.
+ *
+ * @param writer - Zielobjekt
+ * @param fd - Geöffnete Datei
+ */
+static bool openSnapshotWriter (StorageSnapshotWriter *writer, int fd)
+{
+    memset(writer, 0, sizeof(StorageSnapshotWriter));
+    writer->fd = fd;
+    writer->capacity = STORAGE_SNAPSHOT_BUFFER_SIZE;
+    writer->buffer = malloc(writer->capacity);
+    writer->checksummed = true;
+    return writer->buffer != NULL;
+}
+
+
+static void flushSnapshotWriter (StorageSnapshotWriter *writer)
+{
+    if (!writer->failed && writer->used > 0) {
+        if (writer->checksummed) {
+            writer->checksum = checksumSnapshotData(writer->checksum, writer->buffer, writer->used);
+        }
+        writer->dataSize += writer->used;
+        writer->failed = !writeSnapshotData(writer->fd, writer->buffer, writer->used);
+    }
+    writer->used = 0;
+}
+
+
+/**
+ * Reserviert Platz am Ende des Puffers, der volle Puffer wird vorher mit
+ * einem write() geschrieben. Bei Fehlschlag NULL.
+ *
+ * @param writer - Zielobjekt
+ * @param size - Benötigte Bytes (mit Prüfsumme ein Vielfaches von 4)
+ */
+static char* reserveSnapshotWriter (StorageSnapshotWriter *writer, size_t size)
+{
+    if (writer->used + size > writer->capacity) {
+        flushSnapshotWriter(writer);
+        if (size > writer->capacity) {
+            char *buffer = realloc(writer->buffer, size);
+            if (buffer == NULL) {
+                writer->failed = true;
+                return NULL;
+            }
+            writer->buffer = buffer;
+            writer->capacity = size;
+        }
+    }
+    char *target = &writer->buffer[writer->used];
+    writer->used += size;
+    return target;
+}
+
+
+/**
+ * Schreibt den Rest des Puffers und gibt ihn frei. Gibt false zurück, wenn
+ * eine Schreiboperation fehlgeschlagen ist.
+ *
+ * @param writer - Zielobjekt
+ */
+static bool closeSnapshotWriter (StorageSnapshotWriter *writer)
+{
+    flushSnapshotWriter(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return !writer->failed;
+}
+
+
+/**
+ * Legt eine leere temporäre Datei an, die nach dem Schreiben mit
+ * replaceStorageFile() umbenannt wird. Eine alte (abgebrochenes Speichern)
+ * wird vorher gelöscht, damit ein noch schreibender Prozess nicht in die
+ * neue Datei schreibt. Gibt bei Fehlschlag -1 zurück.
+ *
+ * @param path - Temporäre Datei
+ */
+static int createStorageTempFile (const char *path)
+{
+    unlink(path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        perror("createStorageTempFile open");
+    }
+    return fd;
+}
+
+
+static bool syncStorageDirectory ()
+{
+    int fd = open(STORAGE_DIRECTORY, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        perror("syncStorageDirectory open");
+        return false;
+    }
+    bool success = fsync(fd) == 0;
+    if (!success) {
+        perror("syncStorageDirectory fsync");
+    }
+    close(fd);
+    return success;
+}
+
+
+/**
+ * Ersetzt eine Datei atomar durch die vollständig geschriebene und
+ * synchronisierte temporäre Datei, sonst wird die temporäre Datei gelöscht
+ * und die alte bleibt unverändert. Das Verzeichnis wird danach
+ * synchronisiert, damit die Umbenennung auf der Platte ist, bevor das
+ * Journal geleert wird.
+ *
+ * @param tempPath - Temporäre Datei (siehe createStorageTempFile())
+ * @param path - Zu ersetzende Datei
+ * @param complete - Die temporäre Datei wurde vollständig geschrieben
+ */
+static bool replaceStorageFile (const char *tempPath, const char *path, bool complete)
+{
+    if (complete && rename(tempPath, path) == -1) {
+        perror("replaceStorageFile rename");
+        complete = false;
+    }
+    if (!complete) {
+        unlink(tempPath);
+        return false;
+    }
+    return syncStorageDirectory();
+}
+
+
+/**
+ * Speichert eine Kopie des Storage in die "STORAGE_FILE"-Datei.
+ * Zeilenweise Einträge, Schlüssel und Wert kommasepariert. Jede Zeile
+ * entsteht im Schreibpuffer aus dem kopierten Block "key\0value\0" (die
+ * beiden '\0' werden ersetzt), der volle Puffer wird mit einem write()
+ * geschrieben. Die alte Datei wird erst ersetzt, wenn die neue vollständig
+ * auf der Platte ist.
+ *
+ * @param copy - Kopie des Storage (siehe copyStorage())
+ */
+bool saveStorageToFile (const StorageCopy *copy)
+{
+    int fd = createStorageTempFile(STORAGE_TEMP_FILE);
+    if (fd == -1) {
+        return false;
+    }
+
+    StorageSnapshotWriter writer;
+    bool success = openSnapshotWriter(&writer, fd);
+
+    if (success) {
+        writer.checksummed = false;
+        for (int i = 0; !writer.failed && i < copy->endIndex; i++) {
+            const Record *record = &copy->records[i];
+            if (record->data == SLAB_NULL) continue;
+
+            unsigned int size = getRecordDataSize(record);
+            char *line = reserveSnapshotWriter(&writer, size);
+            if (line != NULL) {
+                memcpy(line, getCopiedRecordKey(copy, record), size);
+                line[record->keyLength] = ',';
+                line[size - 1] = '\n';
+            }
+        }
+        success = closeSnapshotWriter(&writer);
+    }
+
+    success = success && fsync(fd) == 0;
+    close(fd);
+    return replaceStorageFile(STORAGE_TEMP_FILE, STORAGE_FILE, success);
+}
+
+
+/**
+ * Befüllt das Storage aus der binären "STORAGE_SNAPSHOT_FILE"-Datei. Die
+ * Datei wird eingeblendet, geprüft (Kennung, Version, Größe, Prüfsumme) und
+ * jeder Eintrag mit seinem gespeicherten Hash direkt in seinen Slab-Block
+ * kopiert, ohne Zerlegen und ohne Suche nach doppelten Schlüsseln. Gibt
+ * false zurück, wenn die Datei fehlt oder ungültig ist.
+ * Nur beim Start in ein leeres Storage aufrufen.
+ *
+ */
+bool loadStorageFromSnapshot ()
+{
+    int fd = open(STORAGE_SNAPSHOT_FILE, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(StorageSnapshotHeader)) {
+        fprintf(stderr, "loadStorageFromSnapshot: %s is too short\n", STORAGE_SNAPSHOT_FILE);
+        close(fd);
+        return false;
+    }
+
+    const char *file = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        perror("loadStorageFromSnapshot mmap");
+        return false;
+    }
+
+    const StorageSnapshotHeader *header = (const StorageSnapshotHeader*)file;
+    const char *data = file + sizeof(StorageSnapshotHeader);
+    size_t dataSize = info.st_size - sizeof(StorageSnapshotHeader);
+
+    if (memcmp(header->magic, STORAGE_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != STORAGE_SNAPSHOT_VERSION || header->dataSize != dataSize ||
+            dataSize % 4 != 0 || checksumSnapshotData(0, data, dataSize) != header->checksum) {
+        fprintf(stderr, "loadStorageFromSnapshot: %s is invalid\n", STORAGE_SNAPSHOT_FILE);
+        munmap((void*)file, info.st_size);
+        return false;
+    }
+
+    size_t offset = 0;
+    for (unsigned int i = 0; i < header->recordCount; i++) {
+        const StorageSnapshotRecord *packed = (const StorageSnapshotRecord*)&data[offset];
+        if (dataSize - offset < sizeof(StorageSnapshotRecord)) break;
+
+        size_t blockSize = (size_t)packed->keyLength + packed->valueLength + 2;
+        if (dataSize - offset - sizeof(StorageSnapshotRecord) < blockSize) break;
+
+        const char *key = (const char*)&packed[1];
+        if (createStorageRecord(key, packed->keyLength, packed->hash,
+                                key + packed->keyLength + 1, packed->valueLength) == -1) break;
+
+        offset += sizeof(StorageSnapshotRecord) + ((blockSize + 3) & ~(size_t)3);
+    }
+
+    storageSnapshotBase = *header;
+    munmap((void*)file, info.st_size);
+    return true;
+}
+
+
+/**
+ * Wendet die Abschnitte der "STORAGE_DELTA_FILE"-Datei (inkrementelle
+ * Snapshots, siehe StorageDeltaHeader) der Reihe nach auf den geladenen
+ * Snapshot an. Abschnitte zu einem anderen Snapshot, ungültige und alle
+ * danach werden ignoriert. Gibt die Anzahl der angewendeten Abschnitte
+ * zurück.
+ * Nur beim Start direkt nach loadStorageFromSnapshot() aufrufen.
+ *
+ */
+long loadStorageFromDelta ()
+{
+    int fd = open(STORAGE_DELTA_FILE, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *file = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        perror("loadStorageFromDelta mmap");
+        return 0;
+    }
+
+    size_t size = info.st_size;
+    size_t offset = 0;
+    long count = 0;
+    while (size - offset >= sizeof(StorageDeltaHeader)) {
+        // Abschnitte beginnen nur an 4-Byte-Grenzen
+        StorageDeltaHeader header;
+        memcpy(&header, &file[offset], sizeof(header));
+        const char *data = &file[offset + sizeof(header)];
+
+        if (memcmp(header.magic, STORAGE_DELTA_MAGIC, sizeof(header.magic)) != 0 ||
+                header.baseChecksum != storageSnapshotBase.checksum ||
+                header.baseDataSize != storageSnapshotBase.dataSize ||
+                header.dataSize > size - offset - sizeof(header) || header.dataSize % 4 != 0 ||
+                checksumSnapshotData(0, data, header.dataSize) != header.checksum) {
+            break;
+        }
+
+        size_t position = 0;
+        for (unsigned long i = 0; i < (unsigned long)header.deleteCount + header.recordCount; i++) {
+            const StorageSnapshotRecord *packed = (const StorageSnapshotRecord*)&data[position];
+            if (header.dataSize - position < sizeof(StorageSnapshotRecord)) break;
+
+            size_t blockSize = (size_t)packed->keyLength + packed->valueLength + 2;
+            if (header.dataSize - position - sizeof(StorageSnapshotRecord) < blockSize) break;
+
+            const char *key = (const char*)&packed[1];
+            applyJournalRecord((i < header.deleteCount) ? JOURNAL_DEL : JOURNAL_PUT, key, packed->keyLength,
+                               key + packed->keyLength + 1, packed->valueLength);
+
+            position += sizeof(StorageSnapshotRecord) + ((blockSize + 3) & ~(size_t)3);
+        }
+
+        offset += sizeof(header) + header.dataSize;
+        count++;
+    }
+
+    if (offset < size) {
+        fprintf(stderr, "loadStorageFromDelta: %s ignored after %ld deltas (%zu of %zu bytes valid)\n",
+                STORAGE_DELTA_FILE, count, offset, size);
+    }
+
+    munmap((void*)file, info.st_size);
+    return count;
+}
+
+
+/**
+ * Speichert eine Kopie des Storage als binären Snapshot in die
+ * "STORAGE_SNAPSHOT_FILE"-Datei (siehe StorageSnapshotHeader). Die Einträge
+ * werden in einem Puffer gepackt, der jeweils mit einem write() geschrieben
+ * wird; Prüfsumme und Anzahl stehen am Ende im Kopf. Wie bei der CSV-Datei
+ * wird zuerst eine temporäre Datei geschrieben und erst danach umbenannt.
+ *
+ * @param copy - Kopie des Storage (siehe copyStorage())
+ */
+bool saveStorageToSnapshot (const StorageCopy *copy)
+{
+    int fd = createStorageTempFile(STORAGE_SNAPSHOT_TEMP_FILE);
+    if (fd == -1) {
+        return false;
+    }
+
+    StorageSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORAGE_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = STORAGE_SNAPSHOT_VERSION;
+
+    StorageSnapshotWriter writer;
+    bool success = lseek(fd, sizeof(header), SEEK_SET) != -1 && openSnapshotWriter(&writer, fd);
+
+    if (success) {
+        for (int i = 0; !writer.failed && i < copy->endIndex; i++) {
+            const Record *record = &copy->records[i];
+            if (record->data == SLAB_NULL) continue;
+
+            char *target = reserveSnapshotWriter(&writer, getSnapshotRecordSize(record->keyLength,
+                                                                                 record->valueLength));
+            if (target != NULL) {
+                const char *key = getCopiedRecordKey(copy, record);
+                packSnapshotRecord(target, record->hash, key, record->keyLength,
+                                   key + record->keyLength + 1, record->valueLength);
+                header.recordCount++;
+            }
+        }
+        success = closeSnapshotWriter(&writer);
+    }
+
+    if (success) {
+        header.dataSize = writer.dataSize;
+        header.checksum = writer.checksum;
+        success = pwrite(fd, &header, sizeof(header), 0) == sizeof(header) && fsync(fd) == 0;
+    }
+    close(fd);
+
+    if (!replaceStorageFile(STORAGE_SNAPSHOT_TEMP_FILE, STORAGE_SNAPSHOT_FILE, success)) {
+        return false;
+    }
+    storageSnapshotBase = header;
+    return true;
+}
+
+
+/**
+ * Hängt die Änderungen einer Kopie seit der vorherigen (siehe
+ * copyStorageChanges()) als Abschnitt an die "STORAGE_DELTA_FILE"-Datei an.
+ * Der Abschnitt bezieht sich auf den zuletzt gespeicherten Snapshot, ein
+ * abgerissener Abschnitt am Ende der Datei wird dabei überschrieben.
+ * Nur im Snapshot-Timer-Prozess aufrufen.
+ *
+ * @param copy - Kopie des Storage
+ */
+bool saveStorageToDelta (const StorageCopy *copy)
+{
+    int fd = open(STORAGE_DELTA_FILE, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("saveStorageToDelta open");
+        return false;
+    }
+
+    StorageDeltaHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORAGE_DELTA_MAGIC, sizeof(header.magic));
+    header.deleteCount = copy->deleteCount;
+    header.baseDataSize = storageSnapshotBase.dataSize;
+    header.baseChecksum = storageSnapshotBase.checksum;
+
+    off_t start = (off_t)snapshotTimerDeltaSize;
+    StorageSnapshotWriter writer;
+    bool success = ftruncate(fd, start) == 0 && lseek(fd, start + sizeof(header), SEEK_SET) != -1 &&
+                   openSnapshotWriter(&writer, fd);
+
+    if (success) {
+        char *target;
+        if (copy->deletedSize > 0 && (target = reserveSnapshotWriter(&writer, copy->deletedSize)) != NULL) {
+            memcpy(target, copy->deleted, copy->deletedSize);
+        }
+
+        for (int i = 0; !writer.failed && i < copy->changedCount; i++) {
+            int index = copy->changed[i];
+            if (index >= copy->endIndex) continue;
+            const Record *record = &copy->records[index];
+            if (record->data == SLAB_NULL) continue;
+
+            target = reserveSnapshotWriter(&writer, getSnapshotRecordSize(record->keyLength,
+                                                                          record->valueLength));
+            if (target != NULL) {
+                const char *key = getCopiedRecordKey(copy, record);
+                packSnapshotRecord(target, record->hash, key, record->keyLength,
+                                   key + record->keyLength + 1, record->valueLength);
+                header.recordCount++;
+            }
+        }
+        success = closeSnapshotWriter(&writer);
+    }
+
+    if (success) {
+        header.dataSize = writer.dataSize;
+        header.checksum = writer.checksum;
+        success = pwrite(fd, &header, sizeof(header), start) == sizeof(header) &&
+                  fdatasync(fd) == 0; // Danach wird das rotierte Journal gelöscht
+    }
+    close(fd);
+
+    // Eine neu angelegte Datei muss auch im Verzeichnis auf der Platte sein
+    if (success && start == 0) {
+        success = syncStorageDirectory();
+    }
+    if (success) {
+        snapshotTimerDeltaSize += sizeof(header) + header.dataSize;
+    }
+    return success;
+}
+
+
+/**
+ * Speichert eine Kopie des Storage im beim Start gewählten Format.
+ *
+ * @param copy - Kopie des Storage (siehe copyStorage())
+ */
+static bool saveStorageCopy (const StorageCopy *copy)
+{
+    return (storageFormat == STORAGE_FORMAT_BINARY) ? saveStorageToSnapshot(copy) : saveStorageToFile(copy);
+}
+
+
+/**
+ * Speichert den Inhalt des Storage im beim Start gewählten Format.
+ * Nur aufrufen, wenn kein anderer Prozess schreibt (Beenden).
+ *
+ */
+bool saveStorage ()
+{
+    StorageCopy copy;
+    memset(&copy, 0, sizeof(copy));
+
+    bool success = copyStorage(&copy) && saveStorageCopy(&copy);
+    freeStorageCopy(&copy);
+    return success;
+}
+
+
+/**
+ * Snapshot im laufenden Betrieb. Nur das Kopieren hält das Lese-Lock über
+ * alle Stripes; Packen, Prüfsumme, write() und fsync() laufen ohne Lock auf
+ * der Kopie. Im binären Format wird nach einem vollständigen Snapshot
+ * nur noch kopiert und als Delta angehängt, was sich seitdem geändert hat,
+ * bis die Deltas STORAGE_DELTA_MAX_PERCENT der Größe des Snapshots
+ * erreichen; dann wird wieder vollständig gespeichert und die Delta-Datei
+ * gelöscht. Im selben kritischen Abschnitt wird das Journal rotiert: das
+ * rotierte Journal enthält genau die Änderungen bis zur Kopie und wird erst
+ * gelöscht, wenn der Snapshot bzw. das Delta auf der Platte ist. Ein
+ * vollständiger Snapshot kopiert alle belegten Slab-Chunks unter dem Lock
+ * (höchstens SLAB_MAX_CHUNKS * SLAB_CHUNK_SIZE Bytes). Die Kopie bleibt für
+ * die Deltas reserviert, im CSV-Format gibt es keine und sie wird freigegeben.
+ *
+ */
+void eventSnapshotTimer ()
+{
+    bool incremental = storageFormat == STORAGE_FORMAT_BINARY && snapshotTimerDeltaSize >= 0 &&
+                       (unsigned long long)snapshotTimerDeltaSize * 100 <=
+                       storageSnapshotBase.dataSize * STORAGE_DELTA_MAX_PERCENT;
+    double start = getMonotonicSeconds();
+
+    enterCriticalSection(READ_ACCESS);
+    rotateJournal();
+    bool success = incremental ? copyStorageChanges(&snapshotTimerCopy) : copyStorage(&snapshotTimerCopy);
     leaveCriticalSection(READ_ACCESS);
 
-    double time_taken = (double)(clock() - clockTime) / CLOCKS_PER_SEC;
-    printf("Storage saved by Snapshot-Timer (time taken: %f sec).\n", time_taken);
+    double copied = getMonotonicSeconds();
+
+    if (success) {
+        success = incremental ? saveStorageToDelta(&snapshotTimerCopy) : saveStorageCopy(&snapshotTimerCopy);
+    }
+    if (success) {
+        if (!incremental) {
+            // Im Snapshot enthalten, würde wegen der neuen Prüfsumme ohnehin ignoriert
+            unlink(STORAGE_DELTA_FILE);
+            snapshotTimerDeltaSize = 0;
+        }
+        discardRotatedJournal();
+    }
+    else {
+        // Die Änderungen seit dem letzten Snapshot stehen nur noch im Journal
+        snapshotTimerDeltaSize = -1;
+    }
+    if (storageFormat == STORAGE_FORMAT_CSV) {
+        freeStorageCopy(&snapshotTimerCopy);
+    }
+
+    printf("Storage %s by Snapshot-Timer (locked: %f sec, written: %f sec).\n",
+           !success ? "not saved" : incremental ? "delta saved" : "saved",
+           copied - start, getMonotonicSeconds() - copied);
     fflush(stdout);
 }
 